@@ -96,12 +96,99 @@ CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void)
     return (const char*) (global_error.json + global_error.position);
 }
 
+static void* cast_away_const(const void* string);
+static cJSON_bool decode_lazy_in_place(cJSON * const item);
+static cJSON_bool pack_array(cJSON * const array, cJSON_Pool * const pool);
+
+#define CJSON_UINT64_MAX (~(cJSON_uint64)0)
+#define CJSON_INT64_MAX ((cJSON_int64)(CJSON_UINT64_MAX >> 1))
+#define CJSON_INT64_MIN (-CJSON_INT64_MAX - 1)
+
+/* valueint64 only counts while it agrees with valuedouble, which may have been written directly */
+static cJSON_bool has_exact_integer(const cJSON * const item)
+{
+    if (item->type & cJSON_NumberIsInt64)
+    {
+        return (double)item->valueint64 == item->valuedouble;
+    }
+    if (item->type & cJSON_NumberIsUInt64)
+    {
+        return (double)(cJSON_uint64)item->valueint64 == item->valuedouble;
+    }
+
+    return false;
+}
+
+/* Integers a double holds exactly, the numbers of packed arrays must not lose anything. */
+#define CJSON_DOUBLE_INTEGER_LIMIT 9007199254740992.0
+
+/* -0 compares equal to 0, only its bits tell them apart (signbit is C99) */
+static cJSON_bool is_negative_zero(const double number)
+{
+    const double zero = 0.0;
+    return (number == 0) && (memcmp(&number, &zero, sizeof(double)) != 0);
+}
+
+/* Turn item into a number node for an element of a packed array, integers are exact like parsed ones. */
+static void set_packed_number(cJSON * const item, const double number)
+{
+    memset(item, '\0', sizeof(cJSON));
+    item->type = cJSON_Number;
+    cJSON_SetNumberHelper(item, number);
+    /* -0 is only a double, like a parsed one, the integer 0 would print without the sign */
+    if ((number >= -CJSON_DOUBLE_INTEGER_LIMIT) && (number <= CJSON_DOUBLE_INTEGER_LIMIT) && ((double)(cJSON_int64)number == number)
+        && !is_negative_zero(number))
+    {
+        item->valueint64 = (cJSON_int64)number;
+        item->type |= cJSON_NumberIsInt64;
+    }
+}
+
+/* strlen(item->valuestring), the cJSON functions store it when they set a string */
+static size_t string_length(const cJSON * const item)
+{
+    if (item->type & cJSON_StringHasLength)
+    {
+        return (size_t)item->valueint;
+    }
+
+    return strlen(item->valuestring);
+}
+
+/* remember the length of the string that was just set */
+static void set_string_length(cJSON * const item, const size_t length)
+{
+    if (length <= (size_t)INT_MAX)
+    {
+        item->valueint = (int)length;
+        item->type |= cJSON_StringHasLength;
+    }
+    else
+    {
+        item->type &= ~cJSON_StringHasLength;
+    }
+}
+
+CJSON_PUBLIC(size_t) cJSON_GetStringLength(const cJSON * const item)
+{
+    if (cJSON_GetStringValue(item) == NULL)
+    {
+        return 0;
+    }
+
+    return string_length(item);
+}
+
 CJSON_PUBLIC(char *) cJSON_GetStringValue(const cJSON * const item) 
 {
     if (!cJSON_IsString(item)) 
     {
         return NULL;
     }
+    if ((item->type & cJSON_IsLazy) && !decode_lazy_in_place((cJSON*)cast_away_const(item)))
+    {
+        return NULL;
+    }
 
     return item->valuestring;
 }
@@ -112,10 +199,87 @@ CJSON_PUBLIC(double) cJSON_GetNumberValue(const cJSON * const item)
     {
         return (double) NAN;
     }
+    if ((item->type & cJSON_IsLazy) && !decode_lazy_in_place((cJSON*)cast_away_const(item)))
+    {
+        return (double) NAN;
+    }
 
     return item->valuedouble;
 }
 
+CJSON_PUBLIC(cJSON_int64) cJSON_GetInt64Value(const cJSON * const item)
+{
+    double number = 0;
+
+    if (!cJSON_IsNumber(item))
+    {
+        return 0;
+    }
+    if ((item->type & cJSON_IsLazy) && !decode_lazy_in_place((cJSON*)cast_away_const(item)))
+    {
+        return 0;
+    }
+
+    if (has_exact_integer(item))
+    {
+        return (item->type & cJSON_NumberIsUInt64) ? CJSON_INT64_MAX : item->valueint64;
+    }
+
+    /* use saturation in case of overflow */
+    number = item->valuedouble;
+    if (number >= 9223372036854775808.0)
+    {
+        return CJSON_INT64_MAX;
+    }
+    if (number <= -9223372036854775808.0)
+    {
+        return CJSON_INT64_MIN;
+    }
+    if (isnan(number))
+    {
+        return 0;
+    }
+
+    return (cJSON_int64)number;
+}
+
+CJSON_PUBLIC(cJSON_uint64) cJSON_GetUInt64Value(const cJSON * const item)
+{
+    double number = 0;
+
+    if (!cJSON_IsNumber(item))
+    {
+        return 0;
+    }
+    if ((item->type & cJSON_IsLazy) && !decode_lazy_in_place((cJSON*)cast_away_const(item)))
+    {
+        return 0;
+    }
+
+    if (has_exact_integer(item))
+    {
+        if (!(item->type & cJSON_NumberIsUInt64) && (item->valueint64 < 0))
+        {
+            return 0;
+        }
+        return (cJSON_uint64)item->valueint64;
+    }
+
+    /* use saturation in case of overflow */
+    number = item->valuedouble;
+    if (number >= 18446744073709551616.0)
+    {
+        return CJSON_UINT64_MAX;
+    }
+    if (!(number > 0))
+    {
+        /* negative or NaN */
+        return 0;
+    }
+
+    return (cJSON_uint64)number;
+}
+
 /* This is a safeguard to prevent copy-pasters from using incompatible C and header files */
 #if (CJSON_VERSION_MAJOR != 1) || (CJSON_VERSION_MINOR != 7) || (CJSON_VERSION_PATCH != 15)
     #error cJSON.h and cJSON.c have different versions. Make sure that both have the same.
@@ -153,6 +317,46 @@ static int case_insensitive_strcmp(const unsigned char *string1, const unsigned
     return tolower(*string1) - tolower(*string2);
 }
 
+/* FNV-1a over at most "length" bytes of a key, stops at the first '\0'.
+ * ASCII letters are folded to lower case and all other bytes above 0x7F hash the same,
+ * so keys that are equal for case_insensitive_strcmp always have the same hash. */
+static unsigned int hash_key(const unsigned char * const key, const size_t length)
+{
+    unsigned int hash = 2166136261U;
+    size_t position = 0;
+
+    for (position = 0; (position < length) && (key[position] != '\0'); position++)
+    {
+        unsigned int character = key[position];
+        if (character > 0x7F)
+        {
+            character = 0x80;
+        }
+        else if ((character >= 'A') && (character <= 'Z'))
+        {
+            character += 'a' - 'A';
+        }
+        hash = (hash ^ character) * 16777619U;
+    }
+
+    return hash;
+}
+
+/* length of string, but at most max_length */
+static size_t strlen_bounded(const char * const string, const size_t max_length)
+{
+    size_t length = 0;
+    while ((length < max_length) && (string[length] != '\0'))
+    {
+        length++;
+    }
+
+    return length;
+}
+
+/* siblings whose key hash differs can be skipped without comparing the keys */
+#define key_hash_differs(item, hash) ((((item)->type & cJSON_StringIsHashed) != 0) && ((item)->stringhash != (hash)))
+
 typedef struct internal_hooks
 {
     void *(CJSON_CDECL *allocate)(size_t size);
@@ -185,9 +389,85 @@ static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
 
 static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
 
-static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
+/* copies the first "length" bytes of string and terminates the copy, string doesn't have to be zero terminated */
+/* Memory that belongs to a tree comes from the allocator of its nodes, NULL stands for the global hooks. */
+static void *allocate_with(const cJSON_Allocator * const allocator, const size_t size)
+{
+    if (allocator != NULL)
+    {
+        return allocator->allocate(allocator->context, size);
+    }
+
+    return global_hooks.allocate(size);
+}
+
+static void deallocate_with(const cJSON_Allocator * const allocator, void * const pointer)
+{
+    if (pointer == NULL)
+    {
+        /* a cJSON_Allocator is never asked to free NULL */
+        return;
+    }
+    if (allocator != NULL)
+    {
+        allocator->deallocate(allocator->context, pointer);
+        return;
+    }
+
+    global_hooks.deallocate(pointer);
+}
+
+/* A node from a cJSON_Allocator (cJSON_IsAllocated), the allocator is kept in front of it. */
+typedef struct
+{
+    const cJSON_Allocator *allocator;
+    cJSON node;
+} allocated_node;
+
+/* A block made by cJSON_DuplicateFlat: the nodes in pre-order followed by the strings. Every node and
+ * every value string in it holds a reference, the owner pointer in front of them leads back to the block.
+ * Keys are marked const and live as long as their node. */
+typedef struct flat_block flat_block;
+typedef struct
+{
+    flat_block *block;
+    cJSON node;
+} flat_node;
+typedef struct
+{
+    flat_block *block;
+    char text[1];
+} flat_string;
+struct flat_block
+{
+    size_t references;
+    const cJSON_Allocator *allocator;
+    flat_node nodes[1];
+};
+
+/* bytes taken by a string of the given length, the next owner pointer stays aligned */
+#define flat_text_size(length) (((length) + sizeof(flat_block*)) & ~(sizeof(flat_block*) - 1))
+
+#define allocated_node_of(item) ((const allocated_node*)(const void*)((const char*)(item) - offsetof(allocated_node, node)))
+#define flat_node_of(item) ((const flat_node*)(const void*)((const char*)(item) - offsetof(flat_node, node)))
+
+/* The allocator of item's node, its strings, packed numbers and index come from the same one. */
+static const cJSON_Allocator *item_allocator(const cJSON * const item)
+{
+    if (item->type & cJSON_IsAllocated)
+    {
+        return allocated_node_of(item)->allocator;
+    }
+    if (item->type & cJSON_IsFlat)
+    {
+        return flat_node_of(item)->block->allocator;
+    }
+
+    return NULL;
+}
+
+static unsigned char* cJSON_strndup(const unsigned char* string, const size_t length, const cJSON_Allocator * const allocator)
 {
-    size_t length = 0;
     unsigned char *copy = NULL;
 
     if (string == NULL)
@@ -195,17 +475,60 @@ static unsigned char* cJSON_strdup(const unsigned char* string, const internal_h
         return NULL;
     }
 
-    length = strlen((const char*)string) + sizeof("");
-    copy = (unsigned char*)hooks->allocate(length);
+    copy = (unsigned char*)allocate_with(allocator, length + sizeof(""));
     if (copy == NULL)
     {
         return NULL;
     }
     memcpy(copy, string, length);
+    copy[length] = '\0';
 
     return copy;
 }
 
+/* Make item a string value holding a copy of the first length bytes of string, inline if it is short enough. */
+static cJSON_bool set_string_value(cJSON * const item, const char * const string, const size_t length)
+{
+    char *copy = NULL;
+
+    if (length < CJSON_INLINE_STRING_SIZE)
+    {
+        copy = cJSON_InlineString(item);
+        memmove(copy, string, length);
+        copy[length] = '\0';
+        item->type |= cJSON_StringIsInline;
+    }
+    else
+    {
+        copy = (char*)cJSON_strndup((const unsigned char*)string, length, item_allocator(item));
+        if (copy == NULL)
+        {
+            return false;
+        }
+        item->type &= ~cJSON_StringIsInline;
+    }
+    item->valuestring = copy;
+
+    return true;
+}
+
+/* call after setting item->string, "length" may be larger than the key */
+static void hash_item_key(cJSON * const item, const size_t length)
+{
+    item->stringhash = hash_key((const unsigned char*)item->string, length);
+    item->type |= cJSON_StringIsHashed;
+}
+
+static unsigned char* cJSON_strdup(const unsigned char* string, const cJSON_Allocator * const allocator)
+{
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    return cJSON_strndup(string, strlen((const char*)string), allocator);
+}
+
 CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
 {
     if (hooks == NULL)
@@ -237,560 +560,1375 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     }
 }
 
-/* Internal constructor. */
-static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
+/* Internal constructor. Nodes from an allocator start out as cJSON_IsAllocated, keep that bit when setting the type. */
+static cJSON *cJSON_New_Item(const cJSON_Allocator * const allocator)
 {
-    cJSON* node = (cJSON*)hooks->allocate(sizeof(cJSON));
-    if (node)
+    cJSON* node = NULL;
+    allocated_node *allocated = NULL;
+
+    if (allocator == NULL)
+    {
+        node = (cJSON*)global_hooks.allocate(sizeof(cJSON));
+        if (node)
+        {
+            memset(node, '\0', sizeof(cJSON));
+        }
+
+        return node;
+    }
+
+    allocated = (allocated_node*)allocator->allocate(allocator->context, sizeof(allocated_node));
+    if (allocated == NULL)
     {
-        memset(node, '\0', sizeof(cJSON));
+        return NULL;
     }
+    allocated->allocator = allocator;
+    node = &allocated->node;
+    memset(node, '\0', sizeof(cJSON));
+    node->type = cJSON_IsAllocated;
 
     return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+static void release_flat_block(flat_block * const block)
 {
-    cJSON *next = NULL;
-    while (item != NULL)
+    block->references--;
+    if (block->references == 0)
     {
-        next = item->next;
-        if (!(item->type & cJSON_IsReference) && (item->child != NULL))
-        {
-            cJSON_Delete(item->child);
-        }
-        if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
-        {
-            global_hooks.deallocate(item->valuestring);
-        }
-        if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
-        {
-            global_hooks.deallocate(item->string);
-        }
-        global_hooks.deallocate(item);
-        item = next;
+        deallocate_with(block->allocator, block);
     }
 }
 
-/* get the decimal point character of the current locale */
-static unsigned char get_decimal_point(void)
+static void release_flat_node(const cJSON * const item)
 {
-#ifdef ENABLE_LOCALES
-    struct lconv *lconv = localeconv();
-    return (unsigned char) lconv->decimal_point[0];
-#else
-    return '.';
-#endif
+    release_flat_block(flat_node_of(item)->block);
 }
 
-typedef struct
+static void release_flat_string(char * const string)
 {
-    const unsigned char *content;
-    size_t length;
-    size_t offset;
-    size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
-    internal_hooks hooks;
-} parse_buffer;
+    release_flat_block(((flat_string*)(void*)(string - offsetof(flat_string, text)))->block);
+}
 
-/* check if the given size is left to read in a given parse buffer (starting with 1) */
-#define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
-/* check if the buffer can be accessed at the given index (starting with 0) */
-#define can_access_at_index(buffer, index) ((buffer != NULL) && (((buffer)->offset + index) < (buffer)->length))
-#define cannot_access_at_index(buffer, index) (!can_access_at_index(buffer, index))
-/* get a pointer to the buffer at the position */
-#define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
+/* Free the memory of item itself, not what it owns. */
+static void delete_node(cJSON * const item)
+{
+    if (item->type & cJSON_IsFlat)
+    {
+        release_flat_node(item);
+    }
+    else if (item->type & cJSON_IsAllocated)
+    {
+        deallocate_with(allocated_node_of(item)->allocator, cast_away_const(allocated_node_of(item)));
+    }
+    else
+    {
+        global_hooks.deallocate(item);
+    }
+}
 
-/* Parse the input text to generate a number, and populate the result into item. */
-static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
+/* Number of stack entries the tree walks keep on the C stack before they move their stack to the heap. */
+#define WALK_STACK_PREALLOCATED 32
+
+/* An array/object whose children are being walked by one of the tree walks that don't recurse. */
+typedef struct
 {
-    double number = 0;
-    unsigned char *after_end = NULL;
-    unsigned char number_c_string[64];
-    unsigned char decimal_point = get_decimal_point();
-    size_t i = 0;
+    const cJSON *item;
+    cJSON *copy; /* duplicate: the copy of item */
+    const cJSON *other; /* compare: the array/object item is compared with */
+    const cJSON *element; /* compare: the child of item that is compared next */
+    const cJSON *other_element; /* compare: the child of other that is compared next */
+} walk_frame;
+
+/* Explicit stack of the arrays/objects that enclose the current item of a tree walk. */
+typedef struct
+{
+    walk_frame *items;
+    size_t size;
+    size_t capacity;
+    cJSON_bool failed;
+    walk_frame preallocated[WALK_STACK_PREALLOCATED];
+} walk_stack;
+
+static void walk_stack_init(walk_stack * const stack)
+{
+    stack->items = stack->preallocated;
+    stack->size = 0;
+    stack->capacity = WALK_STACK_PREALLOCATED;
+    stack->failed = false;
+}
 
-    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+static void walk_stack_free(walk_stack * const stack)
+{
+    if (stack->items != stack->preallocated)
     {
-        return false;
+        global_hooks.deallocate(stack->items);
     }
+}
 
-    /* copy the number into a temporary buffer and replace '.' with the decimal point
-     * of the current locale (for strtod)
-     * This also takes care of '\0' not necessarily being available for marking the end of the input */
-    for (i = 0; (i < (sizeof(number_c_string) - 1)) && can_access_at_index(input_buffer, i); i++)
-    {
-        switch (buffer_at_offset(input_buffer)[i])
-        {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-            case '+':
-            case '-':
-            case 'e':
-            case 'E':
-                number_c_string[i] = buffer_at_offset(input_buffer)[i];
-                break;
+/* Returns the new top of the stack, or NULL and sets failed if the stack can't grow. */
+static walk_frame *walk_stack_push(walk_stack * const stack, const cJSON * const item)
+{
+    walk_frame *frame = NULL;
 
-            case '.':
-                number_c_string[i] = decimal_point;
-                break;
+    if (stack->size == stack->capacity)
+    {
+        walk_frame *new_items = NULL;
+        size_t new_capacity = stack->capacity * 2;
 
-            default:
-                goto loop_end;
+        if (new_capacity < stack->capacity)
+        {
+            stack->failed = true;
+            return NULL; /* overflow */
+        }
+        new_items = (walk_frame*)global_hooks.allocate(new_capacity * sizeof(walk_frame));
+        if (new_items == NULL)
+        {
+            stack->failed = true;
+            return NULL; /* allocation failure */
         }
+        memcpy(new_items, stack->items, stack->size * sizeof(walk_frame));
+        walk_stack_free(stack);
+        stack->items = new_items;
+        stack->capacity = new_capacity;
     }
-loop_end:
-    number_c_string[i] = '\0';
 
-    number = strtod((const char*)number_c_string, (char**)&after_end);
-    if (number_c_string == after_end)
-    {
-        return false; /* parse_error */
-    }
+    frame = &stack->items[stack->size++];
+    memset(frame, '\0', sizeof(walk_frame));
+    frame->item = item;
 
-    item->valuedouble = number;
+    return frame;
+}
 
-    /* use saturation in case of overflow */
-    if (number >= INT_MAX)
-    {
-        item->valueint = INT_MAX;
-    }
-    else if (number <= (double)INT_MIN)
+/* The item after current in pre-order within the tree the walk started at, or NULL at its end.
+ * Descending into the children of current pushes current, with copy, so the top of the stack is
+ * always the parent of the returned item. */
+static const cJSON *walk_next(walk_stack * const stack, const cJSON *current, cJSON * const copy, const cJSON_bool descend)
+{
+    walk_frame *frame = NULL;
+
+    if (descend && (current->child != NULL))
     {
-        item->valueint = INT_MIN;
+        frame = walk_stack_push(stack, current);
+        if (frame == NULL)
+        {
+            return NULL;
+        }
+        frame->copy = copy;
+        return current->child;
     }
-    else
+    while (stack->size > 0)
     {
-        item->valueint = (int)number;
+        if (current->next != NULL)
+        {
+            return current->next;
+        }
+        current = stack->items[--stack->size].item;
     }
 
-    item->type = cJSON_Number;
-
-    input_buffer->offset += (size_t)(after_end - number_c_string);
-    return true;
+    return NULL;
 }
 
-/* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
-CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
+/* The last item of the list that starts at child. The cJSON functions keep it in child->prev,
+ * but children linked by hand may leave child->prev NULL, then the list is walked. */
+static cJSON *last_sibling(cJSON *child)
 {
-    if (number >= INT_MAX)
+    if ((child->prev != NULL) && (child->prev->next == NULL))
     {
-        object->valueint = INT_MAX;
+        return child->prev;
     }
-    else if (number <= (double)INT_MIN)
+    while (child->next != NULL)
     {
-        object->valueint = INT_MIN;
+        child = child->next;
     }
-    else
+
+    return child;
+}
+
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+{
+    cJSON_DeleteSlice(item, (size_t)-1);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_DeleteSlice(cJSON *item, size_t count)
+{
+    cJSON *next = NULL;
+    /* item and its siblings are a work list, children get spliced in front of the remaining siblings
+     * so the tree is taken apart without recursion, and the rest of the list is what is left to delete */
+    for (; (item != NULL) && (count > 0); count--)
     {
-        object->valueint = (int)number;
+        next = item->next;
+        if (!(item->type & cJSON_IsReference) && (item->child != NULL))
+        {
+            last_sibling(item->child)->next = next;
+            next = item->child;
+        }
+        if (!(item->type & (cJSON_IsReference | cJSON_IsLazy | cJSON_StringIsInline)) && (item->valuestring != NULL))
+        {
+            if (item->type & cJSON_StringIsFlat)
+            {
+                release_flat_string(item->valuestring);
+            }
+            else
+            {
+                deallocate_with(item_allocator(item), item->valuestring);
+            }
+        }
+        if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
+        {
+            deallocate_with(item_allocator(item), item->string);
+        }
+        delete_node(item);
+        item = next;
     }
 
-    return object->valuedouble = number;
+    return item;
 }
 
-CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
+/* Number of size classes for string buffers in a cJSON_Pool, class i holds buffers of at least (8 << i) bytes. */
+#define POOL_STRING_CLASSES 12
+#define POOL_MIN_STRING_SIZE ((size_t)8)
+
+struct cJSON_Pool
 {
-    char *copy = NULL;
-    /* if object's type is not cJSON_String or is cJSON_IsReference, it should not set valuestring */
-    if (!(object->type & cJSON_String) || (object->type & cJSON_IsReference))
+    /* free nodes, linked through next */
+    cJSON *nodes;
+    /* free string buffers, linked through their first bytes */
+    void *strings[POOL_STRING_CLASSES];
+    /* where the pool, its nodes and strings come from, NULL for the global hooks */
+    const cJSON_Allocator *allocator;
+};
+
+CJSON_PUBLIC(cJSON_Pool *) cJSON_CreatePool(void)
+{
+    return cJSON_CreatePoolWithAllocator(NULL);
+}
+
+CJSON_PUBLIC(cJSON_Pool *) cJSON_CreatePoolWithAllocator(const cJSON_Allocator *allocator)
+{
+    cJSON_Pool *pool = (cJSON_Pool*)allocate_with(allocator, sizeof(cJSON_Pool));
+    if (pool != NULL)
     {
-        return NULL;
+        memset(pool, '\0', sizeof(cJSON_Pool));
+        pool->allocator = allocator;
     }
-    if (strlen(valuestring) <= strlen(object->valuestring))
+
+    return pool;
+}
+
+CJSON_PUBLIC(void) cJSON_DeletePool(cJSON_Pool *pool)
+{
+    size_t i = 0;
+
+    if (pool == NULL)
     {
-        strcpy(object->valuestring, valuestring);
-        return object->valuestring;
+        return;
     }
-    copy = (char*) cJSON_strdup((const unsigned char*)valuestring, &global_hooks);
-    if (copy == NULL)
+
+    while (pool->nodes != NULL)
     {
-        return NULL;
+        cJSON *next = pool->nodes->next;
+        delete_node(pool->nodes);
+        pool->nodes = next;
     }
-    if (object->valuestring != NULL)
+    for (i = 0; i < POOL_STRING_CLASSES; i++)
     {
-        cJSON_free(object->valuestring);
+        while (pool->strings[i] != NULL)
+        {
+            void *next = *(void**)pool->strings[i];
+            deallocate_with(pool->allocator, pool->strings[i]);
+            pool->strings[i] = next;
+        }
     }
-    object->valuestring = copy;
-
-    return copy;
+    deallocate_with(pool->allocator, pool);
 }
 
-typedef struct
+/* Keys are copied into chunks of this size, longer keys get a chunk of their own. */
+#define KEY_TABLE_CHUNK_SIZE ((size_t)4096)
+
+typedef struct key_table_chunk
 {
-    unsigned char *buffer;
-    size_t length;
-    size_t offset;
-    size_t depth; /* current nesting depth (for formatted printing) */
-    cJSON_bool noalloc;
-    cJSON_bool format; /* is this print a formatted print */
+    struct key_table_chunk *next;
+    size_t used;
+    size_t size;
+    /* followed by size bytes of keys */
+} key_table_chunk;
+
+struct cJSON_KeyTable
+{
+    /* open addressing, capacity is a power of two and entries with a NULL string are free */
+    cJSON_Key *entries;
+    size_t capacity;
+    size_t size;
+    /* keys are never moved, the first chunk is the one that is being filled */
+    key_table_chunk *chunks;
+    void (*lock)(void *context);
+    void (*unlock)(void *context);
+    void *context;
     internal_hooks hooks;
-} printbuffer;
+};
 
-/* realloc printbuffer if necessary to have at least "needed" bytes more */
-static unsigned char* ensure(printbuffer * const p, size_t needed)
+CJSON_PUBLIC(cJSON_KeyTable *) cJSON_CreateKeyTable(void (*lock)(void *context), void (*unlock)(void *context), void *context)
 {
-    unsigned char *newbuffer = NULL;
-    size_t newsize = 0;
+    cJSON_KeyTable *table = (cJSON_KeyTable*)global_hooks.allocate(sizeof(cJSON_KeyTable));
+    if (table != NULL)
+    {
+        memset(table, '\0', sizeof(cJSON_KeyTable));
+        table->lock = lock;
+        table->unlock = unlock;
+        table->context = context;
+        table->hooks = global_hooks;
+    }
 
-    if ((p == NULL) || (p->buffer == NULL))
+    return table;
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteKeyTable(cJSON_KeyTable *table)
+{
+    if (table == NULL)
     {
-        return NULL;
+        return;
     }
 
-    if ((p->length > 0) && (p->offset >= p->length))
+    while (table->chunks != NULL)
     {
-        /* make sure that offset is valid */
-        return NULL;
+        key_table_chunk *next = table->chunks->next;
+        table->hooks.deallocate(table->chunks);
+        table->chunks = next;
     }
+    if (table->entries != NULL)
+    {
+        table->hooks.deallocate(table->entries);
+    }
+    table->hooks.deallocate(table);
+}
 
-    if (needed > INT_MAX)
+static cJSON_bool key_table_grow(cJSON_KeyTable * const table)
+{
+    size_t capacity = (table->capacity == 0) ? 64 : (table->capacity * 2);
+    size_t index = 0;
+    cJSON_Key *entries = (cJSON_Key*)table->hooks.allocate(capacity * sizeof(cJSON_Key));
+    if (entries == NULL)
     {
-        /* sizes bigger than INT_MAX are currently not supported */
-        return NULL;
+        return false;
     }
+    memset(entries, '\0', capacity * sizeof(cJSON_Key));
 
-    needed += p->offset + 1;
-    if (needed <= p->length)
+    for (index = 0; index < table->capacity; index++)
     {
-        return p->buffer + p->offset;
+        if (table->entries[index].string != NULL)
+        {
+            size_t position = table->entries[index].hash & (capacity - 1);
+            while (entries[position].string != NULL)
+            {
+                position = (position + 1) & (capacity - 1);
+            }
+            entries[position] = table->entries[index];
+        }
     }
 
-    if (p->noalloc) {
-        return NULL;
+    if (table->entries != NULL)
+    {
+        table->hooks.deallocate(table->entries);
     }
+    table->entries = entries;
+    table->capacity = capacity;
 
-    /* calculate new buffer size */
-    if (needed > (INT_MAX / 2))
+    return true;
+}
+
+/* copy a key into the chunks */
+static const char *key_table_store(cJSON_KeyTable * const table, const unsigned char * const string, const size_t length)
+{
+    size_t size = length + sizeof("");
+    key_table_chunk *chunk = table->chunks;
+    char *copy = NULL;
+
+    if ((chunk == NULL) || ((chunk->size - chunk->used) < size))
     {
-        /* overflow of int, use INT_MAX if possible */
-        if (needed <= INT_MAX)
+        size_t chunk_size = (size > (KEY_TABLE_CHUNK_SIZE / 4)) ? size : KEY_TABLE_CHUNK_SIZE;
+        chunk = (key_table_chunk*)table->hooks.allocate(sizeof(key_table_chunk) + chunk_size);
+        if (chunk == NULL)
         {
-            newsize = INT_MAX;
+            return NULL;
+        }
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        if ((chunk_size != KEY_TABLE_CHUNK_SIZE) && (table->chunks != NULL))
+        {
+            /* a long key doesn't replace the chunk that is being filled */
+            chunk->next = table->chunks->next;
+            table->chunks->next = chunk;
         }
         else
         {
-            return NULL;
+            chunk->next = table->chunks;
+            table->chunks = chunk;
         }
     }
-    else
+
+    copy = (char*)(chunk + 1) + chunk->used;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    chunk->used += size;
+
+    return copy;
+}
+
+/* string must not contain '\0', the caller holds the lock */
+static const char *key_table_intern(cJSON_KeyTable * const table, const unsigned char * const string, const size_t length, const unsigned int hash)
+{
+    size_t index = 0;
+    const char *copy = NULL;
+
+    /* keep the load factor below 3/4 */
+    if (((table->size + 1) * 4 > table->capacity * 3) && !key_table_grow(table))
     {
-        newsize = needed * 2;
+        return NULL;
     }
 
-    if (p->hooks.reallocate != NULL)
+    index = hash & (table->capacity - 1);
+    while (table->entries[index].string != NULL)
     {
-        /* reallocate with realloc if available */
-        newbuffer = (unsigned char*)p->hooks.reallocate(p->buffer, newsize);
-        if (newbuffer == NULL)
+        if ((table->entries[index].hash == hash) && (table->entries[index].length == length) && (memcmp(table->entries[index].string, string, length) == 0))
         {
-            p->hooks.deallocate(p->buffer);
-            p->length = 0;
-            p->buffer = NULL;
-
-            return NULL;
+            return table->entries[index].string;
         }
+        index = (index + 1) & (table->capacity - 1);
     }
-    else
-    {
-        /* otherwise reallocate manually */
-        newbuffer = (unsigned char*)p->hooks.allocate(newsize);
-        if (!newbuffer)
-        {
-            p->hooks.deallocate(p->buffer);
-            p->length = 0;
-            p->buffer = NULL;
 
-            return NULL;
-        }
-        
-        memcpy(newbuffer, p->buffer, p->offset + 1);
-        p->hooks.deallocate(p->buffer);
+    copy = key_table_store(table, string, length);
+    if (copy != NULL)
+    {
+        table->entries[index].string = copy;
+        table->entries[index].length = length;
+        table->entries[index].hash = hash;
+        table->size++;
     }
-    p->length = newsize;
-    p->buffer = newbuffer;
 
-    return newbuffer + p->offset;
+    return copy;
 }
 
-/* calculate the new length of the string in a printbuffer and update the offset */
-static void update_offset(printbuffer * const buffer)
+static const char *key_table_intern_locked(cJSON_KeyTable * const table, const unsigned char * const string, const size_t length, const unsigned int hash)
 {
-    const unsigned char *buffer_pointer = NULL;
-    if ((buffer == NULL) || (buffer->buffer == NULL))
+    const char *copy = NULL;
+
+    if (table->lock != NULL)
     {
-        return;
+        table->lock(table->context);
+    }
+    copy = key_table_intern(table, string, length, hash);
+    if (table->unlock != NULL)
+    {
+        table->unlock(table->context);
     }
-    buffer_pointer = buffer->buffer + buffer->offset;
 
-    buffer->offset += strlen((const char*)buffer_pointer);
+    return copy;
 }
 
-/* securely comparison of floating-point variables */
-static cJSON_bool compare_double(double a, double b)
+CJSON_PUBLIC(const char *) cJSON_InternKey(cJSON_KeyTable *table, const char *string, size_t length)
 {
-    double maxVal = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
-    return (fabs(a - b) <= maxVal * DBL_EPSILON);
+    if ((table == NULL) || (string == NULL))
+    {
+        return NULL;
+    }
+
+    /* like the other key functions the key ends at the first '\0' */
+    length = strlen_bounded(string, length);
+
+    return key_table_intern_locked(table, (const unsigned char*)string, length, hash_key((const unsigned char*)string, length));
 }
 
-/* Render the number nicely from the given item into a string. */
-static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+CJSON_PUBLIC(size_t) cJSON_GetKeyTableSize(cJSON_KeyTable *table)
 {
-    unsigned char *output_pointer = NULL;
-    double d = item->valuedouble;
-    int length = 0;
-    size_t i = 0;
-    unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-    double test = 0.0;
+    size_t size = 0;
 
-    if (output_buffer == NULL)
+    if (table == NULL)
     {
-        return false;
+        return 0;
     }
 
-    /* This checks for NaN and Infinity */
-    if (isnan(d) || isinf(d))
+    if (table->lock != NULL)
     {
-        length = sprintf((char*)number_buffer, "null");
+        table->lock(table->context);
     }
-    else
+    size = table->size;
+    if (table->unlock != NULL)
     {
-        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
-        length = sprintf((char*)number_buffer, "%1.15g", d);
+        table->unlock(table->context);
+    }
 
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || !compare_double((double)test, d))
+    return size;
+}
+
+/* the smallest class whose buffers hold size bytes, POOL_STRING_CLASSES if there is none */
+static size_t pool_string_class(size_t size)
+{
+    size_t string_class = 0;
+    while ((string_class < POOL_STRING_CLASSES) && ((POOL_MIN_STRING_SIZE << string_class) < size))
+    {
+        string_class++;
+    }
+
+    return string_class;
+}
+
+/* keep a string buffer of at least size bytes for later use */
+static void pool_put_string(cJSON_Pool * const pool, char *string, cJSON_bool pooled)
+{
+    size_t size = strlen(string) + sizeof("");
+    size_t string_class = 0;
+
+    if (pooled)
+    {
+        /* strings from the pool always fill their whole class */
+        string_class = pool_string_class(size);
+        if (string_class < POOL_STRING_CLASSES)
         {
-            /* If not, print with 17 decimal places of precision */
-            length = sprintf((char*)number_buffer, "%1.17g", d);
+            size = POOL_MIN_STRING_SIZE << string_class;
         }
     }
 
-    /* sprintf failed or buffer overrun occurred */
-    if ((length < 0) || (length > (int)(sizeof(number_buffer) - 1)))
+    if (size < POOL_MIN_STRING_SIZE)
     {
-        return false;
+        /* too small to be linked */
+        deallocate_with(pool->allocator, string);
+        return;
     }
 
-    /* reserve appropriate space in the output */
-    output_pointer = ensure(output_buffer, (size_t)length + sizeof(""));
-    if (output_pointer == NULL)
+    /* the largest class that is guaranteed to fit into the buffer */
+    string_class = 0;
+    while (((string_class + 1) < POOL_STRING_CLASSES) && ((POOL_MIN_STRING_SIZE << (string_class + 1)) <= size))
     {
-        return false;
+        string_class++;
     }
 
-    /* copy the printed number to the output and replace locale
-     * dependent decimal point with '.' */
-    for (i = 0; i < ((size_t)length); i++)
+    *(void**)string = pool->strings[string_class];
+    pool->strings[string_class] = string;
+}
+
+/* get a string buffer of at least size bytes, from the pool if possible */
+static unsigned char *pool_get_string(cJSON_Pool * const pool, size_t size)
+{
+    size_t string_class = pool_string_class(size);
+
+    if (string_class >= POOL_STRING_CLASSES)
     {
-        if (number_buffer[i] == decimal_point)
+        return (unsigned char*)allocate_with(pool->allocator, size);
+    }
+
+    for (; string_class < POOL_STRING_CLASSES; string_class++)
+    {
+        void *string = pool->strings[string_class];
+        if (string != NULL)
         {
-            output_pointer[i] = '.';
-            continue;
+            pool->strings[string_class] = *(void**)string;
+            return (unsigned char*)string;
         }
-
-        output_pointer[i] = number_buffer[i];
     }
-    output_pointer[i] = '\0';
 
-    output_buffer->offset += (size_t)length;
+    /* round up, so the buffer can be put back into the same class */
+    return (unsigned char*)allocate_with(pool->allocator, POOL_MIN_STRING_SIZE << pool_string_class(size));
+}
 
-    return true;
+static cJSON *pool_get_item(cJSON_Pool * const pool)
+{
+    cJSON *node = pool->nodes;
+    if (node == NULL)
+    {
+        return cJSON_New_Item(pool->allocator);
+    }
+
+    pool->nodes = node->next;
+    memset(node, '\0', sizeof(cJSON));
+    if (pool->allocator != NULL)
+    {
+        node->type = cJSON_IsAllocated;
+    }
+    return node;
 }
 
-/* parse 4 digit hexadecimal number */
-static unsigned parse_hex4(const unsigned char * const input)
+CJSON_PUBLIC(void) cJSON_DeleteToPool(cJSON_Pool *pool, cJSON *item)
 {
-    unsigned int h = 0;
-    size_t i = 0;
+    if (pool == NULL)
+    {
+        cJSON_Delete(item);
+        return;
+    }
 
-    for (i = 0; i < 4; i++)
+    /* item and its siblings are a work list, children get spliced in front of the remaining siblings
+     * so the tree is taken apart without recursion */
+    while (item != NULL)
     {
-        /* parse digit */
-        if ((input[i] >= '0') && (input[i] <= '9'))
+        cJSON *next = item->next;
+        /* only memory from the allocator of the pool can be kept in it */
+        const cJSON_Allocator *allocator = item_allocator(item);
+        const cJSON_bool foreign = (allocator != pool->allocator) || ((item->type & cJSON_IsFlat) != 0);
+        if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
-            h += (unsigned int) input[i] - '0';
+            last_sibling(item->child)->next = next;
+            next = item->child;
         }
-        else if ((input[i] >= 'A') && (input[i] <= 'F'))
+        if ((item->type & (cJSON_IsPacked | cJSON_IsIndexed)) && !(item->type & cJSON_IsReference) && (item->valuestring != NULL))
         {
-            h += (unsigned int) 10 + input[i] - 'A';
+            /* not a string, it can't be linked by its length */
+            deallocate_with(allocator, item->valuestring);
         }
-        else if ((input[i] >= 'a') && (input[i] <= 'f'))
+        else if (item->type & cJSON_StringIsFlat)
         {
-            h += (unsigned int) 10 + input[i] - 'a';
+            release_flat_string(item->valuestring);
         }
-        else /* invalid */
+        else if (!(item->type & (cJSON_IsReference | cJSON_IsLazy | cJSON_StringIsInline)) && (item->valuestring != NULL))
         {
-            return 0;
+            if (foreign)
+            {
+                deallocate_with(allocator, item->valuestring);
+            }
+            else
+            {
+                pool_put_string(pool, item->valuestring, item->type & cJSON_StringIsPooled);
+            }
         }
-
-        if (i < 3)
+        if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
         {
-            /* shift left to make place for the next nibble */
-            h = h << 4;
+            if (foreign)
+            {
+                deallocate_with(allocator, item->string);
+            }
+            else
+            {
+                pool_put_string(pool, item->string, item->type & cJSON_StringIsPooled);
+            }
+        }
+        if (foreign)
+        {
+            /* a flat node goes back to its block, not to the pool */
+            delete_node(item);
         }
+        else
+        {
+            item->next = pool->nodes;
+            pool->nodes = item;
+        }
+        item = next;
     }
+}
 
-    return h;
+/* get the decimal point character of the current locale */
+static unsigned char get_decimal_point(void)
+{
+#ifdef ENABLE_LOCALES
+    struct lconv *lconv = localeconv();
+    return (unsigned char) lconv->decimal_point[0];
+#else
+    return '.';
+#endif
 }
 
-/* converts a UTF-16 literal to UTF-8
- * A literal can be one or two sequences of the form \uXXXX */
-static unsigned char utf16_literal_to_utf8(const unsigned char * const input_pointer, const unsigned char * const input_end, unsigned char **output_pointer)
+typedef struct
 {
-    long unsigned int codepoint = 0;
-    unsigned int first_code = 0;
-    const unsigned char *first_sequence = input_pointer;
-    unsigned char utf8_length = 0;
-    unsigned char utf8_position = 0;
-    unsigned char sequence_length = 0;
-    unsigned char first_byte_mark = 0;
+    const unsigned char *content;
+    size_t length;
+    size_t offset;
+    size_t nesting_limit; /* How deeply nested (in arrays/objects) the input is allowed to be. */
+    cJSON_ParseError error; /* Why parsing failed, reported through cJSON_ParseResult. */
+    cJSON_Pool *pool; /* Where nodes and strings are taken from, if not NULL. */
+    cJSON_bool lazy; /* Keep strings and numbers undecoded. */
+    cJSON_KeyTable *keys; /* Where object keys are interned, if not NULL. */
+    cJSON_bool pack; /* Pack arrays of numbers when they are closed. */
+    const cJSON_Allocator *allocator; /* Where nodes and strings are allocated if there is no pool, NULL for the global hooks. */
+    internal_hooks hooks;
+} parse_buffer;
 
-    if ((input_end - first_sequence) < 6)
+/* allocate a node/string for the parsed document */
+static cJSON *parse_new_item(const parse_buffer * const input_buffer)
+{
+    cJSON *item = NULL;
+    if (input_buffer->pool != NULL)
     {
-        /* input ends unexpectedly */
-        goto fail;
+        item = pool_get_item(input_buffer->pool);
+        if (item != NULL)
+        {
+            /* the parser only adds type bits, so this stays set */
+            item->type |= cJSON_StringIsPooled;
+        }
+        return item;
     }
 
-    /* get the first utf16 sequence */
-    first_code = parse_hex4(first_sequence + 2);
+    return cJSON_New_Item(input_buffer->allocator);
+}
 
-    /* check that the code is valid */
-    if (((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
+static unsigned char *parse_allocate_string(const parse_buffer * const input_buffer, size_t size)
+{
+    if (input_buffer->pool != NULL)
     {
-        goto fail;
+        return pool_get_string(input_buffer->pool, size);
     }
 
-    /* UTF16 surrogate pair */
-    if ((first_code >= 0xD800) && (first_code <= 0xDBFF))
+    return (unsigned char*)allocate_with(input_buffer->allocator, size);
+}
+
+/* free a string from parse_allocate_string that didn't make it into the tree */
+static void parse_free_string(const parse_buffer * const input_buffer, unsigned char * const string)
+{
+    if (input_buffer->pool != NULL)
     {
-        const unsigned char *second_sequence = first_sequence + 6;
-        unsigned int second_code = 0;
-        sequence_length = 12; /* \uXXXX\uXXXX */
+        deallocate_with(input_buffer->pool->allocator, string);
+        return;
+    }
 
-        if ((input_end - second_sequence) < 6)
-        {
-            /* input ends unexpectedly */
-            goto fail;
-        }
+    deallocate_with(input_buffer->allocator, string);
+}
 
-        if ((second_sequence[0] != '\\') || (second_sequence[1] != 'u'))
-        {
-            /* missing second half of the surrogate pair */
-            goto fail;
-        }
+/* check if the given size is left to read in a given parse buffer (starting with 1) */
+#define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
+/* check if the buffer can be accessed at the given index (starting with 0) */
+#define can_access_at_index(buffer, index) ((buffer != NULL) && (((buffer)->offset + index) < (buffer)->length))
+#define cannot_access_at_index(buffer, index) (!can_access_at_index(buffer, index))
+/* get a pointer to the buffer at the position */
+#define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
-        /* get the second utf16 sequence */
-        second_code = parse_hex4(second_sequence + 2);
-        /* check that the code is valid */
-        if ((second_code < 0xDC00) || (second_code > 0xDFFF))
-        {
-            /* invalid second half of the surrogate pair */
-            goto fail;
-        }
+#define is_digit(character) (((character) >= '0') && ((character) <= '9'))
 
+/* Parse a number without fraction and exponent exactly and without strtod.
+ * Returns false without consuming anything if the number is no such integer, parse_number falls back to strtod then. */
+static cJSON_bool parse_integer(cJSON * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *number = buffer_at_offset(input_buffer);
+    size_t available = input_buffer->length - input_buffer->offset;
+    size_t length = 0;
+    cJSON_bool negative = false;
+    cJSON_uint64 magnitude = 0;
 
-        /* calculate the unicode codepoint from the surrogate pair */
-        codepoint = 0x10000 + (((first_code & 0x3FF) << 10) | (second_code & 0x3FF));
-    }
-    else
+    /* parse_number doesn't look further either */
+    if (available > 63)
     {
-        sequence_length = 6; /* \uXXXX */
-        codepoint = first_code;
+        available = 63;
     }
 
-    /* encode as UTF-8
-     * takes at maximum 4 bytes to encode:
-     * 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
-    if (codepoint < 0x80)
+    if ((length < available) && (number[length] == '-'))
     {
-        /* normal ascii, encoding 0xxxxxxx */
-        utf8_length = 1;
+        negative = true;
+        length++;
     }
-    else if (codepoint < 0x800)
+    if ((length >= available) || !is_digit(number[length]))
     {
-        /* two bytes, encoding 110xxxxx 10xxxxxx */
-        utf8_length = 2;
-        first_byte_mark = 0xC0; /* 11000000 */
+        return false;
     }
-    else if (codepoint < 0x10000)
+    for (; (length < available) && is_digit(number[length]); length++)
     {
-        /* three bytes, encoding 1110xxxx 10xxxxxx 10xxxxxx */
-        utf8_length = 3;
-        first_byte_mark = 0xE0; /* 11100000 */
+        unsigned int digit = (unsigned int)(number[length] - '0');
+        if (magnitude > ((CJSON_UINT64_MAX - digit) / 10))
+        {
+            return false; /* too large for 64 bits */
+        }
+        magnitude = (magnitude * 10) + digit;
     }
-    else if (codepoint <= 0x10FFFF)
+    if ((length < available) && ((number[length] == '.') || (number[length] == 'e') || (number[length] == 'E')))
     {
-        /* four bytes, encoding 1110xxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-        utf8_length = 4;
-        first_byte_mark = 0xF0; /* 11110000 */
+        return false; /* fraction or exponent */
     }
-    else
+
+    if (negative)
     {
-        /* invalid unicode codepoint */
-        goto fail;
+        if ((magnitude == 0) || (magnitude > ((cJSON_uint64)CJSON_INT64_MAX + 1)))
+        {
+            return false; /* -0 is only a double, or too small */
+        }
+        item->valueint64 = (magnitude == ((cJSON_uint64)CJSON_INT64_MAX + 1)) ? CJSON_INT64_MIN : -(cJSON_int64)magnitude;
+        item->valuedouble = (double)item->valueint64;
+        item->type |= cJSON_Number | cJSON_NumberIsInt64;
     }
-
-    /* encode as utf8 */
-    for (utf8_position = (unsigned char)(utf8_length - 1); utf8_position > 0; utf8_position--)
+    else
     {
-        /* 10xxxxxx */
-        (*output_pointer)[utf8_position] = (unsigned char)((codepoint | 0x80) & 0xBF);
-        codepoint >>= 6;
+        item->valueint64 = (cJSON_int64)magnitude;
+        item->valuedouble = (double)magnitude;
+        item->type |= cJSON_Number | ((magnitude > (cJSON_uint64)CJSON_INT64_MAX) ? cJSON_NumberIsUInt64 : cJSON_NumberIsInt64);
     }
-    /* encode first byte */
-    if (utf8_length > 1)
+
+    /* use saturation in case of overflow */
+    if (negative)
     {
-        (*output_pointer)[0] = (unsigned char)((codepoint | first_byte_mark) & 0xFF);
+        item->valueint = (item->valueint64 <= INT_MIN) ? INT_MIN : (int)item->valueint64;
     }
     else
     {
-        (*output_pointer)[0] = (unsigned char)(codepoint & 0x7F);
+        item->valueint = (magnitude >= INT_MAX) ? INT_MAX : (int)magnitude;
     }
 
-    *output_pointer += utf8_length;
-
-    return sequence_length;
-
-fail:
-    return 0;
+    input_buffer->offset += length;
+    return true;
 }
 
-/* Parse the input text into an unescaped cinput, and populate item. */
-static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
+/* Parse the input text to generate a number, and populate the result into item. */
+static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
-    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
-    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
-    unsigned char *output_pointer = NULL;
-    unsigned char *output = NULL;
+    double number = 0;
+    unsigned char *after_end = NULL;
+    unsigned char number_c_string[64];
+    unsigned char decimal_point = get_decimal_point();
+    size_t i = 0;
 
-    /* not a string */
-    if (buffer_at_offset(input_buffer)[0] != '\"')
+    if ((input_buffer == NULL) || (input_buffer->content == NULL))
     {
-        goto fail;
+        return false;
     }
 
+    if (parse_integer(item, input_buffer))
     {
-        /* calculate approximate size of the output (overestimate) */
-        size_t allocation_length = 0;
-        size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        return true;
+    }
+
+    /* copy the number into a temporary buffer and replace '.' with the decimal point
+     * of the current locale (for strtod)
+     * This also takes care of '\0' not necessarily being available for marking the end of the input */
+    for (i = 0; (i < (sizeof(number_c_string) - 1)) && can_access_at_index(input_buffer, i); i++)
+    {
+        switch (buffer_at_offset(input_buffer)[i])
         {
-            /* is escape sequence */
-            if (input_end[0] == '\\')
-            {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+            case '+':
+            case '-':
+            case 'e':
+            case 'E':
+                number_c_string[i] = buffer_at_offset(input_buffer)[i];
+                break;
+
+            case '.':
+                number_c_string[i] = decimal_point;
+                break;
+
+            default:
+                goto loop_end;
+        }
+    }
+loop_end:
+    number_c_string[i] = '\0';
+
+    number = strtod((const char*)number_c_string, (char**)&after_end);
+    if (number_c_string == after_end)
+    {
+        input_buffer->error = cJSON_ParseErrorIllegalNumber;
+        return false; /* parse_error */
+    }
+
+    item->valuedouble = number;
+
+    /* use saturation in case of overflow */
+    if (number >= INT_MAX)
+    {
+        item->valueint = INT_MAX;
+    }
+    else if (number <= (double)INT_MIN)
+    {
+        item->valueint = INT_MIN;
+    }
+    else
+    {
+        item->valueint = (int)number;
+    }
+
+    item->type |= cJSON_Number;
+
+    input_buffer->offset += (size_t)(after_end - number_c_string);
+    return true;
+}
+
+/* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
+CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
+{
+    if (object->type & cJSON_IsLazy)
+    {
+        /* the text of the old value must not be printed anymore */
+        object->type &= ~cJSON_IsLazy;
+        object->valuestring = NULL;
+    }
+    object->type &= ~(cJSON_NumberIsInt64 | cJSON_NumberIsUInt64);
+
+    if (number >= INT_MAX)
+    {
+        object->valueint = INT_MAX;
+    }
+    else if (number <= (double)INT_MIN)
+    {
+        object->valueint = INT_MIN;
+    }
+    else
+    {
+        object->valueint = (int)number;
+    }
+
+    return object->valuedouble = number;
+}
+
+CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
+{
+    char *old_string = NULL;
+    int old_type = 0;
+    size_t length = 0;
+    /* if object's type is not cJSON_String or is cJSON_IsReference, it should not set valuestring */
+    if (!(object->type & cJSON_String) || (object->type & cJSON_IsReference))
+    {
+        return NULL;
+    }
+    length = strlen(valuestring);
+    if (!(object->type & cJSON_IsLazy) && (length <= string_length(object)))
+    {
+        memmove(object->valuestring, valuestring, length + sizeof(""));
+        set_string_length(object, length);
+        return object->valuestring;
+    }
+    /* the old string is freed after the copy, valuestring may point into it */
+    old_type = object->type;
+    old_string = (old_type & (cJSON_IsLazy | cJSON_StringIsInline)) ? NULL : object->valuestring;
+    if (!set_string_value(object, valuestring, length))
+    {
+        return NULL;
+    }
+    if ((old_string != NULL) && (old_type & cJSON_StringIsFlat))
+    {
+        release_flat_string(old_string);
+    }
+    else if (old_string != NULL)
+    {
+        deallocate_with(item_allocator(object), old_string);
+    }
+    object->type &= ~(cJSON_StringIsPooled | cJSON_IsLazy | cJSON_StringIsFlat);
+    set_string_length(object, length);
+
+    return object->valuestring;
+}
+
+typedef struct
+{
+    unsigned char *buffer;
+    size_t length;
+    size_t offset;
+    size_t depth; /* current nesting depth (for formatted printing) */
+    cJSON_bool noalloc;
+    cJSON_bool format; /* is this print a formatted print */
+    internal_hooks hooks;
+} printbuffer;
+
+/* realloc printbuffer if necessary to have at least "needed" bytes more */
+static unsigned char* ensure(printbuffer * const p, size_t needed)
+{
+    unsigned char *newbuffer = NULL;
+    size_t newsize = 0;
+
+    if ((p == NULL) || (p->buffer == NULL))
+    {
+        return NULL;
+    }
+
+    if ((p->length > 0) && (p->offset >= p->length))
+    {
+        /* make sure that offset is valid */
+        return NULL;
+    }
+
+    if (needed > INT_MAX)
+    {
+        /* sizes bigger than INT_MAX are currently not supported */
+        return NULL;
+    }
+
+    needed += p->offset + 1;
+    if (needed <= p->length)
+    {
+        return p->buffer + p->offset;
+    }
+
+    if (p->noalloc) {
+        return NULL;
+    }
+
+    /* calculate new buffer size */
+    if (needed > (INT_MAX / 2))
+    {
+        /* overflow of int, use INT_MAX if possible */
+        if (needed <= INT_MAX)
+        {
+            newsize = INT_MAX;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        newsize = needed * 2;
+    }
+
+    if (p->hooks.reallocate != NULL)
+    {
+        /* reallocate with realloc if available */
+        newbuffer = (unsigned char*)p->hooks.reallocate(p->buffer, newsize);
+        if (newbuffer == NULL)
+        {
+            p->hooks.deallocate(p->buffer);
+            p->length = 0;
+            p->buffer = NULL;
+
+            return NULL;
+        }
+    }
+    else
+    {
+        /* otherwise reallocate manually */
+        newbuffer = (unsigned char*)p->hooks.allocate(newsize);
+        if (!newbuffer)
+        {
+            p->hooks.deallocate(p->buffer);
+            p->length = 0;
+            p->buffer = NULL;
+
+            return NULL;
+        }
+        
+        memcpy(newbuffer, p->buffer, p->offset + 1);
+        p->hooks.deallocate(p->buffer);
+    }
+    p->length = newsize;
+    p->buffer = newbuffer;
+
+    return newbuffer + p->offset;
+}
+
+/* calculate the new length of the string in a printbuffer and update the offset */
+static void update_offset(printbuffer * const buffer)
+{
+    const unsigned char *buffer_pointer = NULL;
+    if ((buffer == NULL) || (buffer->buffer == NULL))
+    {
+        return;
+    }
+    buffer_pointer = buffer->buffer + buffer->offset;
+
+    buffer->offset += strlen((const char*)buffer_pointer);
+}
+
+/* securely comparison of floating-point variables */
+static cJSON_bool compare_double(double a, double b)
+{
+    double maxVal = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return (fabs(a - b) <= maxVal * DBL_EPSILON);
+}
+
+/* Render an exact integer without sprintf. */
+static cJSON_bool print_integer(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char digits[20]; /* enough for CJSON_UINT64_MAX */
+    size_t length = 0;
+    size_t i = 0;
+    cJSON_bool negative = !(item->type & cJSON_NumberIsUInt64) && (item->valueint64 < 0);
+    cJSON_uint64 magnitude = (cJSON_uint64)item->valueint64;
+    unsigned char *output_pointer = NULL;
+
+    if (negative)
+    {
+        magnitude = (cJSON_uint64)0 - magnitude;
+    }
+
+    /* digits in reverse order */
+    do
+    {
+        digits[length++] = (unsigned char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    output_pointer = ensure(output_buffer, length + (negative ? 1 : 0) + sizeof(""));
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+
+    if (negative)
+    {
+        *output_pointer++ = '-';
+        output_buffer->offset++;
+    }
+    for (i = 0; i < length; i++)
+    {
+        output_pointer[i] = digits[length - 1 - i];
+    }
+    output_pointer[length] = '\0';
+
+    output_buffer->offset += length;
+
+    return true;
+}
+
+/* Render the number nicely from the given item into a string. */
+static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    double d = item->valuedouble;
+    int length = 0;
+    size_t i = 0;
+    unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
+    unsigned char decimal_point = get_decimal_point();
+    double test = 0.0;
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    if (has_exact_integer(item))
+    {
+        return print_integer(item, output_buffer);
+    }
+
+    /* This checks for NaN and Infinity */
+    if (isnan(d) || isinf(d))
+    {
+        length = sprintf((char*)number_buffer, "null");
+    }
+    else
+    {
+        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
+        length = sprintf((char*)number_buffer, "%1.15g", d);
+
+        /* Check whether the original double can be recovered */
+        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || !compare_double((double)test, d))
+        {
+            /* If not, print with 17 decimal places of precision */
+            length = sprintf((char*)number_buffer, "%1.17g", d);
+        }
+    }
+
+    /* sprintf failed or buffer overrun occurred */
+    if ((length < 0) || (length > (int)(sizeof(number_buffer) - 1)))
+    {
+        return false;
+    }
+
+    /* reserve appropriate space in the output */
+    output_pointer = ensure(output_buffer, (size_t)length + sizeof(""));
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+
+    /* copy the printed number to the output and replace locale
+     * dependent decimal point with '.' */
+    for (i = 0; i < ((size_t)length); i++)
+    {
+        if (number_buffer[i] == decimal_point)
+        {
+            output_pointer[i] = '.';
+            continue;
+        }
+
+        output_pointer[i] = number_buffer[i];
+    }
+    output_pointer[i] = '\0';
+
+    output_buffer->offset += (size_t)length;
+
+    return true;
+}
+
+/* parse 4 digit hexadecimal number */
+static unsigned parse_hex4(const unsigned char * const input)
+{
+    unsigned int h = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        /* parse digit */
+        if ((input[i] >= '0') && (input[i] <= '9'))
+        {
+            h += (unsigned int) input[i] - '0';
+        }
+        else if ((input[i] >= 'A') && (input[i] <= 'F'))
+        {
+            h += (unsigned int) 10 + input[i] - 'A';
+        }
+        else if ((input[i] >= 'a') && (input[i] <= 'f'))
+        {
+            h += (unsigned int) 10 + input[i] - 'a';
+        }
+        else /* invalid */
+        {
+            return 0;
+        }
+
+        if (i < 3)
+        {
+            /* shift left to make place for the next nibble */
+            h = h << 4;
+        }
+    }
+
+    return h;
+}
+
+/* converts a UTF-16 literal to UTF-8
+ * A literal can be one or two sequences of the form \uXXXX */
+static unsigned char utf16_literal_to_utf8(const unsigned char * const input_pointer, const unsigned char * const input_end, unsigned char **output_pointer)
+{
+    long unsigned int codepoint = 0;
+    unsigned int first_code = 0;
+    const unsigned char *first_sequence = input_pointer;
+    unsigned char utf8_length = 0;
+    unsigned char utf8_position = 0;
+    unsigned char sequence_length = 0;
+    unsigned char first_byte_mark = 0;
+
+    if ((input_end - first_sequence) < 6)
+    {
+        /* input ends unexpectedly */
+        goto fail;
+    }
+
+    /* get the first utf16 sequence */
+    first_code = parse_hex4(first_sequence + 2);
+
+    /* check that the code is valid */
+    if (((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
+    {
+        goto fail;
+    }
+
+    /* UTF16 surrogate pair */
+    if ((first_code >= 0xD800) && (first_code <= 0xDBFF))
+    {
+        const unsigned char *second_sequence = first_sequence + 6;
+        unsigned int second_code = 0;
+        sequence_length = 12; /* \uXXXX\uXXXX */
+
+        if ((input_end - second_sequence) < 6)
+        {
+            /* input ends unexpectedly */
+            goto fail;
+        }
+
+        if ((second_sequence[0] != '\\') || (second_sequence[1] != 'u'))
+        {
+            /* missing second half of the surrogate pair */
+            goto fail;
+        }
+
+        /* get the second utf16 sequence */
+        second_code = parse_hex4(second_sequence + 2);
+        /* check that the code is valid */
+        if ((second_code < 0xDC00) || (second_code > 0xDFFF))
+        {
+            /* invalid second half of the surrogate pair */
+            goto fail;
+        }
+
+
+        /* calculate the unicode codepoint from the surrogate pair */
+        codepoint = 0x10000 + (((first_code & 0x3FF) << 10) | (second_code & 0x3FF));
+    }
+    else
+    {
+        sequence_length = 6; /* \uXXXX */
+        codepoint = first_code;
+    }
+
+    /* encode as UTF-8
+     * takes at maximum 4 bytes to encode:
+     * 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
+    if (codepoint < 0x80)
+    {
+        /* normal ascii, encoding 0xxxxxxx */
+        utf8_length = 1;
+    }
+    else if (codepoint < 0x800)
+    {
+        /* two bytes, encoding 110xxxxx 10xxxxxx */
+        utf8_length = 2;
+        first_byte_mark = 0xC0; /* 11000000 */
+    }
+    else if (codepoint < 0x10000)
+    {
+        /* three bytes, encoding 1110xxxx 10xxxxxx 10xxxxxx */
+        utf8_length = 3;
+        first_byte_mark = 0xE0; /* 11100000 */
+    }
+    else if (codepoint <= 0x10FFFF)
+    {
+        /* four bytes, encoding 1110xxxx 10xxxxxx 10xxxxxx 10xxxxxx */
+        utf8_length = 4;
+        first_byte_mark = 0xF0; /* 11110000 */
+    }
+    else
+    {
+        /* invalid unicode codepoint */
+        goto fail;
+    }
+
+    /* encode as utf8 */
+    for (utf8_position = (unsigned char)(utf8_length - 1); utf8_position > 0; utf8_position--)
+    {
+        /* 10xxxxxx */
+        (*output_pointer)[utf8_position] = (unsigned char)((codepoint | 0x80) & 0xBF);
+        codepoint >>= 6;
+    }
+    /* encode first byte */
+    if (utf8_length > 1)
+    {
+        (*output_pointer)[0] = (unsigned char)((codepoint | first_byte_mark) & 0xFF);
+    }
+    else
+    {
+        (*output_pointer)[0] = (unsigned char)(codepoint & 0x7F);
+    }
+
+    *output_pointer += utf8_length;
+
+    return sequence_length;
+
+fail:
+    return 0;
+}
+
+/* Parse the input text into an unescaped cinput, and populate item. */
+/* Parse a string literal into valuestring of item. Keys are parsed with allow_inline set to false,
+ * they are moved into string later and the inline bytes belong to the value. */
+static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer, const cJSON_bool allow_inline)
+{
+    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
+    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
+    unsigned char *output_pointer = NULL;
+    unsigned char *output = NULL;
+    cJSON_bool inline_output = false;
+    unsigned char *embedded_zero = NULL; /* the value ends at the first \u0000 */
+
+    /* not a string */
+    if (buffer_at_offset(input_buffer)[0] != '\"')
+    {
+        goto fail;
+    }
+
+    {
+        /* calculate approximate size of the output (overestimate) */
+        size_t allocation_length = 0;
+        size_t skipped_bytes = 0;
+        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        {
+            /* is escape sequence */
+            if (input_end[0] == '\\')
+            {
+                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
+                {
+                    /* prevent buffer overflow when last input character is a backslash */
+                    input_buffer->error = cJSON_ParseErrorUnterminatedString;
                     goto fail;
                 }
                 skipped_bytes++;
@@ -800,14 +1938,24 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         }
         if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
         {
+            input_buffer->error = cJSON_ParseErrorUnterminatedString;
             goto fail; /* string ended unexpectedly */
         }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        /* This is at most how much we need for the output, the opening quote is not part of it */
+        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - 1 - skipped_bytes;
+        if (allow_inline && (allocation_length < CJSON_INLINE_STRING_SIZE))
+        {
+            output = (unsigned char*)cJSON_InlineString(item);
+            inline_output = true;
+        }
+        else
+        {
+            output = parse_allocate_string(input_buffer, allocation_length + sizeof(""));
+        }
         if (output == NULL)
         {
+            input_buffer->error = cJSON_ParseErrorAllocationFailure;
             goto fail; /* allocation failure */
         }
     }
@@ -824,513 +1972,964 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         else
         {
             unsigned char sequence_length = 2;
+            unsigned char *sequence_output = output_pointer;
             if ((input_end - input_pointer) < 1)
             {
+                input_buffer->error = cJSON_ParseErrorIllegalEscapeSequence;
                 goto fail;
             }
 
             switch (input_pointer[1])
             {
-                case 'b':
-                    *output_pointer++ = '\b';
+                case 'b':
+                    *output_pointer++ = '\b';
+                    break;
+                case 'f':
+                    *output_pointer++ = '\f';
+                    break;
+                case 'n':
+                    *output_pointer++ = '\n';
+                    break;
+                case 'r':
+                    *output_pointer++ = '\r';
+                    break;
+                case 't':
+                    *output_pointer++ = '\t';
+                    break;
+                case '\"':
+                case '\\':
+                case '/':
+                    *output_pointer++ = input_pointer[1];
+                    break;
+
+                /* UTF-16 literal */
+                case 'u':
+                    sequence_length = utf16_literal_to_utf8(input_pointer, input_end, &output_pointer);
+                    if (sequence_length == 0)
+                    {
+                        /* failed to convert UTF16-literal to UTF-8 */
+                        input_buffer->error = cJSON_ParseErrorIllegalEscapeSequence;
+                        goto fail;
+                    }
+                    if ((embedded_zero == NULL) && (*sequence_output == '\0'))
+                    {
+                        embedded_zero = sequence_output;
+                    }
+                    break;
+
+                default:
+                    input_buffer->error = cJSON_ParseErrorIllegalEscapeSequence;
+                    goto fail;
+            }
+            input_pointer += sequence_length;
+        }
+    }
+
+    /* zero terminate the output */
+    *output_pointer = '\0';
+
+    item->type |= inline_output ? (cJSON_String | cJSON_StringIsInline) : cJSON_String;
+    item->valuestring = (char*)output;
+    set_string_length(item, (size_t)(((embedded_zero != NULL) ? embedded_zero : output_pointer) - output));
+
+    input_buffer->offset = (size_t) (input_end - input_buffer->content);
+    input_buffer->offset++;
+
+    return true;
+
+fail:
+    if ((output != NULL) && !inline_output)
+    {
+        parse_free_string(input_buffer, output);
+    }
+
+    if (input_pointer != NULL)
+    {
+        input_buffer->offset = (size_t)(input_pointer - input_buffer->content);
+    }
+
+    return false;
+}
+
+/* Render the cstring provided to an escaped version that can be printed. */
+static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+{
+    const unsigned char *input_pointer = NULL;
+    unsigned char *output = NULL;
+    unsigned char *output_pointer = NULL;
+    size_t output_length = 0;
+    /* numbers of additional characters needed for escaping */
+    size_t escape_characters = 0;
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    /* empty string */
+    if (input == NULL)
+    {
+        output = ensure(output_buffer, sizeof("\"\""));
+        if (output == NULL)
+        {
+            return false;
+        }
+        strcpy((char*)output, "\"\"");
+
+        return true;
+    }
+
+    /* set "flag" to 1 if something needs to be escaped */
+    for (input_pointer = input; *input_pointer; input_pointer++)
+    {
+        switch (*input_pointer)
+        {
+            case '\"':
+            case '\\':
+            case '\b':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+                /* one character escape sequence */
+                escape_characters++;
+                break;
+            default:
+                if (*input_pointer < 32)
+                {
+                    /* UTF-16 escape sequence uXXXX */
+                    escape_characters += 5;
+                }
+                break;
+        }
+    }
+    output_length = (size_t)(input_pointer - input) + escape_characters;
+
+    output = ensure(output_buffer, output_length + sizeof("\"\""));
+    if (output == NULL)
+    {
+        return false;
+    }
+
+    /* no characters have to be escaped */
+    if (escape_characters == 0)
+    {
+        output[0] = '\"';
+        memcpy(output + 1, input, output_length);
+        output[output_length + 1] = '\"';
+        output[output_length + 2] = '\0';
+
+        return true;
+    }
+
+    output[0] = '\"';
+    output_pointer = output + 1;
+    /* copy the string */
+    for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
+    {
+        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
+        {
+            /* normal character, copy */
+            *output_pointer = *input_pointer;
+        }
+        else
+        {
+            /* character needs to be escaped */
+            *output_pointer++ = '\\';
+            switch (*input_pointer)
+            {
+                case '\\':
+                    *output_pointer = '\\';
                     break;
-                case 'f':
-                    *output_pointer++ = '\f';
+                case '\"':
+                    *output_pointer = '\"';
                     break;
-                case 'n':
-                    *output_pointer++ = '\n';
+                case '\b':
+                    *output_pointer = 'b';
                     break;
-                case 'r':
-                    *output_pointer++ = '\r';
+                case '\f':
+                    *output_pointer = 'f';
                     break;
-                case 't':
-                    *output_pointer++ = '\t';
+                case '\n':
+                    *output_pointer = 'n';
                     break;
-                case '\"':
-                case '\\':
-                case '/':
-                    *output_pointer++ = input_pointer[1];
+                case '\r':
+                    *output_pointer = 'r';
                     break;
-
-                /* UTF-16 literal */
-                case 'u':
-                    sequence_length = utf16_literal_to_utf8(input_pointer, input_end, &output_pointer);
-                    if (sequence_length == 0)
-                    {
-                        /* failed to convert UTF16-literal to UTF-8 */
-                        goto fail;
-                    }
+                case '\t':
+                    *output_pointer = 't';
                     break;
-
                 default:
-                    goto fail;
+                    /* escape and print as unicode codepoint */
+                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
+                    output_pointer += 4;
+                    break;
             }
-            input_pointer += sequence_length;
         }
     }
+    output[output_length + 1] = '\"';
+    output[output_length + 2] = '\0';
 
-    /* zero terminate the output */
-    *output_pointer = '\0';
+    return true;
+}
 
-    item->type = cJSON_String;
-    item->valuestring = (char*)output;
+/* Invoke print_string_ptr (which is useful) on an item. */
+static cJSON_bool print_string(const cJSON * const item, printbuffer * const p)
+{
+    return print_string_ptr((unsigned char*)item->valuestring, p);
+}
 
-    input_buffer->offset = (size_t) (input_end - input_buffer->content);
-    input_buffer->offset++;
+/* Predeclare these prototypes. */
+static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer);
+static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer);
 
-    return true;
+/* Utility to jump whitespace and cr/lf */
+static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
+{
+    if ((buffer == NULL) || (buffer->content == NULL))
+    {
+        return NULL;
+    }
 
-fail:
-    if (output != NULL)
+    if (cannot_access_at_index(buffer, 0))
+    {
+        return buffer;
+    }
+
+    while (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32))
     {
-        input_buffer->hooks.deallocate(output);
+       buffer->offset++;
     }
 
-    if (input_pointer != NULL)
+    if (buffer->offset == buffer->length)
     {
-        input_buffer->offset = (size_t)(input_pointer - input_buffer->content);
+        buffer->offset--;
     }
 
-    return false;
+    return buffer;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+/* skip the UTF-8 BOM (byte order mark) if it is at the beginning of a buffer */
+static parse_buffer *skip_utf8_bom(parse_buffer * const buffer)
 {
-    const unsigned char *input_pointer = NULL;
-    unsigned char *output = NULL;
-    unsigned char *output_pointer = NULL;
-    size_t output_length = 0;
-    /* numbers of additional characters needed for escaping */
-    size_t escape_characters = 0;
+    if ((buffer == NULL) || (buffer->content == NULL) || (buffer->offset != 0))
+    {
+        return NULL;
+    }
 
-    if (output_buffer == NULL)
+    if (can_access_at_index(buffer, 4) && (strncmp((const char*)buffer_at_offset(buffer), "\xEF\xBB\xBF", 3) == 0))
+    {
+        buffer->offset += 3;
+    }
+
+    return buffer;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    size_t buffer_length;
+
+    if (NULL == value)
+    {
+        return NULL;
+    }
+
+    /* Adding null character size due to require_null_terminated. */
+    buffer_length = strlen(value) + sizeof("");
+
+    return cJSON_ParseWithLengthOpts(value, buffer_length, return_parse_end, require_null_terminated);
+}
+
+CJSON_PUBLIC(void) cJSON_InitParseOptions(cJSON_ParseOptions *options)
+{
+    if (options == NULL)
+    {
+        return;
+    }
+
+    options->nesting_limit = CJSON_NESTING_LIMIT;
+    options->require_null_terminated = false;
+    options->pool = NULL;
+    options->lazy = false;
+    options->keys = NULL;
+    options->pack = false;
+    options->allocator = NULL;
+}
+
+/* Parse an object - create a new root, and populate. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    cJSON_ParseOptions options;
+    cJSON_ParseResult result;
+    cJSON *item = NULL;
+
+    cJSON_InitParseOptions(&options);
+    options.require_null_terminated = require_null_terminated;
+
+    item = cJSON_ParseWithOptions(value, buffer_length, &options, &result);
+
+    /* only the legacy API reports errors through the (not thread safe) global error */
+    global_error.json = NULL;
+    global_error.position = 0;
+    if ((item == NULL) && (value != NULL))
+    {
+        global_error.json = (const unsigned char*)value;
+        global_error.position = result.offset;
+    }
+
+    if ((return_parse_end != NULL) && (value != NULL))
+    {
+        *return_parse_end = value + result.offset;
+    }
+
+    return item;
+}
+
+/* calculate line and column (both starting at 1) of the given offset */
+static void get_line_and_column(const unsigned char * const content, size_t offset, size_t * const line, size_t * const column)
+{
+    size_t line_start = 0;
+    size_t i = 0;
+
+    *line = 1;
+    for (i = 0; i < offset; i++)
+    {
+        if (content[i] == '\n')
+        {
+            (*line)++;
+            line_start = i + 1;
+        }
+    }
+    *column = offset - line_start + 1;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOptions(const char *value, size_t buffer_length, const cJSON_ParseOptions *options, cJSON_ParseResult *result)
+{
+    parse_buffer buffer = { 0, 0, 0, CJSON_NESTING_LIMIT, cJSON_ParseErrorNone, NULL, false, NULL, false, NULL, { 0, 0, 0 } };
+    cJSON_bool require_null_terminated = false;
+    cJSON *item = NULL;
+
+    if (result != NULL)
+    {
+        result->error = cJSON_ParseErrorNone;
+        result->offset = 0;
+        result->line = 0;
+        result->column = 0;
+    }
+
+    if (value == NULL || 0 == buffer_length)
+    {
+        buffer.error = cJSON_ParseErrorIllegalValue;
+        goto fail;
+    }
+
+    buffer.content = (const unsigned char*)value;
+    buffer.length = buffer_length;
+    buffer.offset = 0;
+    buffer.hooks = global_hooks;
+    if (options != NULL)
+    {
+        buffer.nesting_limit = options->nesting_limit;
+        buffer.pool = options->pool;
+        buffer.lazy = options->lazy;
+        buffer.keys = options->keys;
+        buffer.pack = options->pack;
+        buffer.allocator = options->allocator;
+        require_null_terminated = options->require_null_terminated;
+    }
+
+    item = parse_new_item(&buffer);
+    if (item == NULL) /* memory fail */
+    {
+        buffer.error = cJSON_ParseErrorAllocationFailure;
+        goto fail;
+    }
+
+    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    {
+        /* parse failure. buffer.error is set. */
+        goto fail;
+    }
+
+    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
+    if (require_null_terminated)
+    {
+        buffer_skip_whitespace(&buffer);
+        if ((buffer.offset >= buffer.length) || buffer_at_offset(&buffer)[0] != '\0')
+        {
+            buffer.error = cJSON_ParseErrorGarbageAtEnd;
+            goto fail;
+        }
+    }
+    if (result != NULL)
+    {
+        result->offset = buffer.offset;
+    }
+
+    return item;
+
+fail:
+    cJSON_DeleteToPool(buffer.pool, item);
+
+    if (result != NULL)
+    {
+        result->error = (buffer.error != cJSON_ParseErrorNone) ? buffer.error : cJSON_ParseErrorIllegalValue;
+
+        if (value != NULL)
+        {
+            if (buffer.offset < buffer.length)
+            {
+                result->offset = buffer.offset;
+            }
+            else if (buffer.length > 0)
+            {
+                result->offset = buffer.length - 1;
+            }
+
+            get_line_and_column(buffer.content, result->offset, &result->line, &result->column);
+        }
+    }
+
+    return NULL;
+}
+
+CJSON_PUBLIC(const char *) cJSON_GetParseErrorString(cJSON_ParseError parse_error)
+{
+    switch (parse_error)
+    {
+        case cJSON_ParseErrorNone:
+            return "no error occurred";
+        case cJSON_ParseErrorIllegalValue:
+            return "illegal value";
+        case cJSON_ParseErrorIllegalNumber:
+            return "illegal number";
+        case cJSON_ParseErrorUnterminatedString:
+            return "unterminated string";
+        case cJSON_ParseErrorIllegalEscapeSequence:
+            return "invalid escape sequence";
+        case cJSON_ParseErrorMissingName:
+            return "object is missing a name";
+        case cJSON_ParseErrorMissingNameSeparator:
+            return "object is missing name separator";
+        case cJSON_ParseErrorMissingValueSeparator:
+            return "missing value separator";
+        case cJSON_ParseErrorUnterminatedArray:
+            return "unterminated array";
+        case cJSON_ParseErrorUnterminatedObject:
+            return "unterminated object";
+        case cJSON_ParseErrorDeepNesting:
+            return "too deeply nested document";
+        case cJSON_ParseErrorGarbageAtEnd:
+            return "garbage at the end of the document";
+        case cJSON_ParseErrorAllocationFailure:
+            return "memory allocation failed";
+        default:
+            return "unknown error";
+    }
+}
+
+/* Default options for cJSON_Parse */
+CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
+{
+    return cJSON_ParseWithOpts(value, 0, 0);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_length)
+{
+    return cJSON_ParseWithLengthOpts(value, buffer_length, 0, 0);
+}
+
+#define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
+
+static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
+{
+    static const size_t default_buffer_size = 256;
+    printbuffer buffer[1];
+    unsigned char *printed = NULL;
+
+    memset(buffer, 0, sizeof(buffer));
+
+    /* create buffer */
+    buffer->buffer = (unsigned char*) hooks->allocate(default_buffer_size);
+    buffer->length = default_buffer_size;
+    buffer->format = format;
+    buffer->hooks = *hooks;
+    if (buffer->buffer == NULL)
+    {
+        goto fail;
+    }
+
+    /* print the value */
+    if (!print_value(item, buffer))
     {
-        return false;
+        goto fail;
     }
+    update_offset(buffer);
 
-    /* empty string */
-    if (input == NULL)
+    /* check if reallocate is available */
+    if (hooks->reallocate != NULL)
     {
-        output = ensure(output_buffer, sizeof("\"\""));
-        if (output == NULL)
-        {
-            return false;
+        printed = (unsigned char*) hooks->reallocate(buffer->buffer, buffer->offset + 1);
+        if (printed == NULL) {
+            goto fail;
         }
-        strcpy((char*)output, "\"\"");
-
-        return true;
+        buffer->buffer = NULL;
     }
-
-    /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
+    else /* otherwise copy the JSON over to a new buffer */
     {
-        switch (*input_pointer)
+        printed = (unsigned char*) hooks->allocate(buffer->offset + 1);
+        if (printed == NULL)
         {
-            case '\"':
-            case '\\':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* one character escape sequence */
-                escape_characters++;
-                break;
-            default:
-                if (*input_pointer < 32)
-                {
-                    /* UTF-16 escape sequence uXXXX */
-                    escape_characters += 5;
-                }
-                break;
+            goto fail;
         }
-    }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
+        memcpy(printed, buffer->buffer, cjson_min(buffer->length, buffer->offset + 1));
+        printed[buffer->offset] = '\0'; /* just to be sure */
 
-    output = ensure(output_buffer, output_length + sizeof("\"\""));
-    if (output == NULL)
-    {
-        return false;
+        /* free the buffer */
+        hooks->deallocate(buffer->buffer);
     }
 
-    /* no characters have to be escaped */
-    if (escape_characters == 0)
-    {
-        output[0] = '\"';
-        memcpy(output + 1, input, output_length);
-        output[output_length + 1] = '\"';
-        output[output_length + 2] = '\0';
+    return printed;
 
-        return true;
+fail:
+    if (buffer->buffer != NULL)
+    {
+        hooks->deallocate(buffer->buffer);
     }
 
-    output[0] = '\"';
-    output_pointer = output + 1;
-    /* copy the string */
-    for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
+    if (printed != NULL)
     {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
-        {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
-        }
-        else
-        {
-            /* character needs to be escaped */
-            *output_pointer++ = '\\';
-            switch (*input_pointer)
-            {
-                case '\\':
-                    *output_pointer = '\\';
-                    break;
-                case '\"':
-                    *output_pointer = '\"';
-                    break;
-                case '\b':
-                    *output_pointer = 'b';
-                    break;
-                case '\f':
-                    *output_pointer = 'f';
-                    break;
-                case '\n':
-                    *output_pointer = 'n';
-                    break;
-                case '\r':
-                    *output_pointer = 'r';
-                    break;
-                case '\t':
-                    *output_pointer = 't';
-                    break;
-                default:
-                    /* escape and print as unicode codepoint */
-                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
-                    output_pointer += 4;
-                    break;
-            }
-        }
+        hooks->deallocate(printed);
     }
-    output[output_length + 1] = '\"';
-    output[output_length + 2] = '\0';
 
-    return true;
+    return NULL;
 }
 
-/* Invoke print_string_ptr (which is useful) on an item. */
-static cJSON_bool print_string(const cJSON * const item, printbuffer * const p)
+/* Render a cJSON item/entity/structure to text. */
+CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item)
 {
-    return print_string_ptr((unsigned char*)item->valuestring, p);
+    return (char*)print(item, true, &global_hooks);
 }
 
-/* Predeclare these prototypes. */
-static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer);
-static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer);
-static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buffer);
-static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer);
-static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_buffer);
-static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer);
+CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
+{
+    return (char*)print(item, false, &global_hooks);
+}
 
-/* Utility to jump whitespace and cr/lf */
-static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
+CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
-    if ((buffer == NULL) || (buffer->content == NULL))
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+
+    if (prebuffer < 0)
     {
         return NULL;
     }
 
-    if (cannot_access_at_index(buffer, 0))
+    p.buffer = (unsigned char*)global_hooks.allocate((size_t)prebuffer);
+    if (!p.buffer)
     {
-        return buffer;
+        return NULL;
     }
 
-    while (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32))
-    {
-       buffer->offset++;
-    }
+    p.length = (size_t)prebuffer;
+    p.offset = 0;
+    p.noalloc = false;
+    p.format = fmt;
+    p.hooks = global_hooks;
 
-    if (buffer->offset == buffer->length)
+    if (!print_value(item, &p))
     {
-        buffer->offset--;
+        global_hooks.deallocate(p.buffer);
+        return NULL;
     }
 
-    return buffer;
+    return (char*)p.buffer;
 }
 
-/* skip the UTF-8 BOM (byte order mark) if it is at the beginning of a buffer */
-static parse_buffer *skip_utf8_bom(parse_buffer * const buffer)
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
 {
-    if ((buffer == NULL) || (buffer->content == NULL) || (buffer->offset != 0))
-    {
-        return NULL;
-    }
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
 
-    if (can_access_at_index(buffer, 4) && (strncmp((const char*)buffer_at_offset(buffer), "\xEF\xBB\xBF", 3) == 0))
+    if ((length < 0) || (buffer == NULL))
     {
-        buffer->offset += 3;
+        return false;
     }
 
-    return buffer;
+    p.buffer = (unsigned char*)buffer;
+    p.length = (size_t)length;
+    p.offset = 0;
+    p.noalloc = true;
+    p.format = format;
+    p.hooks = global_hooks;
+
+    return print_value(item, &p);
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated)
+/* keep the text of a value that was checked but not decoded */
+static cJSON_bool keep_lazy(cJSON * const item, parse_buffer * const input_buffer, size_t length, int type)
 {
-    size_t buffer_length;
-
-    if (NULL == value)
+    if (length > INT_MAX)
     {
-        return NULL;
+        /* the length doesn't fit into valueint */
+        return (type == cJSON_String) ? parse_string(item, input_buffer, true) : parse_number(item, input_buffer);
     }
 
-    /* Adding null character size due to require_null_terminated. */
-    buffer_length = strlen(value) + sizeof("");
+    item->type |= type | cJSON_IsLazy;
+    item->valuestring = (char*)cast_away_const(buffer_at_offset(input_buffer));
+    item->valueint = (int)length;
 
-    return cJSON_ParseWithLengthOpts(value, buffer_length, return_parse_end, require_null_terminated);
+    input_buffer->offset += length;
+    return true;
 }
 
-/* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+/* Check a string literal like parse_string does, without unescaping it. */
+static cJSON_bool skip_string(cJSON * const item, parse_buffer * const input_buffer)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
-    cJSON *item = NULL;
+    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
+    const unsigned char *buffer_end = input_buffer->content + input_buffer->length;
+    const unsigned char *string_end = input_pointer;
+    unsigned char scratch[4];
+    unsigned char *scratch_pointer = NULL;
 
-    /* reset error position */
-    global_error.json = NULL;
-    global_error.position = 0;
+    /* find the closing quote first like parse_string, the escapes are checked only up to it */
+    while ((string_end < buffer_end) && (*string_end != '\"'))
+    {
+        if (*string_end == '\\')
+        {
+            if ((string_end + 1) >= buffer_end)
+            {
+                input_pointer = string_end;
+                input_buffer->error = cJSON_ParseErrorUnterminatedString;
+                goto fail;
+            }
+            string_end++;
+        }
+        string_end++;
+    }
+    if (string_end >= buffer_end)
+    {
+        input_pointer = string_end;
+        input_buffer->error = cJSON_ParseErrorUnterminatedString;
+        goto fail; /* string ended unexpectedly */
+    }
 
-    if (value == NULL || 0 == buffer_length)
+    while (input_pointer < string_end)
     {
-        goto fail;
+        if (*input_pointer != '\\')
+        {
+            input_pointer++;
+            continue;
+        }
+
+        switch (input_pointer[1])
+        {
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+            case '\"':
+            case '\\':
+            case '/':
+                input_pointer += 2;
+                break;
+
+            /* UTF-16 literal, converted into scratch only to check it */
+            case 'u':
+            {
+                unsigned char sequence_length = 0;
+                scratch_pointer = scratch;
+                sequence_length = utf16_literal_to_utf8(input_pointer, string_end, &scratch_pointer);
+                if (sequence_length == 0)
+                {
+                    input_buffer->error = cJSON_ParseErrorIllegalEscapeSequence;
+                    goto fail;
+                }
+                input_pointer += sequence_length;
+                break;
+            }
+
+            default:
+                input_buffer->error = cJSON_ParseErrorIllegalEscapeSequence;
+                goto fail;
+        }
     }
 
-    buffer.content = (const unsigned char*)value;
-    buffer.length = buffer_length; 
-    buffer.offset = 0;
-    buffer.hooks = global_hooks;
+    /* the text includes both quotes */
+    return keep_lazy(item, input_buffer, (size_t)(string_end + 1 - buffer_at_offset(input_buffer)), cJSON_String);
 
-    item = cJSON_New_Item(&global_hooks);
-    if (item == NULL) /* memory fail */
+fail:
+    input_buffer->offset = (size_t)(input_pointer - input_buffer->content);
+    return false;
+}
+
+/* Find the end of a number like parse_number does: what strtod accepts of the first 63 characters. */
+static cJSON_bool skip_number(cJSON * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *number = buffer_at_offset(input_buffer);
+    size_t available = input_buffer->length - input_buffer->offset;
+    size_t length = 0;
+    size_t digits = 0;
+
+    if (available > 63)
     {
-        goto fail;
+        available = 63;
     }
 
-    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    if ((length < available) && ((number[length] == '+') || (number[length] == '-')))
     {
-        /* parse failure. ep is set. */
-        goto fail;
+        length++;
     }
-
-    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
-    if (require_null_terminated)
+    for (; (length < available) && is_digit(number[length]); length++)
     {
-        buffer_skip_whitespace(&buffer);
-        if ((buffer.offset >= buffer.length) || buffer_at_offset(&buffer)[0] != '\0')
-        {
-            goto fail;
-        }
+        digits++;
     }
-    if (return_parse_end)
+    if ((length < available) && (number[length] == '.'))
     {
-        *return_parse_end = (const char*)buffer_at_offset(&buffer);
+        for (length++; (length < available) && is_digit(number[length]); length++)
+        {
+            digits++;
+        }
     }
-
-    return item;
-
-fail:
-    if (item != NULL)
+    if (digits == 0)
     {
-        cJSON_Delete(item);
+        input_buffer->error = cJSON_ParseErrorIllegalNumber;
+        return false; /* parse_error */
     }
 
-    if (value != NULL)
+    /* the exponent only counts if it has digits */
+    if ((length < available) && ((number[length] == 'e') || (number[length] == 'E')))
     {
-        error local_error;
-        local_error.json = (const unsigned char*)value;
-        local_error.position = 0;
-
-        if (buffer.offset < buffer.length)
-        {
-            local_error.position = buffer.offset;
-        }
-        else if (buffer.length > 0)
+        size_t exponent = length + 1;
+        if ((exponent < available) && ((number[exponent] == '+') || (number[exponent] == '-')))
         {
-            local_error.position = buffer.length - 1;
+            exponent++;
         }
-
-        if (return_parse_end != NULL)
+        if ((exponent < available) && is_digit(number[exponent]))
         {
-            *return_parse_end = (const char*)local_error.json + local_error.position;
+            for (; (exponent < available) && is_digit(number[exponent]); exponent++)
+            {
+            }
+            length = exponent;
         }
-
-        global_error = local_error;
     }
 
-    return NULL;
-}
-
-/* Default options for cJSON_Parse */
-CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
-{
-    return cJSON_ParseWithOpts(value, 0, 0);
-}
-
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_length)
-{
-    return cJSON_ParseWithLengthOpts(value, buffer_length, 0, 0);
+    return keep_lazy(item, input_buffer, length, cJSON_Number);
 }
 
-#define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
-
-static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
+/* Parse the name of an object member into the key table of input_buffer. */
+static cJSON_bool parse_interned_key(cJSON * const item, parse_buffer * const input_buffer)
 {
-    static const size_t default_buffer_size = 256;
-    printbuffer buffer[1];
-    unsigned char *printed = NULL;
-
-    memset(buffer, 0, sizeof(buffer));
-
-    /* create buffer */
-    buffer->buffer = (unsigned char*) hooks->allocate(default_buffer_size);
-    buffer->length = default_buffer_size;
-    buffer->format = format;
-    buffer->hooks = *hooks;
-    if (buffer->buffer == NULL)
-    {
-        goto fail;
-    }
+    const unsigned char *key = buffer_at_offset(input_buffer) + 1;
+    size_t available = input_buffer->length - input_buffer->offset - 1;
+    size_t length = 0;
+    unsigned char *decoded = NULL;
+    const char *interned = NULL;
+    unsigned int hash = 0;
 
-    /* print the value */
-    if (!print_value(item, buffer))
+    /* keys without escape sequences are interned straight from the input */
+    while ((length < available) && (key[length] != '\"') && (key[length] != '\\') && (key[length] != '\0'))
     {
-        goto fail;
+        length++;
     }
-    update_offset(buffer);
-
-    /* check if reallocate is available */
-    if (hooks->reallocate != NULL)
+    if ((length < available) && (key[length] == '\"'))
     {
-        printed = (unsigned char*) hooks->reallocate(buffer->buffer, buffer->offset + 1);
-        if (printed == NULL) {
-            goto fail;
-        }
-        buffer->buffer = NULL;
+        input_buffer->offset += length + 2;
     }
-    else /* otherwise copy the JSON over to a new buffer */
+    else
     {
-        printed = (unsigned char*) hooks->allocate(buffer->offset + 1);
-        if (printed == NULL)
+        if (!parse_string(item, input_buffer, false))
         {
-            goto fail;
+            return false;
         }
-        memcpy(printed, buffer->buffer, cjson_min(buffer->length, buffer->offset + 1));
-        printed[buffer->offset] = '\0'; /* just to be sure */
-
-        /* free the buffer */
-        hooks->deallocate(buffer->buffer);
+        decoded = (unsigned char*)item->valuestring;
+        item->valuestring = NULL;
+        item->type &= ~(cJSON_String | cJSON_StringHasLength);
+        item->valueint = 0;
+        key = decoded;
+        length = strlen((const char*)decoded);
     }
 
-    return printed;
-
-fail:
-    if (buffer->buffer != NULL)
+    hash = hash_key(key, length);
+    interned = key_table_intern_locked(input_buffer->keys, key, length, hash);
+    if (decoded != NULL)
     {
-        hooks->deallocate(buffer->buffer);
+        if (input_buffer->pool != NULL)
+        {
+            pool_put_string(input_buffer->pool, (char*)decoded, true);
+        }
+        else
+        {
+            parse_free_string(input_buffer, decoded);
+        }
     }
-
-    if (printed != NULL)
+    if (interned == NULL)
     {
-        hooks->deallocate(printed);
+        input_buffer->error = cJSON_ParseErrorAllocationFailure;
+        return false;
     }
 
-    return NULL;
-}
+    item->string = (char*)cast_away_const(interned);
+    item->stringhash = hash;
+    item->type |= cJSON_StringIsConst | cJSON_StringIsInterned | cJSON_StringIsHashed;
 
-/* Render a cJSON item/entity/structure to text. */
-CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item)
-{
-    return (char*)print(item, true, &global_hooks);
+    return true;
 }
 
-CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
+/* Parse the name of an object member if it is the same as the name of shape, the member at the same
+ * position in the previous object. Returns false without consuming anything if it is not. */
+static cJSON_bool parse_predicted_key(cJSON * const item, parse_buffer * const input_buffer, const cJSON * const shape)
 {
-    return (char*)print(item, false, &global_hooks);
-}
+    const unsigned char *key = buffer_at_offset(input_buffer) + 1;
+    const unsigned char *predicted = (const unsigned char*)shape->string;
+    size_t available = input_buffer->length - input_buffer->offset - 1;
+    size_t length = 0;
+    unsigned char *copy = NULL;
 
-CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
-{
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    if ((predicted == NULL) || !(shape->type & cJSON_StringIsHashed))
+    {
+        return false;
+    }
 
-    if (prebuffer < 0)
+    /* the text has to be the name itself, names with escape sequences are left to parse_string */
+    while ((length < available) && (predicted[length] != '\0'))
     {
-        return NULL;
+        if ((key[length] != predicted[length]) || (key[length] == '\"') || (key[length] == '\\'))
+        {
+            return false;
+        }
+        length++;
+    }
+    if ((length >= available) || (predicted[length] != '\0') || (key[length] != '\"'))
+    {
+        return false;
     }
 
-    p.buffer = (unsigned char*)global_hooks.allocate((size_t)prebuffer);
-    if (!p.buffer)
+    if (shape->type & cJSON_StringIsInterned)
     {
-        return NULL;
+        /* share the name, it belongs to the key table */
+        item->string = shape->string;
+        item->type |= cJSON_StringIsConst | cJSON_StringIsInterned;
+    }
+    else
+    {
+        copy = parse_allocate_string(input_buffer, length + sizeof(""));
+        if (copy == NULL)
+        {
+            input_buffer->error = cJSON_ParseErrorAllocationFailure;
+            return false;
+        }
+        memcpy(copy, predicted, length + sizeof(""));
+        item->string = (char*)copy;
     }
+    item->stringhash = shape->stringhash;
+    item->type |= cJSON_StringIsHashed;
+    input_buffer->offset += length + 2;
 
-    p.length = (size_t)prebuffer;
-    p.offset = 0;
-    p.noalloc = false;
-    p.format = fmt;
-    p.hooks = global_hooks;
+    return true;
+}
 
-    if (!print_value(item, &p))
+/* Decode the text of a lazy value into target, item is not changed. A decoded string comes from allocator. */
+static cJSON_bool decode_lazy(const cJSON * const item, cJSON * const target, const cJSON_Allocator * const allocator)
+{
+    parse_buffer buffer = { 0, 0, 0, CJSON_NESTING_LIMIT, cJSON_ParseErrorNone, NULL, false, NULL, false, NULL, { 0, 0, 0 } };
+    buffer.content = (const unsigned char*)item->valuestring;
+    buffer.length = (size_t)item->valueint;
+    buffer.allocator = allocator;
+    buffer.hooks = global_hooks;
+
+    if (item->type & cJSON_Number)
     {
-        global_hooks.deallocate(p.buffer);
-        return NULL;
+        return parse_number(target, &buffer);
     }
 
-    return (char*)p.buffer;
+    /* target may be a temporary copy, the string must not live in it */
+    return parse_string(target, &buffer, false);
 }
 
-CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
+static cJSON_bool decode_lazy_in_place(cJSON * const item)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    cJSON decoded;
+    memset(&decoded, '\0', sizeof(decoded));
 
-    if ((length < 0) || (buffer == NULL))
+    if (!decode_lazy(item, &decoded, item_allocator(item)))
     {
         return false;
     }
 
-    p.buffer = (unsigned char*)buffer;
-    p.length = (size_t)length;
-    p.offset = 0;
-    p.noalloc = true;
-    p.format = format;
-    p.hooks = global_hooks;
+    item->valuestring = decoded.valuestring;
+    item->valueint = decoded.valueint;
+    item->valuedouble = decoded.valuedouble;
+    item->valueint64 = decoded.valueint64;
+    /* the decoded string is not from a pool */
+    item->type &= ~(cJSON_IsLazy | cJSON_StringIsPooled);
+    item->type |= decoded.type & (cJSON_NumberIsInt64 | cJSON_NumberIsUInt64 | cJSON_StringHasLength);
 
-    return print_value(item, &p);
+    return true;
 }
 
-/* Parser core - when encountering text, process appropriately. */
-static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
+CJSON_PUBLIC(cJSON_bool) cJSON_Decode(cJSON *item)
 {
-    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+    walk_stack stack;
+    cJSON *current = NULL;
+    cJSON_bool success = true;
+
+    walk_stack_init(&stack);
+    for (; item != NULL; item = item->next)
     {
-        return false; /* no input */
+        for (current = item; current != NULL; current = (cJSON*)cast_away_const(walk_next(&stack, current, NULL, !(current->type & cJSON_IsReference))))
+        {
+            if ((current->type & cJSON_IsLazy) && !decode_lazy_in_place(current))
+            {
+                success = false;
+            }
+            if (current->type & cJSON_StringIsInterned)
+            {
+                char *key = (char*)cJSON_strdup((const unsigned char*)current->string, item_allocator(current));
+                if (key == NULL)
+                {
+                    success = false;
+                }
+                else
+                {
+                    current->string = key;
+                    current->type &= ~(cJSON_StringIsConst | cJSON_StringIsInterned);
+                }
+            }
+        }
+        if (stack.failed)
+        {
+            success = false;
+            stack.size = 0;
+            stack.failed = false;
+        }
     }
+    walk_stack_free(&stack);
 
-    /* parse the different types of values */
+    return success;
+}
+
+/* Parse a value that can't contain other values (null, false, true, string, number). */
+static cJSON_bool parse_scalar(cJSON * const item, parse_buffer * const input_buffer)
+{
     /* null */
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "null", 4) == 0))
     {
-        item->type = cJSON_NULL;
+        item->type |= cJSON_NULL;
         input_buffer->offset += 4;
         return true;
     }
     /* false */
     if (can_read(input_buffer, 5) && (strncmp((const char*)buffer_at_offset(input_buffer), "false", 5) == 0))
     {
-        item->type = cJSON_False;
+        item->type |= cJSON_False;
         input_buffer->offset += 5;
         return true;
     }
     /* true */
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "true", 4) == 0))
     {
-        item->type = cJSON_True;
+        item->type |= cJSON_True;
         item->valueint = 1;
         input_buffer->offset += 4;
         return true;
@@ -1338,35 +2937,303 @@ static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buf
     /* string */
     if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '\"'))
     {
-        return parse_string(item, input_buffer);
+        return input_buffer->lazy ? skip_string(item, input_buffer) : parse_string(item, input_buffer, true);
     }
     /* number */
     if (can_access_at_index(input_buffer, 0) && ((buffer_at_offset(input_buffer)[0] == '-') || ((buffer_at_offset(input_buffer)[0] >= '0') && (buffer_at_offset(input_buffer)[0] <= '9'))))
     {
-        return parse_number(item, input_buffer);
+        return input_buffer->lazy ? skip_number(item, input_buffer) : parse_number(item, input_buffer);
+    }
+
+    input_buffer->error = cJSON_ParseErrorIllegalValue;
+    return false;
+}
+
+/* Number of stack entries the parser keeps on the C stack before it moves its stack to the heap. */
+#define PARSE_STACK_PREALLOCATED 32
+
+/* An array/object that is open while parsing.
+ * For objects, shape is the member of the previous sibling object at the position of the next member,
+ * objects in arrays of records mostly have the same names in the same order. */
+typedef struct
+{
+    cJSON *container;
+    const cJSON *shape;
+} parse_frame;
+
+/* Explicit stack of the arrays/objects that are currently open while parsing. */
+typedef struct
+{
+    parse_frame *items;
+    size_t size;
+    size_t capacity;
+    parse_frame preallocated[PARSE_STACK_PREALLOCATED];
+} parse_stack;
+
+static cJSON_bool parse_stack_push(parse_stack * const stack, cJSON * const container, const internal_hooks * const hooks)
+{
+    parse_frame *frame = NULL;
+
+    if (stack->size == stack->capacity)
+    {
+        parse_frame *new_items = NULL;
+        size_t new_capacity = stack->capacity * 2;
+
+        if (new_capacity < stack->capacity)
+        {
+            return false; /* overflow */
+        }
+        new_items = (parse_frame*)hooks->allocate(new_capacity * sizeof(parse_frame));
+        if (new_items == NULL)
+        {
+            return false; /* allocation failure */
+        }
+        memcpy(new_items, stack->items, stack->size * sizeof(parse_frame));
+        if (stack->items != stack->preallocated)
+        {
+            hooks->deallocate(stack->items);
+        }
+        stack->items = new_items;
+        stack->capacity = new_capacity;
+    }
+
+    frame = &stack->items[stack->size++];
+    frame->container = container;
+    frame->shape = NULL;
+    /* the previous sibling, the head of the list keeps the last element in prev */
+    if (((container->type & 0xFF) == cJSON_Object) && (container->prev != NULL) && (container->prev->next == container)
+        && ((container->prev->type & 0xFF) == cJSON_Object))
+    {
+        frame->shape = container->prev->child;
+    }
+
+    return true;
+}
+
+/* Allocate the next element of an array/object, append it to the children of the container
+ * and, for objects, parse its name and the name separator. */
+static cJSON *parse_new_element(parse_frame * const frame, parse_buffer * const input_buffer)
+{
+    cJSON * const container = frame->container;
+    cJSON *new_item = parse_new_item(input_buffer);
+    if (new_item == NULL)
+    {
+        input_buffer->error = cJSON_ParseErrorAllocationFailure;
+        return NULL; /* allocation failure */
+    }
+
+    /* attach the item to the list right away, so it gets freed together with the tree on failure.
+     * The head of the list keeps a pointer to the last element in prev. */
+    if (container->child == NULL)
+    {
+        container->child = new_item;
+        new_item->prev = new_item;
+    }
+    else
+    {
+        cJSON *last = container->child->prev;
+        last->next = new_item;
+        new_item->prev = last;
+        container->child->prev = new_item;
+    }
+
+    if ((container->type & 0xFF) == cJSON_Object)
+    {
+        /* parse the name of the child */
+        if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != '\"'))
+        {
+            input_buffer->error = cJSON_ParseErrorMissingName;
+            return NULL; /* no name */
+        }
+        if ((frame->shape != NULL) && parse_predicted_key(new_item, input_buffer, frame->shape))
+        {
+            /* same name as in the previous object */
+        }
+        else if (input_buffer->error != cJSON_ParseErrorNone)
+        {
+            return NULL; /* allocation failure */
+        }
+        else if (input_buffer->keys != NULL)
+        {
+            if (!parse_interned_key(new_item, input_buffer))
+            {
+                return NULL; /* failed to parse name */
+            }
+        }
+        else
+        {
+            if (!parse_string(new_item, input_buffer, false))
+            {
+                return NULL; /* failed to parse name */
+            }
+
+            /* swap valuestring and string, because we parsed the name */
+            new_item->string = new_item->valuestring;
+            new_item->valuestring = NULL;
+            new_item->type &= ~(cJSON_String | cJSON_StringHasLength);
+            new_item->valueint = 0;
+            hash_item_key(new_item, (size_t)-1);
+        }
+        if (frame->shape != NULL)
+        {
+            frame->shape = frame->shape->next;
+        }
+        buffer_skip_whitespace(input_buffer);
+
+        if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
+        {
+            input_buffer->error = cJSON_ParseErrorMissingNameSeparator;
+            return NULL; /* invalid object */
+        }
+        input_buffer->offset++;
+        buffer_skip_whitespace(input_buffer);
+    }
+
+    return new_item;
+}
+
+/* Parser core - when encountering text, process appropriately.
+ * Arrays and objects don't recurse, the containers that are still open are kept on an explicit
+ * stack instead. This keeps the C stack usage constant regardless of how deeply the input is nested. */
+static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
+{
+    parse_stack stack;
+    cJSON *current_item = item;
+    cJSON_bool success = false;
+
+    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+    {
+        return false; /* no input */
     }
-    /* array */
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '['))
+
+    stack.items = stack.preallocated;
+    stack.size = 0;
+    stack.capacity = PARSE_STACK_PREALLOCATED;
+
+    for (;;)
     {
-        return parse_array(item, input_buffer);
+        cJSON *container = NULL;
+
+        /* parse the value at the current position into current_item */
+        if (can_access_at_index(input_buffer, 0) && ((buffer_at_offset(input_buffer)[0] == '[') || (buffer_at_offset(input_buffer)[0] == '{')))
+        {
+            const unsigned char closing = (buffer_at_offset(input_buffer)[0] == '[') ? ']' : '}';
+
+            if (stack.size >= input_buffer->nesting_limit)
+            {
+                input_buffer->error = cJSON_ParseErrorDeepNesting;
+                goto end; /* too deeply nested */
+            }
+            if (!parse_stack_push(&stack, current_item, &(input_buffer->hooks)))
+            {
+                input_buffer->error = cJSON_ParseErrorAllocationFailure;
+                goto end; /* allocation failure */
+            }
+            current_item->type |= (closing == ']') ? cJSON_Array : cJSON_Object;
+
+            input_buffer->offset++;
+            buffer_skip_whitespace(input_buffer);
+            if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == closing))
+            {
+                /* empty array/object, it is closed right below */
+                input_buffer->offset++;
+                stack.size--;
+            }
+            else
+            {
+                /* check if we skipped to the end of the buffer */
+                if (cannot_access_at_index(input_buffer, 0))
+                {
+                    input_buffer->offset--;
+                    input_buffer->error = (closing == ']') ? cJSON_ParseErrorUnterminatedArray : cJSON_ParseErrorUnterminatedObject;
+                    goto end;
+                }
+
+                current_item = parse_new_element(&stack.items[stack.size - 1], input_buffer);
+                if (current_item == NULL)
+                {
+                    goto end;
+                }
+                continue;
+            }
+        }
+        else if (!parse_scalar(current_item, input_buffer))
+        {
+            goto end; /* failed to parse value */
+        }
+
+        /* the value is complete, continue with the enclosing arrays/objects */
+        for (;;)
+        {
+            if (stack.size == 0)
+            {
+                success = true;
+                goto end;
+            }
+
+            container = stack.items[stack.size - 1].container;
+            buffer_skip_whitespace(input_buffer);
+            if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','))
+            {
+                /* parse next element */
+                input_buffer->offset++;
+                buffer_skip_whitespace(input_buffer);
+                current_item = parse_new_element(&stack.items[stack.size - 1], input_buffer);
+                if (current_item == NULL)
+                {
+                    goto end;
+                }
+                break;
+            }
+
+            if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != (((container->type & 0xFF) == cJSON_Array) ? ']' : '}')))
+            {
+                /* expected end of array/object */
+                if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] == '\0'))
+                {
+                    input_buffer->error = ((container->type & 0xFF) == cJSON_Array) ? cJSON_ParseErrorUnterminatedArray : cJSON_ParseErrorUnterminatedObject;
+                }
+                else
+                {
+                    input_buffer->error = cJSON_ParseErrorMissingValueSeparator;
+                }
+                goto end;
+            }
+            input_buffer->offset++;
+            stack.size--;
+            if (input_buffer->pack && ((container->type & 0xFF) == cJSON_Array))
+            {
+                /* stays unpacked if it holds anything else than numbers */
+                pack_array(container, input_buffer->pool);
+            }
+        }
     }
-    /* object */
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '{'))
+
+end:
+    if (stack.items != stack.preallocated)
     {
-        return parse_object(item, input_buffer);
+        input_buffer->hooks.deallocate(stack.items);
     }
 
-    return false;
+    return success;
 }
 
-/* Render a value to text. */
-static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer)
+/* Render a value that is not an array/object to text. */
+static cJSON_bool print_scalar(const cJSON * const item, printbuffer * const output_buffer)
 {
     unsigned char *output = NULL;
 
-    if ((item == NULL) || (output_buffer == NULL))
+    if (item->type & cJSON_IsLazy)
     {
-        return false;
+        /* never decoded, so the parsed text is still valid JSON */
+        output = ensure(output_buffer, (size_t)item->valueint + sizeof(""));
+        if (output == NULL)
+        {
+            return false;
+        }
+        memcpy(output, item->valuestring, (size_t)item->valueint);
+        output[item->valueint] = '\0';
+        return true;
     }
 
     switch ((item->type) & 0xFF)
@@ -1422,147 +3289,154 @@ static cJSON_bool print_value(const cJSON * const item, printbuffer * const outp
         case cJSON_String:
             return print_string(item, output_buffer);
 
-        case cJSON_Array:
-            return print_array(item, output_buffer);
-
-        case cJSON_Object:
-            return print_object(item, output_buffer);
-
         default:
             return false;
     }
 }
 
-/* Build an array from input text. */
-static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buffer)
+/* Render the numbers of a packed array and the closing bracket */
+static cJSON_bool print_packed_array(const cJSON * const item, printbuffer * const output_buffer)
 {
-    cJSON *head = NULL; /* head of the linked list */
-    cJSON *current_item = NULL;
+    const double *numbers = (const double*)(const void*)item->valuestring;
+    unsigned char *output_pointer = NULL;
+    size_t length = (size_t) (output_buffer->format ? 2 : 1);
+    cJSON number;
+    int i = 0;
 
-    if (input_buffer->depth >= CJSON_NESTING_LIMIT)
+    for (i = 0; i < item->valueint; i++)
     {
-        return false; /* to deeply nested */
+        set_packed_number(&number, numbers[i]);
+        if (!print_number(&number, output_buffer))
+        {
+            return false;
+        }
+        update_offset(output_buffer);
+        if ((i + 1) < item->valueint)
+        {
+            output_pointer = ensure(output_buffer, length + 1);
+            if (output_pointer == NULL)
+            {
+                return false;
+            }
+            *output_pointer++ = ',';
+            if(output_buffer->format)
+            {
+                *output_pointer++ = ' ';
+            }
+            *output_pointer = '\0';
+            output_buffer->offset += length;
+        }
     }
-    input_buffer->depth++;
 
-    if (buffer_at_offset(input_buffer)[0] != '[')
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
     {
-        /* not an array */
-        goto fail;
+        return false;
     }
+    *output_pointer++ = ']';
+    *output_pointer = '\0';
+    output_buffer->depth--;
 
-    input_buffer->offset++;
-    buffer_skip_whitespace(input_buffer);
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ']'))
-    {
-        /* empty array */
-        goto success;
-    }
+    return true;
+}
 
-    /* check if we skipped to the end of the buffer */
-    if (cannot_access_at_index(input_buffer, 0))
-    {
-        input_buffer->offset--;
-        goto fail;
-    }
+/* Render the opening bracket of an array/object. Packed arrays are rendered completely. */
+static cJSON_bool print_container_start(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    size_t length = 0;
 
-    /* step back to character in front of the first element */
-    input_buffer->offset--;
-    /* loop through the comma separated array elements */
-    do
+    if ((item->type & 0xFF) == cJSON_Array)
     {
-        /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
-        if (new_item == NULL)
+        output_pointer = ensure(output_buffer, 1);
+        if (output_pointer == NULL)
         {
-            goto fail; /* allocation failure */
+            return false;
         }
 
-        /* attach next item to list */
-        if (head == NULL)
-        {
-            /* start the linked list */
-            current_item = head = new_item;
-        }
-        else
-        {
-            /* add to the end and advance */
-            current_item->next = new_item;
-            new_item->prev = current_item;
-            current_item = new_item;
-        }
+        *output_pointer = '[';
+        output_buffer->offset++;
+        output_buffer->depth++;
 
-        /* parse next value */
-        input_buffer->offset++;
-        buffer_skip_whitespace(input_buffer);
-        if (!parse_value(current_item, input_buffer))
+        if (item->type & cJSON_IsPacked)
         {
-            goto fail; /* failed to parse value */
+            return print_packed_array(item, output_buffer);
         }
-        buffer_skip_whitespace(input_buffer);
+        return true;
     }
-    while (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','));
 
-    if (cannot_access_at_index(input_buffer, 0) || buffer_at_offset(input_buffer)[0] != ']')
+    length = (size_t) (output_buffer->format ? 2 : 1); /* fmt: {\n */
+    output_pointer = ensure(output_buffer, length + 1);
+    if (output_pointer == NULL)
     {
-        goto fail; /* expected end of array */
-    }
-
-success:
-    input_buffer->depth--;
-
-    if (head != NULL) {
-        head->prev = current_item;
+        return false;
     }
 
-    item->type = cJSON_Array;
-    item->child = head;
-
-    input_buffer->offset++;
-
-    return true;
-
-fail:
-    if (head != NULL)
+    *output_pointer++ = '{';
+    output_buffer->depth++;
+    if (output_buffer->format)
     {
-        cJSON_Delete(head);
+        *output_pointer++ = '\n';
     }
+    output_buffer->offset += length;
 
-    return false;
+    return true;
 }
 
-/* Render an array to text */
-static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer)
+/* Render the indentation and the name of an object member. */
+static cJSON_bool print_member_name(const cJSON * const item, printbuffer * const output_buffer)
 {
     unsigned char *output_pointer = NULL;
     size_t length = 0;
-    cJSON *current_element = item->child;
 
-    if (output_buffer == NULL)
+    if (output_buffer->format)
+    {
+        size_t i;
+        output_pointer = ensure(output_buffer, output_buffer->depth);
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        for (i = 0; i < output_buffer->depth; i++)
+        {
+            *output_pointer++ = '\t';
+        }
+        output_buffer->offset += output_buffer->depth;
+    }
+
+    /* print key */
+    if (!print_string_ptr((unsigned char*)item->string, output_buffer))
     {
         return false;
     }
+    update_offset(output_buffer);
 
-    /* Compose the output array. */
-    /* opening square bracket */
-    output_pointer = ensure(output_buffer, 1);
+    length = (size_t) (output_buffer->format ? 2 : 1);
+    output_pointer = ensure(output_buffer, length);
     if (output_pointer == NULL)
     {
         return false;
     }
+    *output_pointer++ = ':';
+    if (output_buffer->format)
+    {
+        *output_pointer++ = '\t';
+    }
+    output_buffer->offset += length;
 
-    *output_pointer = '[';
-    output_buffer->offset++;
-    output_buffer->depth++;
+    return true;
+}
+
+/* Render what follows an element of an array/object: the comma if it is not the last one and,
+ * in objects, the line break. */
+static cJSON_bool print_separator(const cJSON * const container, const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    size_t length = 0;
 
-    while (current_element != NULL)
+    if ((container->type & 0xFF) == cJSON_Array)
     {
-        if (!print_value(current_element, output_buffer))
-        {
-            return false;
-        }
-        update_offset(output_buffer);
-        if (current_element->next)
+        if (item->next)
         {
             length = (size_t) (output_buffer->format ? 2 : 1);
             output_pointer = ensure(output_buffer, length + 1);
@@ -1578,246 +3452,311 @@ static cJSON_bool print_array(const cJSON * const item, printbuffer * const outp
             *output_pointer = '\0';
             output_buffer->offset += length;
         }
-        current_element = current_element->next;
+        return true;
     }
 
-    output_pointer = ensure(output_buffer, 2);
+    /* print comma if not last */
+    length = ((size_t)(output_buffer->format ? 1 : 0) + (size_t)(item->next ? 1 : 0));
+    output_pointer = ensure(output_buffer, length + 1);
     if (output_pointer == NULL)
     {
         return false;
     }
-    *output_pointer++ = ']';
+    if (item->next)
+    {
+        *output_pointer++ = ',';
+    }
+
+    if (output_buffer->format)
+    {
+        *output_pointer++ = '\n';
+    }
     *output_pointer = '\0';
-    output_buffer->depth--;
+    output_buffer->offset += length;
 
     return true;
 }
 
-/* Build an object from the text. */
-static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_buffer)
+/* Render the closing bracket of an array/object. */
+static cJSON_bool print_container_end(const cJSON * const item, printbuffer * const output_buffer)
 {
-    cJSON *head = NULL; /* linked list head */
-    cJSON *current_item = NULL;
+    unsigned char *output_pointer = NULL;
 
-    if (input_buffer->depth >= CJSON_NESTING_LIMIT)
+    if ((item->type & 0xFF) == cJSON_Array)
     {
-        return false; /* to deeply nested */
+        output_pointer = ensure(output_buffer, 2);
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        *output_pointer++ = ']';
+        *output_pointer = '\0';
+        output_buffer->depth--;
+
+        return true;
     }
-    input_buffer->depth++;
 
-    if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != '{'))
+    output_pointer = ensure(output_buffer, output_buffer->format ? (output_buffer->depth + 1) : 2);
+    if (output_pointer == NULL)
     {
-        goto fail; /* not an object */
+        return false;
     }
-
-    input_buffer->offset++;
-    buffer_skip_whitespace(input_buffer);
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '}'))
+    if (output_buffer->format)
     {
-        goto success; /* empty object */
+        size_t i;
+        for (i = 0; i < (output_buffer->depth - 1); i++)
+        {
+            *output_pointer++ = '\t';
+        }
     }
+    *output_pointer++ = '}';
+    *output_pointer = '\0';
+    output_buffer->depth--;
+
+    return true;
+}
 
-    /* check if we skipped to the end of the buffer */
-    if (cannot_access_at_index(input_buffer, 0))
+/* Render a value to text.
+ * Arrays and objects don't recurse, the ones that are still open are kept on an explicit stack instead.
+ * This keeps the C stack usage constant regardless of how deeply the tree is nested. */
+static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer)
+{
+    walk_stack stack;
+    const cJSON *current = item;
+    const cJSON *container = NULL;
+    cJSON_bool success = false;
+
+    if ((item == NULL) || (output_buffer == NULL))
     {
-        input_buffer->offset--;
-        goto fail;
+        return false;
     }
 
-    /* step back to character in front of the first element */
-    input_buffer->offset--;
-    /* loop through the comma separated array elements */
-    do
+    walk_stack_init(&stack);
+    for (;;)
     {
-        /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
-        if (new_item == NULL)
-        {
-            goto fail; /* allocation failure */
-        }
-
-        /* attach next item to list */
-        if (head == NULL)
+        /* print the current value, arrays/objects with children only get opened */
+        if (!(current->type & cJSON_IsLazy) && (((current->type & 0xFF) == cJSON_Array) || ((current->type & 0xFF) == cJSON_Object)))
         {
-            /* start the linked list */
-            current_item = head = new_item;
+            if (!print_container_start(current, output_buffer))
+            {
+                goto end;
+            }
+            if (!(current->type & cJSON_IsPacked) && (current->child != NULL))
+            {
+                if (walk_stack_push(&stack, current) == NULL)
+                {
+                    goto end;
+                }
+                current = current->child;
+                if (((stack.items[stack.size - 1].item->type & 0xFF) == cJSON_Object) && !print_member_name(current, output_buffer))
+                {
+                    goto end;
+                }
+                continue;
+            }
+            if (!(current->type & cJSON_IsPacked) && !print_container_end(current, output_buffer))
+            {
+                goto end;
+            }
         }
-        else
+        else if (!print_scalar(current, output_buffer))
         {
-            /* add to the end and advance */
-            current_item->next = new_item;
-            new_item->prev = current_item;
-            current_item = new_item;
+            goto end;
         }
 
-        /* parse the name of the child */
-        input_buffer->offset++;
-        buffer_skip_whitespace(input_buffer);
-        if (!parse_string(current_item, input_buffer))
+        /* the value is complete, continue with the next element or close the enclosing arrays/objects */
+        for (;;)
         {
-            goto fail; /* failed to parse name */
+            if (stack.size == 0)
+            {
+                success = true;
+                goto end;
+            }
+
+            container = stack.items[stack.size - 1].item;
+            update_offset(output_buffer);
+            if (!print_separator(container, current, output_buffer))
+            {
+                goto end;
+            }
+            if (current->next != NULL)
+            {
+                current = current->next;
+                if (((container->type & 0xFF) == cJSON_Object) && !print_member_name(current, output_buffer))
+                {
+                    goto end;
+                }
+                break;
+            }
+            stack.size--;
+            if (!print_container_end(container, output_buffer))
+            {
+                goto end;
+            }
+            current = container;
         }
-        buffer_skip_whitespace(input_buffer);
+    }
 
-        /* swap valuestring and string, because we parsed the name */
-        current_item->string = current_item->valuestring;
-        current_item->valuestring = NULL;
+end:
+    walk_stack_free(&stack);
 
-        if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
-        {
-            goto fail; /* invalid object */
-        }
+    return success;
+}
 
-        /* parse the value */
-        input_buffer->offset++;
-        buffer_skip_whitespace(input_buffer);
-        if (!parse_value(current_item, input_buffer))
-        {
-            goto fail; /* failed to parse value */
-        }
-        buffer_skip_whitespace(input_buffer);
+/* The vector of an indexed array (cJSON_IsIndexed), kept in valuestring. */
+typedef struct child_index
+{
+    size_t size;
+    size_t capacity;
+    cJSON *items[1];
+} child_index;
+
+#define child_index_of(array) ((child_index*)(void*)(array)->valuestring)
+
+static void drop_index(cJSON * const array)
+{
+    if (array->type & cJSON_IsIndexed)
+    {
+        deallocate_with(item_allocator(array), array->valuestring);
+        array->valuestring = NULL;
+        array->type &= ~cJSON_IsIndexed;
     }
-    while (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','));
+}
+
+/* (Re)build the index of array with room for capacity items, at least for the ones it has. */
+static cJSON_bool resize_index(cJSON * const array, size_t capacity)
+{
+    child_index *index = NULL;
+    cJSON *child = NULL;
+    size_t size = 0;
 
-    if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != '}'))
+    if ((array->type & (cJSON_IsReference | cJSON_IsPacked)) || (((array->type & 0xFF) != cJSON_Array) && ((array->type & 0xFF) != cJSON_Object)))
     {
-        goto fail; /* expected end of object */
+        return false;
     }
 
-success:
-    input_buffer->depth--;
+    if (array->type & cJSON_IsIndexed)
+    {
+        size = child_index_of(array)->size;
+    }
+    else
+    {
+        for (child = array->child; child != NULL; child = child->next)
+        {
+            size++;
+        }
+    }
+    if (capacity < size)
+    {
+        capacity = size;
+    }
+    if ((capacity == 0) || (capacity > (((size_t)-1) - sizeof(child_index)) / sizeof(cJSON*)))
+    {
+        capacity = 1;
+    }
 
-    if (head != NULL) {
-        head->prev = current_item;
+    index = (child_index*)allocate_with(item_allocator(array), sizeof(child_index) + (capacity - 1) * sizeof(cJSON*));
+    if (index == NULL)
+    {
+        return false;
+    }
+    index->size = size;
+    index->capacity = capacity;
+    if (array->type & cJSON_IsIndexed)
+    {
+        memcpy(index->items, child_index_of(array)->items, size * sizeof(cJSON*));
+        deallocate_with(item_allocator(array), array->valuestring);
+    }
+    else
+    {
+        size = 0;
+        for (child = array->child; child != NULL; child = child->next)
+        {
+            index->items[size++] = child;
+        }
     }
 
-    item->type = cJSON_Object;
-    item->child = head;
+    array->valuestring = (char*)index;
+    array->type |= cJSON_IsIndexed;
 
-    input_buffer->offset++;
     return true;
+}
 
-fail:
-    if (head != NULL)
+/* Put item into the index of array at position, items from there on move up. */
+static void index_insert(cJSON * const array, const size_t position, cJSON * const item)
+{
+    child_index *index = NULL;
+
+    if (!(array->type & cJSON_IsIndexed))
     {
-        cJSON_Delete(head);
+        return;
+    }
+    index = child_index_of(array);
+    if ((index->size == index->capacity) && !resize_index(array, index->capacity * 2))
+    {
+        /* GetArrayItem builds it again */
+        drop_index(array);
+        return;
     }
 
-    return false;
+    index = child_index_of(array);
+    memmove(&index->items[position + 1], &index->items[position], (index->size - position) * sizeof(cJSON*));
+    index->items[position] = item;
+    index->size++;
 }
 
-/* Render an object to text. */
-static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer)
+/* Remove item from the index of array, or put replacement at its position if that isn't NULL. */
+static void index_remove(cJSON * const array, const cJSON * const item, cJSON * const replacement)
 {
-    unsigned char *output_pointer = NULL;
-    size_t length = 0;
-    cJSON *current_item = item->child;
+    child_index *index = NULL;
+    size_t position = 0;
 
-    if (output_buffer == NULL)
+    if (!(array->type & cJSON_IsIndexed))
     {
-        return false;
+        return;
     }
-
-    /* Compose the output: */
-    length = (size_t) (output_buffer->format ? 2 : 1); /* fmt: {\n */
-    output_pointer = ensure(output_buffer, length + 1);
-    if (output_pointer == NULL)
+    index = child_index_of(array);
+    while ((position < index->size) && (index->items[position] != item))
     {
-        return false;
+        position++;
     }
-
-    *output_pointer++ = '{';
-    output_buffer->depth++;
-    if (output_buffer->format)
+    if (position == index->size)
     {
-        *output_pointer++ = '\n';
+        /* the children were changed by hand */
+        drop_index(array);
+        return;
     }
-    output_buffer->offset += length;
 
-    while (current_item)
+    if (replacement != NULL)
     {
-        if (output_buffer->format)
-        {
-            size_t i;
-            output_pointer = ensure(output_buffer, output_buffer->depth);
-            if (output_pointer == NULL)
-            {
-                return false;
-            }
-            for (i = 0; i < output_buffer->depth; i++)
-            {
-                *output_pointer++ = '\t';
-            }
-            output_buffer->offset += output_buffer->depth;
-        }
-
-        /* print key */
-        if (!print_string_ptr((unsigned char*)current_item->string, output_buffer))
-        {
-            return false;
-        }
-        update_offset(output_buffer);
-
-        length = (size_t) (output_buffer->format ? 2 : 1);
-        output_pointer = ensure(output_buffer, length);
-        if (output_pointer == NULL)
-        {
-            return false;
-        }
-        *output_pointer++ = ':';
-        if (output_buffer->format)
-        {
-            *output_pointer++ = '\t';
-        }
-        output_buffer->offset += length;
-
-        /* print value */
-        if (!print_value(current_item, output_buffer))
-        {
-            return false;
-        }
-        update_offset(output_buffer);
-
-        /* print comma if not last */
-        length = ((size_t)(output_buffer->format ? 1 : 0) + (size_t)(current_item->next ? 1 : 0));
-        output_pointer = ensure(output_buffer, length + 1);
-        if (output_pointer == NULL)
-        {
-            return false;
-        }
-        if (current_item->next)
-        {
-            *output_pointer++ = ',';
-        }
-
-        if (output_buffer->format)
-        {
-            *output_pointer++ = '\n';
-        }
-        *output_pointer = '\0';
-        output_buffer->offset += length;
-
-        current_item = current_item->next;
+        index->items[position] = replacement;
+        return;
     }
+    memmove(&index->items[position], &index->items[position + 1], (index->size - position - 1) * sizeof(cJSON*));
+    index->size--;
+}
 
-    output_pointer = ensure(output_buffer, output_buffer->format ? (output_buffer->depth + 1) : 2);
-    if (output_pointer == NULL)
+CJSON_PUBLIC(cJSON_bool) cJSON_ReserveArray(cJSON *array, int capacity)
+{
+    if ((array == NULL) || (capacity < 0))
     {
         return false;
     }
-    if (output_buffer->format)
+    if ((array->type & cJSON_IsIndexed) && (child_index_of(array)->capacity >= (size_t)capacity))
     {
-        size_t i;
-        for (i = 0; i < (output_buffer->depth - 1); i++)
-        {
-            *output_pointer++ = '\t';
-        }
+        return true;
     }
-    *output_pointer++ = '}';
-    *output_pointer = '\0';
-    output_buffer->depth--;
 
-    return true;
+    return resize_index(array, (size_t)capacity);
+}
+
+CJSON_PUBLIC(void) cJSON_ShrinkArray(cJSON *array)
+{
+    if ((array != NULL) && (array->type & cJSON_IsIndexed) && (child_index_of(array)->capacity > child_index_of(array)->size))
+    {
+        /* the old index stays if there is no memory for the smaller one */
+        resize_index(array, child_index_of(array)->size);
+    }
 }
 
 /* Get Array size/item / object item. */
@@ -1830,6 +3769,14 @@ CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array)
     {
         return 0;
     }
+    if (array->type & cJSON_IsPacked)
+    {
+        return array->valueint;
+    }
+    if (array->type & cJSON_IsIndexed)
+    {
+        return (int)child_index_of(array)->size;
+    }
 
     child = array->child;
 
@@ -1852,6 +3799,19 @@ static cJSON* get_array_item(const cJSON *array, size_t index)
     {
         return NULL;
     }
+    if ((array->type & cJSON_IsPacked) && !cJSON_UnpackArray((cJSON*)cast_away_const(array)))
+    {
+        return NULL;
+    }
+    if (!(array->type & cJSON_IsIndexed) && (index >= CJSON_INDEX_THRESHOLD))
+    {
+        /* walks like this are repeated for the following items, keep falling back to walking if it fails */
+        resize_index((cJSON*)cast_away_const(array), 0);
+    }
+    if (array->type & cJSON_IsIndexed)
+    {
+        return (index < child_index_of(array)->size) ? child_index_of(array)->items[index] : NULL;
+    }
 
     current_child = array->child;
     while ((current_child != NULL) && (index > 0))
@@ -1876,23 +3836,25 @@ CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index)
 static cJSON *get_object_item(const cJSON * const object, const char * const name, const cJSON_bool case_sensitive)
 {
     cJSON *current_element = NULL;
+    unsigned int hash = 0;
 
     if ((object == NULL) || (name == NULL))
     {
         return NULL;
     }
 
+    hash = hash_key((const unsigned char*)name, (size_t)-1);
     current_element = object->child;
     if (case_sensitive)
     {
-        while ((current_element != NULL) && (current_element->string != NULL) && (strcmp(name, current_element->string) != 0))
+        while ((current_element != NULL) && (current_element->string != NULL) && (key_hash_differs(current_element, hash) || (strcmp(name, current_element->string) != 0)))
         {
             current_element = current_element->next;
         }
     }
     else
     {
-        while ((current_element != NULL) && (case_insensitive_strcmp((const unsigned char*)name, (const unsigned char*)(current_element->string)) != 0))
+        while ((current_element != NULL) && (key_hash_differs(current_element, hash) || (case_insensitive_strcmp((const unsigned char*)name, (const unsigned char*)(current_element->string)) != 0)))
         {
             current_element = current_element->next;
         }
@@ -1915,6 +3877,132 @@ CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const objec
     return get_object_item(object, string, true);
 }
 
+/* compares a name of known length with a zero terminated key without calling strlen on either of them */
+static cJSON_bool key_equals(const unsigned char * const name, const size_t length, const unsigned char *key, const cJSON_bool case_sensitive)
+{
+    size_t position = 0;
+
+    if (key == NULL)
+    {
+        return false;
+    }
+
+    for (position = 0; position < length; position++)
+    {
+        /* the key is shorter than the name */
+        if (key[position] == '\0')
+        {
+            return false;
+        }
+
+        if (case_sensitive ? (name[position] != key[position]) : (tolower(name[position]) != tolower(key[position])))
+        {
+            return false;
+        }
+    }
+
+    return key[length] == '\0';
+}
+
+static cJSON *get_object_item_with_hash(const cJSON * const object, const char * const name, const size_t length, const unsigned int hash, const cJSON_bool case_sensitive)
+{
+    cJSON *current_element = NULL;
+
+    if ((object == NULL) || (name == NULL))
+    {
+        return NULL;
+    }
+
+    current_element = object->child;
+    while ((current_element != NULL) && (key_hash_differs(current_element, hash) || !key_equals((const unsigned char*)name, length, (const unsigned char*)current_element->string, case_sensitive)))
+    {
+        current_element = current_element->next;
+    }
+
+    return current_element;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemWithLength(const cJSON * const object, const char * const string, size_t length)
+{
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    return get_object_item_with_hash(object, string, length, hash_key((const unsigned char*)string, length), false);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitiveWithLength(const cJSON * const object, const char * const string, size_t length)
+{
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    return get_object_item_with_hash(object, string, length, hash_key((const unsigned char*)string, length), true);
+}
+
+CJSON_PUBLIC(unsigned int) cJSON_HashKey(const char *string, size_t length)
+{
+    if (string == NULL)
+    {
+        return 0;
+    }
+
+    return hash_key((const unsigned char*)string, length);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemWithHash(const cJSON * const object, const char * const string, size_t length, unsigned int hash)
+{
+    return get_object_item_with_hash(object, string, length, hash, false);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitiveWithHash(const cJSON * const object, const char * const string, size_t length, unsigned int hash)
+{
+    return get_object_item_with_hash(object, string, length, hash, true);
+}
+
+CJSON_PUBLIC(size_t) cJSON_GetObjectItems(const cJSON * const object, const cJSON_Key *keys, size_t count, cJSON **items, cJSON_bool case_sensitive)
+{
+    cJSON *current_element = NULL;
+    size_t found = 0;
+    size_t index = 0;
+
+    if ((keys == NULL) || (items == NULL))
+    {
+        return 0;
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        items[index] = NULL;
+    }
+
+    if (object == NULL)
+    {
+        return 0;
+    }
+
+    for (current_element = object->child; (current_element != NULL) && (found < count); current_element = current_element->next)
+    {
+        for (index = 0; index < count; index++)
+        {
+            if ((items[index] != NULL) || (keys[index].string == NULL) || key_hash_differs(current_element, keys[index].hash))
+            {
+                continue;
+            }
+
+            if (key_equals((const unsigned char*)keys[index].string, keys[index].length, (const unsigned char*)current_element->string, case_sensitive))
+            {
+                items[index] = current_element;
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
 CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *string)
 {
     return cJSON_GetObjectItem(object, string) ? 1 : 0;
@@ -1928,23 +4016,59 @@ static void suffix_object(cJSON *prev, cJSON *item)
 }
 
 /* Utility for handling references. */
-static cJSON *create_reference(const cJSON *item, const internal_hooks * const hooks)
+static cJSON *create_reference(const cJSON *item)
 {
     cJSON *reference = NULL;
+    cJSON_bool owned = false;
     if (item == NULL)
     {
         return NULL;
     }
 
-    reference = cJSON_New_Item(hooks);
+    reference = cJSON_New_Item(NULL);
     if (reference == NULL)
     {
         return NULL;
     }
 
     memcpy(reference, item, sizeof(cJSON));
+    if (item->type & cJSON_IsIndexed)
+    {
+        /* the index belongs to item */
+        reference->valuestring = NULL;
+        reference->type &= ~cJSON_IsIndexed;
+    }
+    else if (item->type & cJSON_StringIsInline)
+    {
+        /* the copied bytes are the string */
+        reference->valuestring = cJSON_InlineString(reference);
+    }
+    else if (item->type & cJSON_IsLazy)
+    {
+        /* the getters decode into the reference itself, it has to own the decoded string, so it isn't a reference */
+        owned = true;
+    }
+    else if (item->type & cJSON_IsPacked)
+    {
+        /* unpacking the reference would free the buffer of item, so it gets its own copy and isn't a reference */
+        owned = true;
+        if (item->valuestring != NULL)
+        {
+            reference->valuestring = (char*)allocate_with(NULL, (size_t)item->valueint * sizeof(double));
+            if (reference->valuestring == NULL)
+            {
+                delete_node(reference);
+                return NULL;
+            }
+            memcpy(reference->valuestring, item->valuestring, (size_t)item->valueint * sizeof(double));
+        }
+    }
     reference->string = NULL;
-    reference->type |= cJSON_IsReference;
+    reference->type &= ~(cJSON_IsFlat | cJSON_StringIsFlat | cJSON_IsAllocated);
+    if (!owned)
+    {
+        reference->type |= cJSON_IsReference;
+    }
     reference->next = reference->prev = NULL;
     return reference;
 }
@@ -1957,6 +4081,10 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
     {
         return false;
     }
+    if ((array->type & cJSON_IsPacked) && !cJSON_UnpackArray(array))
+    {
+        return false;
+    }
 
     child = array->child;
     /*
@@ -1978,6 +4106,10 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
             array->child->prev = item;
         }
     }
+    if (array->type & cJSON_IsIndexed)
+    {
+        index_insert(array, child_index_of(array)->size, item);
+    }
 
     return true;
 }
@@ -2004,7 +4136,7 @@ static void* cast_away_const(const void* string)
 #endif
 
 
-static cJSON_bool add_item_to_object(cJSON * const object, const char * const string, cJSON * const item, const internal_hooks * const hooks, const cJSON_bool constant_key)
+static cJSON_bool add_item_to_object(cJSON * const object, const char * const string, cJSON * const item, const cJSON_bool constant_key)
 {
     char *new_key = NULL;
     int new_type = cJSON_Invalid;
@@ -2017,39 +4149,67 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
     if (constant_key)
     {
         new_key = (char*)cast_away_const(string);
-        new_type = item->type | cJSON_StringIsConst;
+        new_type = (item->type | cJSON_StringIsConst) & ~(cJSON_StringIsPooled | cJSON_StringIsInterned);
     }
     else
     {
-        new_key = (char*)cJSON_strdup((const unsigned char*)string, hooks);
+        new_key = (char*)cJSON_strdup((const unsigned char*)string, item_allocator(item));
         if (new_key == NULL)
         {
             return false;
         }
 
-        new_type = item->type & ~cJSON_StringIsConst;
+        new_type = item->type & ~(cJSON_StringIsConst | cJSON_StringIsPooled | cJSON_StringIsInterned);
     }
 
     if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
     {
-        hooks->deallocate(item->string);
+        deallocate_with(item_allocator(item), item->string);
     }
 
     item->string = new_key;
     item->type = new_type;
+    hash_item_key(item, (size_t)-1);
 
     return add_item_to_array(object, item);
 }
 
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
 {
-    return add_item_to_object(object, string, item, &global_hooks, false);
+    return add_item_to_object(object, string, item, false);
 }
 
 /* Add an item to an object with constant string as key */
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectCS(cJSON *object, const char *string, cJSON *item)
 {
-    return add_item_to_object(object, string, item, &global_hooks, true);
+    return add_item_to_object(object, string, item, true);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectWithLength(cJSON *object, const char *string, size_t length, cJSON *item)
+{
+    char *new_key = NULL;
+
+    if ((object == NULL) || (string == NULL) || (item == NULL) || (object == item))
+    {
+        return false;
+    }
+
+    new_key = (char*)cJSON_strndup((const unsigned char*)string, length, item_allocator(item));
+    if (new_key == NULL)
+    {
+        return false;
+    }
+
+    if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
+    {
+        deallocate_with(item_allocator(item), item->string);
+    }
+
+    item->string = new_key;
+    item->type &= ~(cJSON_StringIsConst | cJSON_StringIsPooled | cJSON_StringIsInterned);
+    hash_item_key(item, length);
+
+    return add_item_to_array(object, item);
 }
 
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item)
@@ -2059,7 +4219,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item
         return false;
     }
 
-    return add_item_to_array(array, create_reference(item, &global_hooks));
+    return add_item_to_array(array, create_reference(item));
 }
 
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToObject(cJSON *object, const char *string, cJSON *item)
@@ -2069,13 +4229,13 @@ CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToObject(cJSON *object, const cha
         return false;
     }
 
-    return add_item_to_object(object, string, create_reference(item, &global_hooks), &global_hooks, false);
+    return add_item_to_object(object, string, create_reference(item), false);
 }
 
 CJSON_PUBLIC(cJSON*) cJSON_AddNullToObject(cJSON * const object, const char * const name)
 {
     cJSON *null = cJSON_CreateNull();
-    if (add_item_to_object(object, name, null, &global_hooks, false))
+    if (add_item_to_object(object, name, null, false))
     {
         return null;
     }
@@ -2087,7 +4247,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddNullToObject(cJSON * const object, const char * co
 CJSON_PUBLIC(cJSON*) cJSON_AddTrueToObject(cJSON * const object, const char * const name)
 {
     cJSON *true_item = cJSON_CreateTrue();
-    if (add_item_to_object(object, name, true_item, &global_hooks, false))
+    if (add_item_to_object(object, name, true_item, false))
     {
         return true_item;
     }
@@ -2099,7 +4259,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddTrueToObject(cJSON * const object, const char * co
 CJSON_PUBLIC(cJSON*) cJSON_AddFalseToObject(cJSON * const object, const char * const name)
 {
     cJSON *false_item = cJSON_CreateFalse();
-    if (add_item_to_object(object, name, false_item, &global_hooks, false))
+    if (add_item_to_object(object, name, false_item, false))
     {
         return false_item;
     }
@@ -2111,7 +4271,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddFalseToObject(cJSON * const object, const char * c
 CJSON_PUBLIC(cJSON*) cJSON_AddBoolToObject(cJSON * const object, const char * const name, const cJSON_bool boolean)
 {
     cJSON *bool_item = cJSON_CreateBool(boolean);
-    if (add_item_to_object(object, name, bool_item, &global_hooks, false))
+    if (add_item_to_object(object, name, bool_item, false))
     {
         return bool_item;
     }
@@ -2123,7 +4283,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddBoolToObject(cJSON * const object, const char * co
 CJSON_PUBLIC(cJSON*) cJSON_AddNumberToObject(cJSON * const object, const char * const name, const double number)
 {
     cJSON *number_item = cJSON_CreateNumber(number);
-    if (add_item_to_object(object, name, number_item, &global_hooks, false))
+    if (add_item_to_object(object, name, number_item, false))
     {
         return number_item;
     }
@@ -2135,7 +4295,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddNumberToObject(cJSON * const object, const char *
 CJSON_PUBLIC(cJSON*) cJSON_AddStringToObject(cJSON * const object, const char * const name, const char * const string)
 {
     cJSON *string_item = cJSON_CreateString(string);
-    if (add_item_to_object(object, name, string_item, &global_hooks, false))
+    if (add_item_to_object(object, name, string_item, false))
     {
         return string_item;
     }
@@ -2147,7 +4307,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddStringToObject(cJSON * const object, const char *
 CJSON_PUBLIC(cJSON*) cJSON_AddRawToObject(cJSON * const object, const char * const name, const char * const raw)
 {
     cJSON *raw_item = cJSON_CreateRaw(raw);
-    if (add_item_to_object(object, name, raw_item, &global_hooks, false))
+    if (add_item_to_object(object, name, raw_item, false))
     {
         return raw_item;
     }
@@ -2159,7 +4319,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddRawToObject(cJSON * const object, const char * con
 CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObject(cJSON * const object, const char * const name)
 {
     cJSON *object_item = cJSON_CreateObject();
-    if (add_item_to_object(object, name, object_item, &global_hooks, false))
+    if (add_item_to_object(object, name, object_item, false))
     {
         return object_item;
     }
@@ -2171,7 +4331,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObject(cJSON * const object, const char *
 CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObject(cJSON * const object, const char * const name)
 {
     cJSON *array = cJSON_CreateArray();
-    if (add_item_to_object(object, name, array, &global_hooks, false))
+    if (add_item_to_object(object, name, array, false))
     {
         return array;
     }
@@ -2187,6 +4347,7 @@ CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const it
         return NULL;
     }
 
+    index_remove(parent, item, NULL);
     if (item != parent->child)
     {
         /* not the first element */
@@ -2271,6 +4432,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
         return add_item_to_array(array, newitem);
     }
 
+    index_insert(array, (size_t)which, newitem);
     newitem->next = after_inserted;
     newitem->prev = after_inserted->prev;
     after_inserted->prev = newitem;
@@ -2297,6 +4459,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON
         return true;
     }
 
+    index_remove(parent, item, replacement);
     replacement->next = item->next;
     replacement->prev = item->prev;
 
@@ -2354,10 +4517,14 @@ static cJSON_bool replace_item_in_object(cJSON *object, const char *string, cJSO
     /* replace the name in the replacement */
     if (!(replacement->type & cJSON_StringIsConst) && (replacement->string != NULL))
     {
-        cJSON_free(replacement->string);
+        deallocate_with(item_allocator(replacement), replacement->string);
+    }
+    replacement->string = (char*)cJSON_strdup((const unsigned char*)string, item_allocator(replacement));
+    replacement->type &= ~(cJSON_StringIsConst | cJSON_StringIsPooled | cJSON_StringIsHashed | cJSON_StringIsInterned);
+    if (replacement->string != NULL)
+    {
+        hash_item_key(replacement, (size_t)-1);
     }
-    replacement->string = (char*)cJSON_strdup((const unsigned char*)string, &global_hooks);
-    replacement->type &= ~cJSON_StringIsConst;
 
     return cJSON_ReplaceItemViaPointer(object, get_object_item(object, string, case_sensitive), replacement);
 }
@@ -2375,7 +4542,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemInObjectCaseSensitive(cJSON *object, c
 /* Create basic types: */
 CJSON_PUBLIC(cJSON *) cJSON_CreateNull(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = cJSON_NULL;
@@ -2386,7 +4553,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateNull(void)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateTrue(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = cJSON_True;
@@ -2397,7 +4564,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateTrue(void)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateFalse(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = cJSON_False;
@@ -2408,7 +4575,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateFalse(void)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateBool(cJSON_bool boolean)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = boolean ? cJSON_True : cJSON_False;
@@ -2419,7 +4586,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateBool(cJSON_bool boolean)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = cJSON_Number;
@@ -2436,25 +4603,85 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
         }
         else
         {
-            item->valueint = (int)num;
+            item->valueint = (int)num;
+        }
+    }
+
+    return item;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateInt64(cJSON_int64 num)
+{
+    cJSON *item = cJSON_CreateNumber((double)num);
+    if(item)
+    {
+        item->valueint64 = num;
+        item->type |= cJSON_NumberIsInt64;
+    }
+
+    return item;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateUInt64(cJSON_uint64 num)
+{
+    cJSON *item = NULL;
+    if (num <= (cJSON_uint64)CJSON_INT64_MAX)
+    {
+        return cJSON_CreateInt64((cJSON_int64)num);
+    }
+
+    item = cJSON_CreateNumber((double)num);
+    if(item)
+    {
+        item->valueint64 = (cJSON_int64)num;
+        item->type |= cJSON_NumberIsUInt64;
+    }
+
+    return item;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
+{
+    cJSON *item = NULL;
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    item = cJSON_New_Item(NULL);
+    if(item)
+    {
+        size_t length = strlen(string);
+        item->type = cJSON_String;
+        if (!set_string_value(item, string, length))
+        {
+            cJSON_Delete(item);
+            return NULL;
         }
+        set_string_length(item, length);
     }
 
     return item;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
+CJSON_PUBLIC(cJSON *) cJSON_CreateStringWithLength(const char *string, size_t length)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
+        const char *end = (const char*)memchr(string, '\0', length);
+        /* the value ends at the first '\0' like everywhere else */
+        if (end != NULL)
+        {
+            length = (size_t)(end - string);
+        }
         item->type = cJSON_String;
-        item->valuestring = (char*)cJSON_strdup((const unsigned char*)string, &global_hooks);
-        if(!item->valuestring)
+        if (!set_string_value(item, string, length))
         {
             cJSON_Delete(item);
             return NULL;
         }
+        set_string_length(item, length);
     }
 
     return item;
@@ -2462,7 +4689,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateStringReference(const char *string)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if (item != NULL)
     {
         item->type = cJSON_String | cJSON_IsReference;
@@ -2474,7 +4701,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateStringReference(const char *string)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateObjectReference(const cJSON *child)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if (item != NULL) {
         item->type = cJSON_Object | cJSON_IsReference;
         item->child = (cJSON*)cast_away_const(child);
@@ -2484,7 +4711,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateObjectReference(const cJSON *child)
 }
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateArrayReference(const cJSON *child) {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if (item != NULL) {
         item->type = cJSON_Array | cJSON_IsReference;
         item->child = (cJSON*)cast_away_const(child);
@@ -2495,11 +4722,11 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateArrayReference(const cJSON *child) {
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type = cJSON_Raw;
-        item->valuestring = (char*)cJSON_strdup((const unsigned char*)raw, &global_hooks);
+        item->valuestring = (char*)cJSON_strdup((const unsigned char*)raw, NULL);
         if(!item->valuestring)
         {
             cJSON_Delete(item);
@@ -2512,7 +4739,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateArray(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if(item)
     {
         item->type=cJSON_Array;
@@ -2523,7 +4750,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateArray(void)
 
 CJSON_PUBLIC(cJSON *) cJSON_CreateObject(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(NULL);
     if (item)
     {
         item->type = cJSON_Object;
@@ -2610,171 +4837,566 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateFloatArray(const float *numbers, int count)
         a->child->prev = n;
     }
 
-    return a;
+    return a;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count)
+{
+    size_t i = 0;
+    cJSON *n = NULL;
+    cJSON *p = NULL;
+    cJSON *a = NULL;
+
+    if ((count < 0) || (numbers == NULL))
+    {
+        return NULL;
+    }
+
+    a = cJSON_CreateArray();
+
+    for(i = 0; a && (i < (size_t)count); i++)
+    {
+        n = cJSON_CreateNumber(numbers[i]);
+        if(!n)
+        {
+            cJSON_Delete(a);
+            return NULL;
+        }
+        if(!i)
+        {
+            a->child = n;
+        }
+        else
+        {
+            suffix_object(p, n);
+        }
+        p = n;
+    }
+
+    if (a && a->child) {
+        a->child->prev = n;
+    }
+
+    return a;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count)
+{
+    size_t i = 0;
+    cJSON *n = NULL;
+    cJSON *p = NULL;
+    cJSON *a = NULL;
+
+    if ((count < 0) || (strings == NULL))
+    {
+        return NULL;
+    }
+
+    a = cJSON_CreateArray();
+
+    for (i = 0; a && (i < (size_t)count); i++)
+    {
+        n = cJSON_CreateString(strings[i]);
+        if(!n)
+        {
+            cJSON_Delete(a);
+            return NULL;
+        }
+        if(!i)
+        {
+            a->child = n;
+        }
+        else
+        {
+            suffix_object(p,n);
+        }
+        p = n;
+    }
+
+    if (a && a->child) {
+        a->child->prev = n;
+    }
+    
+    return a;
+}
+
+/* Duplication */
+/* true if item is a number that can be kept in a packed array */
+static cJSON_bool is_packable(const cJSON * const item)
+{
+    if (((item->type & 0xFF) != cJSON_Number) || (item->type & (cJSON_IsLazy | cJSON_NumberIsUInt64)))
+    {
+        return false;
+    }
+    if (item->type & cJSON_NumberIsInt64)
+    {
+        return (item->valueint64 >= -(cJSON_int64)CJSON_DOUBLE_INTEGER_LIMIT) && (item->valueint64 <= (cJSON_int64)CJSON_DOUBLE_INTEGER_LIMIT)
+            && ((double)item->valueint64 == item->valuedouble);
+    }
+
+    return true;
+}
+
+/* Pack array, its child nodes are put into pool (or freed if pool is NULL). */
+static cJSON_bool pack_array(cJSON * const array, cJSON_Pool * const pool)
+{
+    cJSON *element = NULL;
+    double *numbers = NULL;
+    size_t count = 0;
+
+    if ((array == NULL) || ((array->type & 0xFF) != cJSON_Array) || (array->type & cJSON_IsReference))
+    {
+        return false;
+    }
+    if (array->type & cJSON_IsPacked)
+    {
+        return true;
+    }
+
+    for (element = array->child; element != NULL; element = element->next)
+    {
+        if (!is_packable(element) || (count == (size_t)INT_MAX))
+        {
+            return false;
+        }
+        count++;
+    }
+
+    if (count > 0)
+    {
+        numbers = (double*)allocate_with(item_allocator(array), count * sizeof(double));
+        if (numbers == NULL)
+        {
+            return false;
+        }
+        count = 0;
+        for (element = array->child; element != NULL; element = element->next)
+        {
+            numbers[count++] = element->valuedouble;
+        }
+        cJSON_DeleteToPool(pool, array->child);
+    }
+
+    drop_index(array);
+    array->child = NULL;
+    array->valuestring = (char*)numbers;
+    array->valueint = (int)count;
+    array->type |= cJSON_IsPacked;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedDoubleArray(const double *numbers, int count)
+{
+    cJSON *a = NULL;
+
+    if ((count < 0) || ((numbers == NULL) && (count > 0)))
+    {
+        return NULL;
+    }
+
+    a = cJSON_CreateArray();
+    if (a && (count > 0))
+    {
+        a->valuestring = (char*)global_hooks.allocate((size_t)count * sizeof(double));
+        if (!a->valuestring)
+        {
+            cJSON_Delete(a);
+            return NULL;
+        }
+        memcpy(a->valuestring, numbers, (size_t)count * sizeof(double));
+    }
+    if (a)
+    {
+        a->valueint = count;
+        a->type |= cJSON_IsPacked;
+    }
+
+    return a;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArray(cJSON *array)
+{
+    return pack_array(array, NULL);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_UnpackArray(cJSON *array)
+{
+    const cJSON_Allocator *allocator = NULL;
+    const double *numbers = NULL;
+    cJSON *n = NULL;
+    cJSON *p = NULL;
+    cJSON *a = NULL;
+    int i = 0;
+
+    if ((array == NULL) || !(array->type & cJSON_IsPacked))
+    {
+        return true;
+    }
+    if (array->type & cJSON_IsReference)
+    {
+        /* the buffer belongs to the referenced array */
+        return false;
+    }
+
+    /* the elements come from where the array is allocated */
+    allocator = item_allocator(array);
+    numbers = (const double*)(const void*)array->valuestring;
+    for (i = 0; i < array->valueint; i++)
+    {
+        n = cJSON_New_Item(allocator);
+        if (!n)
+        {
+            cJSON_Delete(a);
+            return false;
+        }
+        set_packed_number(n, numbers[i]);
+        if (allocator != NULL)
+        {
+            /* cleared by set_packed_number */
+            n->type |= cJSON_IsAllocated;
+        }
+        if (!i)
+        {
+            a = n;
+        }
+        else
+        {
+            suffix_object(p, n);
+        }
+        p = n;
+    }
+    if (a)
+    {
+        a->prev = n;
+    }
+
+    if (array->valuestring != NULL)
+    {
+        deallocate_with(allocator, array->valuestring);
+    }
+    array->valuestring = NULL;
+    array->valueint = 0;
+    array->child = a;
+    array->type &= ~cJSON_IsPacked;
+
+    return true;
+}
+
+CJSON_PUBLIC(const double *) cJSON_GetPackedArrayData(const cJSON *array)
+{
+    if ((array == NULL) || !(array->type & cJSON_IsPacked))
+    {
+        return NULL;
+    }
+
+    return (const double*)(const void*)array->valuestring;
+}
+
+/* Copy item without its children, the copy and its strings come from allocator. */
+static cJSON *duplicate_node(const cJSON * const item, const cJSON_bool recurse, const cJSON_Allocator * const allocator)
+{
+    cJSON *newitem = NULL;
+
+    /* Create new item */
+    newitem = cJSON_New_Item(allocator);
+    if (!newitem)
+    {
+        goto fail;
+    }
+    /* Copy over all vars, the new node is already marked cJSON_IsAllocated if it has to be */
+    newitem->type |= item->type & (~(cJSON_IsReference | cJSON_StringIsPooled | cJSON_IsFlat | cJSON_StringIsFlat | cJSON_IsAllocated));
+    newitem->valueint = item->valueint;
+    newitem->valuedouble = item->valuedouble;
+    newitem->valueint64 = item->valueint64;
+    newitem->stringhash = item->stringhash;
+    if (item->type & cJSON_IsLazy)
+    {
+        /* refers to the same parsed text */
+        newitem->valuestring = item->valuestring;
+    }
+    else if (item->type & cJSON_IsIndexed)
+    {
+        /* the children are copied into a plain list */
+        newitem->type &= ~cJSON_IsIndexed;
+    }
+    else if ((item->type & cJSON_IsPacked) && !recurse)
+    {
+        /* the numbers are the items of the array */
+        newitem->type &= ~cJSON_IsPacked;
+        newitem->valueint = 0;
+    }
+    else if ((item->type & cJSON_IsPacked) && (item->valuestring != NULL))
+    {
+        newitem->valuestring = (char*)allocate_with(allocator, (size_t)item->valueint * sizeof(double));
+        if (!newitem->valuestring)
+        {
+            goto fail;
+        }
+        memcpy(newitem->valuestring, item->valuestring, (size_t)item->valueint * sizeof(double));
+    }
+    else if (item->valuestring && ((item->type & 0xFF) == cJSON_String))
+    {
+        newitem->type &= ~cJSON_StringIsInline;
+        if (!set_string_value(newitem, item->valuestring, string_length(item)))
+        {
+            goto fail;
+        }
+    }
+    else if (item->valuestring)
+    {
+        newitem->valuestring = (char*)cJSON_strndup((unsigned char*)item->valuestring, string_length(item), allocator);
+        if (!newitem->valuestring)
+        {
+            goto fail;
+        }
+    }
+    if (item->string)
+    {
+        /* a key copied into a flat block is const but lives only as long as the block */
+        if ((item->type & cJSON_StringIsConst) && ((item->type & (cJSON_IsFlat | cJSON_StringIsInterned)) != cJSON_IsFlat))
+        {
+            newitem->string = item->string;
+        }
+        else
+        {
+            newitem->string = (char*)cJSON_strdup((unsigned char*)item->string, allocator);
+            newitem->type &= ~cJSON_StringIsConst;
+        }
+        if (!newitem->string)
+        {
+            goto fail;
+        }
+    }
+
+    return newitem;
+
+fail:
+    if (newitem != NULL)
+    {
+        cJSON_Delete(newitem);
+    }
+
+    return NULL;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count)
+/* The block of cJSON_DuplicateFlat that is being filled. */
+typedef struct
 {
-    size_t i = 0;
-    cJSON *n = NULL;
-    cJSON *p = NULL;
-    cJSON *a = NULL;
+    flat_block *block;
+    flat_node *next_node;
+    char *next_text;
+} flat_copy;
 
-    if ((count < 0) || (numbers == NULL))
+/* strings that cJSON_DuplicateFlat places in the block, short strings are inline in the node */
+static cJSON_bool has_flat_text(const cJSON * const item)
+{
+    if ((item->valuestring == NULL) || (item->type & cJSON_IsLazy))
     {
-        return NULL;
+        return false;
+    }
+    if ((item->type & 0xFF) == cJSON_String)
+    {
+        return string_length(item) >= CJSON_INLINE_STRING_SIZE;
     }
 
-    a = cJSON_CreateArray();
+    return (item->type & 0xFF) == cJSON_Raw;
+}
 
-    for(i = 0; a && (i < (size_t)count); i++)
+/* Copy item without its children into the next free node of the block. */
+static cJSON *duplicate_flat_node(const cJSON * const item, flat_copy * const flat)
+{
+    cJSON *newitem = &flat->next_node->node;
+    size_t length = 0;
+
+    flat->next_node->block = flat->block;
+    flat->next_node++;
+    flat->block->references++;
+    memset(newitem, '\0', sizeof(cJSON));
+    newitem->type = (item->type & ~(cJSON_IsReference | cJSON_StringIsPooled | cJSON_IsIndexed | cJSON_StringIsFlat | cJSON_IsAllocated)) | cJSON_IsFlat;
+    newitem->valueint = item->valueint;
+    newitem->valuedouble = item->valuedouble;
+    newitem->valueint64 = item->valueint64;
+    newitem->stringhash = item->stringhash;
+    if (item->type & cJSON_IsLazy)
     {
-        n = cJSON_CreateNumber(numbers[i]);
-        if(!n)
+        /* refers to the same parsed text */
+        newitem->valuestring = item->valuestring;
+    }
+    else if ((item->type & cJSON_IsPacked) && (item->valuestring != NULL))
+    {
+        /* the buffer can be grown or dropped later, it stays a separate allocation */
+        newitem->valuestring = (char*)allocate_with(flat->block->allocator, (size_t)item->valueint * sizeof(double));
+        if (newitem->valuestring == NULL)
         {
-            cJSON_Delete(a);
+            /* gives the node back to the block */
+            cJSON_Delete(newitem);
             return NULL;
         }
-        if(!i)
-        {
-            a->child = n;
-        }
-        else
-        {
-            suffix_object(p, n);
-        }
-        p = n;
+        memcpy(newitem->valuestring, item->valuestring, (size_t)item->valueint * sizeof(double));
     }
-
-    if (a && a->child) {
-        a->child->prev = n;
+    else if (has_flat_text(item))
+    {
+        flat_string *text = (flat_string*)(void*)flat->next_text;
+        length = string_length(item);
+        text->block = flat->block;
+        memcpy(text->text, item->valuestring, length);
+        text->text[length] = '\0';
+        flat->next_text += offsetof(flat_string, text) + flat_text_size(length);
+        flat->block->references++;
+        newitem->valuestring = text->text;
+        newitem->type = (newitem->type | cJSON_StringIsFlat) & ~cJSON_StringIsInline;
+    }
+    else if ((item->valuestring != NULL) && ((item->type & 0xFF) == cJSON_String))
+    {
+        set_string_value(newitem, item->valuestring, string_length(item));
+    }
+    if ((item->string != NULL) && (item->type & cJSON_StringIsInterned))
+    {
+        newitem->string = item->string;
+    }
+    else if (item->string != NULL)
+    {
+        length = strlen(item->string);
+        memcpy(flat->next_text, item->string, length + sizeof(""));
+        newitem->string = flat->next_text;
+        newitem->type |= cJSON_StringIsConst;
+        flat->next_text += flat_text_size(length);
     }
 
-    return a;
+    return newitem;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count)
+/* Copy item and its children in pre-order, into the block of flat if it is set, otherwise from allocator.
+ * Every copy is linked to its parent right away, so the tree can be deleted when a copy fails. */
+static cJSON *duplicate_tree(const cJSON * const item, flat_copy * const flat, const cJSON_Allocator * const allocator)
 {
-    size_t i = 0;
-    cJSON *n = NULL;
-    cJSON *p = NULL;
-    cJSON *a = NULL;
+    walk_stack stack;
+    const cJSON *current = item;
+    cJSON *root = NULL;
+    cJSON *copy = NULL;
+    cJSON *parent = NULL;
 
-    if ((count < 0) || (strings == NULL))
+    root = (flat != NULL) ? duplicate_flat_node(item, flat) : duplicate_node(item, true, allocator);
+    if (root == NULL)
     {
         return NULL;
     }
 
-    a = cJSON_CreateArray();
-
-    for (i = 0; a && (i < (size_t)count); i++)
+    walk_stack_init(&stack);
+    copy = root;
+    for (;;)
     {
-        n = cJSON_CreateString(strings[i]);
-        if(!n)
+        current = walk_next(&stack, current, copy, true);
+        if (current == NULL)
         {
-            cJSON_Delete(a);
-            return NULL;
+            break;
         }
-        if(!i)
+        copy = (flat != NULL) ? duplicate_flat_node(current, flat) : duplicate_node(current, true, allocator);
+        if (copy == NULL)
         {
-            a->child = n;
+            stack.failed = true;
+            break;
+        }
+
+        /* the head of the list keeps a pointer to the last element in prev */
+        parent = stack.items[stack.size - 1].copy;
+        if (parent->child == NULL)
+        {
+            parent->child = copy;
+            copy->prev = copy;
         }
         else
         {
-            suffix_object(p,n);
+            copy->prev = parent->child->prev;
+            parent->child->prev->next = copy;
+            parent->child->prev = copy;
         }
-        p = n;
     }
+    walk_stack_free(&stack);
 
-    if (a && a->child) {
-        a->child->prev = n;
+    if (stack.failed)
+    {
+        cJSON_Delete(root);
+        return NULL;
     }
-    
-    return a;
+
+    return root;
 }
 
-/* Duplication */
 CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
 {
-    cJSON *newitem = NULL;
-    cJSON *child = NULL;
-    cJSON *next = NULL;
-    cJSON *newchild = NULL;
+    return cJSON_DuplicateWithAllocator(item, recurse, NULL);
+}
 
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateWithAllocator(const cJSON *item, cJSON_bool recurse, const cJSON_Allocator *allocator)
+{
     /* Bail on bad ptr */
     if (!item)
     {
-        goto fail;
-    }
-    /* Create new item */
-    newitem = cJSON_New_Item(&global_hooks);
-    if (!newitem)
-    {
-        goto fail;
+        return NULL;
     }
-    /* Copy over all vars */
-    newitem->type = item->type & (~cJSON_IsReference);
-    newitem->valueint = item->valueint;
-    newitem->valuedouble = item->valuedouble;
-    if (item->valuestring)
+
+    return recurse ? duplicate_tree(item, NULL, allocator) : duplicate_node(item, false, allocator);
+}
+
+/* Count the nodes of the tree and the bytes its strings take in a flat block. */
+static cJSON_bool measure_flat(const cJSON * const item, size_t * const nodes, size_t * const bytes)
+{
+    walk_stack stack;
+    const cJSON *current = NULL;
+
+    walk_stack_init(&stack);
+    for (current = item; current != NULL; current = walk_next(&stack, current, NULL, true))
     {
-        newitem->valuestring = (char*)cJSON_strdup((unsigned char*)item->valuestring, &global_hooks);
-        if (!newitem->valuestring)
+        (*nodes)++;
+        if ((current->string != NULL) && !(current->type & cJSON_StringIsInterned))
         {
-            goto fail;
+            *bytes += flat_text_size(strlen(current->string));
         }
-    }
-    if (item->string)
-    {
-        newitem->string = (item->type&cJSON_StringIsConst) ? item->string : (char*)cJSON_strdup((unsigned char*)item->string, &global_hooks);
-        if (!newitem->string)
+        if (has_flat_text(current))
         {
-            goto fail;
+            *bytes += offsetof(flat_string, text) + flat_text_size(string_length(current));
         }
     }
-    /* If non-recursive, then we're done! */
-    if (!recurse)
-    {
-        return newitem;
-    }
-    /* Walk the ->next chain for the child. */
-    child = item->child;
-    while (child != NULL)
+    walk_stack_free(&stack);
+
+    return !stack.failed;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateFlat(const cJSON *item)
+{
+    return cJSON_DuplicateFlatWithAllocator(item, NULL);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateFlatWithAllocator(const cJSON *item, const cJSON_Allocator *allocator)
+{
+    size_t nodes = 0;
+    size_t bytes = 0;
+    flat_copy flat;
+
+    if (item == NULL)
     {
-        newchild = cJSON_Duplicate(child, true); /* Duplicate (with recurse) each item in the ->next chain */
-        if (!newchild)
-        {
-            goto fail;
-        }
-        if (next != NULL)
-        {
-            /* If newitem->child already set, then crosswire ->prev and ->next and move on */
-            next->next = newchild;
-            newchild->prev = next;
-            next = newchild;
-        }
-        else
-        {
-            /* Set newitem->child and move to it */
-            newitem->child = newchild;
-            next = newchild;
-        }
-        child = child->next;
+        return NULL;
     }
-    if (newitem && newitem->child)
+
+    /* size the tree first, the nodes and strings then fill one block */
+    if (!measure_flat(item, &nodes, &bytes))
     {
-        newitem->child->prev = newchild;
+        return NULL;
     }
-
-    return newitem;
-
-fail:
-    if (newitem != NULL)
+    flat.block = (flat_block*)allocate_with(allocator, offsetof(flat_block, nodes) + nodes * sizeof(flat_node) + bytes);
+    if (flat.block == NULL)
     {
-        cJSON_Delete(newitem);
+        return NULL;
     }
+    flat.block->references = 0;
+    flat.block->allocator = allocator;
+    flat.next_node = flat.block->nodes;
+    flat.next_text = (char*)flat.block->nodes + nodes * sizeof(flat_node);
 
-    return NULL;
+    /* on failure the block is freed together with the last node given back to it */
+    return duplicate_tree(item, &flat, allocator);
 }
 
 static void skip_oneline_comment(char **input)
@@ -2974,8 +5596,103 @@ CJSON_PUBLIC(cJSON_bool) cJSON_IsRaw(const cJSON * const item)
     return (item->type & 0xFF) == cJSON_Raw;
 }
 
-CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * const b, const cJSON_bool case_sensitive)
+/* Compare strings/numbers of which at least one is lazy, without decoding them in place. */
+static cJSON_bool compare_lazy(const cJSON * const a, const cJSON * const b)
+{
+    cJSON a_decoded;
+    cJSON b_decoded;
+    cJSON_bool equal = false;
+
+    /* the same text is the same value */
+    if ((a->type & b->type & cJSON_IsLazy) && (a->valueint == b->valueint)
+        && (memcmp(a->valuestring, b->valuestring, (size_t)a->valueint) == 0))
+    {
+        return true;
+    }
+
+    memset(&a_decoded, '\0', sizeof(a_decoded));
+    memset(&b_decoded, '\0', sizeof(b_decoded));
+    if (a->type & cJSON_IsLazy)
+    {
+        if (!decode_lazy(a, &a_decoded, NULL))
+        {
+            goto end;
+        }
+    }
+    else
+    {
+        memcpy(&a_decoded, a, sizeof(cJSON));
+    }
+    if (b->type & cJSON_IsLazy)
+    {
+        if (!decode_lazy(b, &b_decoded, NULL))
+        {
+            goto end;
+        }
+    }
+    else
+    {
+        memcpy(&b_decoded, b, sizeof(cJSON));
+    }
+
+    equal = cJSON_Compare(&a_decoded, &b_decoded, true);
+
+end:
+    /* only the decoded strings are owned here */
+    if ((a->type & cJSON_IsLazy) && (a_decoded.valuestring != NULL))
+    {
+        global_hooks.deallocate(a_decoded.valuestring);
+    }
+    if ((b->type & cJSON_IsLazy) && (b_decoded.valuestring != NULL))
+    {
+        global_hooks.deallocate(b_decoded.valuestring);
+    }
+
+    return equal;
+}
+
+/* Compare two arrays of which at least one is packed, element by element without unpacking. */
+static cJSON_bool compare_packed(const cJSON * const a, const cJSON * const b)
+{
+    const cJSON *a_element = a->child;
+    const cJSON *b_element = b->child;
+    cJSON a_number;
+    cJSON b_number;
+    int size = cJSON_GetArraySize(a);
+    int i = 0;
+
+    if (size != cJSON_GetArraySize(b))
+    {
+        return false;
+    }
+
+    for (i = 0; i < size; i++)
+    {
+        if (a->type & cJSON_IsPacked)
+        {
+            set_packed_number(&a_number, ((const double*)(const void*)a->valuestring)[i]);
+            a_element = &a_number;
+        }
+        if (b->type & cJSON_IsPacked)
+        {
+            set_packed_number(&b_number, ((const double*)(const void*)b->valuestring)[i]);
+            b_element = &b_number;
+        }
+        if ((a_element == NULL) || (b_element == NULL) || !cJSON_Compare(a_element, b_element, true))
+        {
+            return false;
+        }
+        a_element = (a->type & cJSON_IsPacked) ? NULL : a_element->next;
+        b_element = (b->type & cJSON_IsPacked) ? NULL : b_element->next;
+    }
+
+    return true;
+}
+
+/* Compare a and b without their children. walk is set when the children of a and b still have to be compared. */
+static cJSON_bool compare_values(const cJSON * const a, const cJSON * const b, cJSON_bool * const walk)
 {
+    *walk = false;
     if ((a == NULL) || (b == NULL) || ((a->type & 0xFF) != (b->type & 0xFF)))
     {
         return false;
@@ -3004,6 +5721,11 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
         return true;
     }
 
+    if ((a->type | b->type) & cJSON_IsLazy)
+    {
+        return compare_lazy(a, b);
+    }
+
     switch (a->type & 0xFF)
     {
         /* in these cases and equal type is enough */
@@ -3013,6 +5735,12 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
             return true;
 
         case cJSON_Number:
+            if (has_exact_integer(a) && has_exact_integer(b))
+            {
+                /* doubles can't tell large integers apart */
+                return (a->valueint64 == b->valueint64)
+                    && ((a->type & cJSON_NumberIsUInt64) == (b->type & cJSON_NumberIsUInt64));
+            }
             if (compare_double(a->valuedouble, b->valuedouble))
             {
                 return true;
@@ -3025,6 +5753,11 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
             {
                 return false;
             }
+            if (a->type & b->type & cJSON_StringHasLength)
+            {
+                /* strings of different length can't be equal */
+                return (a->valueint == b->valueint) && (memcmp(a->valuestring, b->valuestring, (size_t)a->valueint) == 0);
+            }
             if (strcmp(a->valuestring, b->valuestring) == 0)
             {
                 return true;
@@ -3033,70 +5766,117 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
             return false;
 
         case cJSON_Array:
-        {
-            cJSON *a_element = a->child;
-            cJSON *b_element = b->child;
-
-            for (; (a_element != NULL) && (b_element != NULL);)
+            if ((a->type | b->type) & cJSON_IsPacked)
             {
-                if (!cJSON_Compare(a_element, b_element, case_sensitive))
-                {
-                    return false;
-                }
-
-                a_element = a_element->next;
-                b_element = b_element->next;
+                return compare_packed(a, b);
             }
+            *walk = true;
+            return true;
+
+        case cJSON_Object:
+            *walk = true;
+            return true;
+
+        default:
+            return false;
+    }
+}
 
+/* The next pair of children of the array/object on top of the stack that has to be compared.
+ * Returns false when there is none, equal is cleared when the children already tell the two apart. */
+static cJSON_bool compare_next_pair(walk_frame * const frame, const cJSON ** const a, const cJSON ** const b, const cJSON_bool case_sensitive, cJSON_bool * const equal)
+{
+    if ((frame->item->type & 0xFF) == cJSON_Array)
+    {
+        if ((frame->element == NULL) || (frame->other_element == NULL))
+        {
             /* one of the arrays is longer than the other */
-            if (a_element != b_element) {
-                return false;
-            }
+            *equal = (frame->element == frame->other_element);
+            return false;
+        }
+        *a = frame->element;
+        *b = frame->other_element;
+        frame->element = frame->element->next;
+        frame->other_element = frame->other_element->next;
+        return true;
+    }
 
+    /* every member of a has to be in b, then every member of b in a so a can't be a subset of b */
+    if (frame->element != NULL)
+    {
+        *a = frame->element;
+        frame->element = frame->element->next;
+        *b = get_object_item(frame->other, (*a)->string, case_sensitive);
+        *equal = (*b != NULL);
+        return *equal;
+    }
+    while (frame->other_element != NULL)
+    {
+        *b = frame->other_element;
+        frame->other_element = frame->other_element->next;
+        *a = get_object_item(frame->item, (*b)->string, case_sensitive);
+        if (*a == NULL)
+        {
+            *equal = false;
+            return false;
+        }
+        /* the first member of b with a name was compared in the first pass already */
+        if (get_object_item(frame->other, (*b)->string, case_sensitive) != *b)
+        {
             return true;
         }
+    }
 
-        case cJSON_Object:
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * const b, const cJSON_bool case_sensitive)
+{
+    walk_stack stack;
+    walk_frame *frame = NULL;
+    const cJSON *a_element = a;
+    const cJSON *b_element = b;
+    cJSON_bool equal = true;
+    cJSON_bool walk = false;
+
+    /* the arrays/objects that are equal so far are kept on an explicit stack until all their children were compared */
+    walk_stack_init(&stack);
+    for (;;)
+    {
+        if (!compare_values(a_element, b_element, &walk))
+        {
+            equal = false;
+            break;
+        }
+        if (walk)
         {
-            cJSON *a_element = NULL;
-            cJSON *b_element = NULL;
-            cJSON_ArrayForEach(a_element, a)
+            frame = walk_stack_push(&stack, a_element);
+            if (frame == NULL)
             {
-                /* TODO This has O(n^2) runtime, which is horrible! */
-                b_element = get_object_item(b, a_element->string, case_sensitive);
-                if (b_element == NULL)
-                {
-                    return false;
-                }
-
-                if (!cJSON_Compare(a_element, b_element, case_sensitive))
-                {
-                    return false;
-                }
+                equal = false;
+                break;
             }
+            frame->other = b_element;
+            frame->element = a_element->child;
+            frame->other_element = b_element->child;
+        }
 
-            /* doing this twice, once on a and b to prevent true comparison if a subset of b
-             * TODO: Do this the proper way, this is just a fix for now */
-            cJSON_ArrayForEach(b_element, b)
+        while ((stack.size > 0) && !compare_next_pair(&stack.items[stack.size - 1], &a_element, &b_element, case_sensitive, &equal))
+        {
+            if (!equal)
             {
-                a_element = get_object_item(a, b_element->string, case_sensitive);
-                if (a_element == NULL)
-                {
-                    return false;
-                }
-
-                if (!cJSON_Compare(b_element, a_element, case_sensitive))
-                {
-                    return false;
-                }
+                break;
             }
-
-            return true;
+            stack.size--;
+        }
+        if (!equal || (stack.size == 0))
+        {
+            break;
         }
-
-        default:
-            return false;
     }
+    walk_stack_free(&stack);
+
+    return equal;
 }
 
 CJSON_PUBLIC(void *) cJSON_malloc(size_t size)
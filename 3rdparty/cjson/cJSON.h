@@ -98,6 +98,31 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_StringIsPooled 1024 /* string and valuestring were taken from a cJSON_Pool */
+#define cJSON_IsLazy 2048 /* string/number not decoded yet, see cJSON_ParseOptions.lazy */
+#define cJSON_NumberIsInt64 4096 /* valueint64 holds the exact number */
+#define cJSON_NumberIsUInt64 8192 /* valueint64 holds the bits of an exact number above the int64 range */
+#define cJSON_StringIsHashed 16384 /* stringhash holds cJSON_HashKey(string) */
+#define cJSON_StringIsInterned 32768 /* string belongs to a cJSON_KeyTable, always set together with cJSON_StringIsConst */
+#define cJSON_IsPacked 65536 /* array of numbers kept in one buffer instead of child nodes, see cJSON_PackArray */
+#define cJSON_IsIndexed 131072 /* valuestring holds a vector of pointers to the children, see cJSON_ReserveArray */
+#define cJSON_StringHasLength 262144 /* valueint holds strlen(valuestring), set by the cJSON functions that set strings */
+#define cJSON_StringIsInline 524288 /* valuestring points into the node itself, see cJSON_InlineString */
+#define cJSON_IsFlat 1048576 /* node lives in a block made by cJSON_DuplicateFlat, a key copied with it is marked cJSON_StringIsConst */
+#define cJSON_StringIsFlat 2097152 /* valuestring lives in a block made by cJSON_DuplicateFlat */
+#define cJSON_IsAllocated 4194304 /* node comes from a cJSON_Allocator, and so does everything it owns */
+
+/* Exact 64 bit integers, C89 has no standard type for them. */
+#if defined(_MSC_VER)
+typedef __int64 cJSON_int64;
+typedef unsigned __int64 cJSON_uint64;
+#elif defined(__GNUC__)
+__extension__ typedef long long cJSON_int64;
+__extension__ typedef unsigned long long cJSON_uint64;
+#else
+typedef long long cJSON_int64;
+typedef unsigned long long cJSON_uint64;
+#endif
 
 /* The cJSON structure: */
 typedef struct cJSON
@@ -120,8 +145,23 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+    /* The fields below were added after the ones above, which keep their places. */
+
+    /* The item's number without rounding, if type has cJSON_NumberIsInt64 or cJSON_NumberIsUInt64.
+     * Use cJSON_GetInt64Value/cJSON_GetUInt64Value to read it, it is ignored once valuedouble no longer matches. */
+    cJSON_int64 valueint64;
+    /* Hash of string, keys set by the cJSON functions are hashed so lookups can skip most siblings.
+     * Don't assign string directly without clearing cJSON_StringIsHashed. */
+    unsigned int stringhash;
 } cJSON;
 
+/* String values shorter than this are kept in the bytes of valueint64 of their own node
+ * (cJSON_StringIsInline) instead of being allocated. valuestring points at them, so they are read as usual.
+ * Code that copies a node by value has to point valuestring of the copy at its own cJSON_InlineString. */
+#define CJSON_INLINE_STRING_SIZE sizeof(cJSON_int64)
+#define cJSON_InlineString(item) ((char*)(item) + offsetof(cJSON, valueint64))
+
 typedef struct cJSON_Hooks
 {
       /* malloc/free are CDECL on Windows regardless of the default calling convention of the compiler, so ensure the hooks allow passing those functions directly. */
@@ -129,14 +169,98 @@ typedef struct cJSON_Hooks
       void (CJSON_CDECL *free_fn)(void *ptr);
 } cJSON_Hooks;
 
+/* Where the nodes and strings of a single tree are allocated instead of the global hooks, so trees in one process
+ * can use different allocators, e.g. one arena per request. See cJSON_ParseOptions.allocator,
+ * cJSON_DuplicateWithAllocator and cJSON_CreatePoolWithAllocator.
+ * Every node remembers its allocator, whatever is later allocated for a node (a new key or string, the index
+ * of an array...) comes from it too, and cJSON_Delete gives it back there. Nodes created by the other functions
+ * use the global hooks, both kinds can be mixed in one tree. The allocator has to outlive its nodes,
+ * memory it returns has to be aligned for any type. deallocate is never called with NULL. */
+typedef struct cJSON_Allocator
+{
+    void *(*allocate)(void *context, size_t size);
+    void (*deallocate)(void *context, void *pointer);
+    void *context;
+} cJSON_Allocator;
+
 typedef int cJSON_bool;
 
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
- * This is to prevent stack overflows. */
+ * This is the default of cJSON_ParseOptions.nesting_limit, see there before raising it. */
 #ifndef CJSON_NESTING_LIMIT
 #define CJSON_NESTING_LIMIT 1000
 #endif
 
+/* cJSON_GetArrayItem indexes an array instead of walking this many items, see cJSON_ReserveArray. */
+#ifndef CJSON_INDEX_THRESHOLD
+#define CJSON_INDEX_THRESHOLD 16
+#endif
+
+/* Nodes and string buffers kept from deleted trees, see cJSON_DeleteToPool. */
+typedef struct cJSON_Pool cJSON_Pool;
+/* Immutable copies of object keys shared by parsed trees, see cJSON_ParseOptions.keys. */
+typedef struct cJSON_KeyTable cJSON_KeyTable;
+
+/* Options for cJSON_ParseWithOptions. Use cJSON_InitParseOptions to set the defaults before changing single fields. */
+typedef struct cJSON_ParseOptions
+{
+    /* How deeply arrays/objects may be nested, defaults to CJSON_NESTING_LIMIT.
+     * The parser keeps the open arrays/objects on the heap, its stack use doesn't grow with the nesting.
+     * The same holds for cJSON_Delete, cJSON_Duplicate, cJSON_Compare, cJSON_Decode and printing, other code that
+     * recurses over the tree (including the caller's own) is what still bounds how far this can be raised. */
+    size_t nesting_limit;
+    /* Require the JSON to be null terminated, without appended garbage. */
+    cJSON_bool require_null_terminated;
+    /* If not NULL, nodes and strings of the parsed tree are taken from this pool before allocating new ones. */
+    cJSON_Pool *pool;
+    /* Keep strings and numbers undecoded (cJSON_IsLazy): valuestring points at their text in the parsed buffer
+     * and valueint holds its length. They are decoded by cJSON_GetStringValue/cJSON_GetNumberValue/cJSON_Decode,
+     * and printed by copying the text. The buffer has to outlive the tree (and its duplicates) until cJSON_Decode is called.
+     * Read lazy values through the functions above, not through valuestring/valuedouble.
+     * These functions decode a lazy value in place, so they change the tree even through a const cJSON*:
+     * threads that read a lazy tree at the same time have to call cJSON_Decode on it first. */
+    cJSON_bool lazy;
+    /* If not NULL, object keys point at the single copy of each distinct key in this table instead of being
+     * allocated per node (cJSON_StringIsConst | cJSON_StringIsInterned). The table has to outlive the tree
+     * (and its duplicates) until cJSON_Decode is called. */
+    cJSON_KeyTable *keys;
+    /* Pack arrays that only contain numbers (cJSON_IsPacked), see cJSON_PackArray. */
+    cJSON_bool pack;
+    /* If not NULL, the parsed tree is allocated from it. Ignored when pool is set, the pool then decides
+     * (see cJSON_CreatePoolWithAllocator). */
+    const cJSON_Allocator *allocator;
+} cJSON_ParseOptions;
+
+/* Why a parse failed, reported in cJSON_ParseResult. */
+typedef enum
+{
+    cJSON_ParseErrorNone = 0,
+    cJSON_ParseErrorIllegalValue,
+    cJSON_ParseErrorIllegalNumber,
+    cJSON_ParseErrorUnterminatedString,
+    cJSON_ParseErrorIllegalEscapeSequence,
+    cJSON_ParseErrorMissingName,
+    cJSON_ParseErrorMissingNameSeparator,
+    cJSON_ParseErrorMissingValueSeparator,
+    cJSON_ParseErrorUnterminatedArray,
+    cJSON_ParseErrorUnterminatedObject,
+    cJSON_ParseErrorDeepNesting,
+    cJSON_ParseErrorGarbageAtEnd,
+    cJSON_ParseErrorAllocationFailure
+} cJSON_ParseError;
+
+/* Outcome of a single cJSON_ParseWithOptions call. Unlike cJSON_GetErrorPtr this is not shared between calls,
+ * so parses on different threads don't interfere with each other. */
+typedef struct cJSON_ParseResult
+{
+    cJSON_ParseError error;
+    /* Offset of the first byte after the parsed value, or where parsing failed. */
+    size_t offset;
+    /* Line and column (both starting at 1, column counted in bytes) of offset, only set when parsing failed. */
+    size_t line;
+    size_t column;
+} cJSON_ParseResult;
+
 /* returns the version of cJSON as a string */
 CJSON_PUBLIC(const char*) cJSON_Version(void);
 
@@ -151,6 +275,14 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Fill options with the defaults used by cJSON_Parse. */
+CJSON_PUBLIC(void) cJSON_InitParseOptions(cJSON_ParseOptions *options);
+/* Parse with explicit options, options may be NULL to use the defaults.
+ * If result isn't NULL it receives the error and its position. This doesn't touch any global state,
+ * in particular cJSON_GetErrorPtr isn't updated. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOptions(const char *value, size_t buffer_length, const cJSON_ParseOptions *options, cJSON_ParseResult *result);
+/* Human readable description of a parse error. */
+CJSON_PUBLIC(const char *) cJSON_GetParseErrorString(cJSON_ParseError parse_error);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -163,21 +295,80 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
 /* Delete a cJSON entity and all subentities. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item);
+/* Delete at most count items of item, its siblings and their children, so big trees can be freed in
+ * bounded steps. Returns the items that are still to be deleted, to be passed to the next call, or NULL
+ * once everything is deleted. Trees to delete can be collected into one list by linking them through next. */
+CJSON_PUBLIC(cJSON *) cJSON_DeleteSlice(cJSON *item, size_t count);
+/* A pool keeps the nodes and strings of deleted trees, so parsing documents of a similar shape again
+ * (with cJSON_ParseOptions.pool) allocates almost nothing. A pool is not thread safe.
+ * Nodes and strings in the pool are ordinary allocations, a tree parsed with a pool can be deleted with cJSON_Delete. */
+CJSON_PUBLIC(cJSON_Pool *) cJSON_CreatePool(void);
+/* A pool whose nodes and strings, and the pool itself, come from allocator. Only nodes from the same allocator are
+ * kept by cJSON_DeleteToPool, others are freed. */
+CJSON_PUBLIC(cJSON_Pool *) cJSON_CreatePoolWithAllocator(const cJSON_Allocator *allocator);
+/* Free the pool and everything it keeps. */
+CJSON_PUBLIC(void) cJSON_DeletePool(cJSON_Pool *pool);
+/* Like cJSON_Delete, but keep the nodes and strings in pool. With a NULL pool this is cJSON_Delete. */
+CJSON_PUBLIC(void) cJSON_DeleteToPool(cJSON_Pool *pool, cJSON *item);
+
+/* Create a key table. lock/unlock may be NULL, pass them (with context) to use the table from several threads at once. */
+CJSON_PUBLIC(cJSON_KeyTable *) cJSON_CreateKeyTable(void (*lock)(void *context), void (*unlock)(void *context), void *context);
+/* Free the table and all of its keys. */
+CJSON_PUBLIC(void) cJSON_DeleteKeyTable(cJSON_KeyTable *table);
+/* Returns the copy of the first length bytes of string in table, adding it if needed. NULL if out of memory. */
+CJSON_PUBLIC(const char *) cJSON_InternKey(cJSON_KeyTable *table, const char *string, size_t length);
+/* Number of distinct keys in table. */
+CJSON_PUBLIC(size_t) cJSON_GetKeyTableSize(cJSON_KeyTable *table);
 
 /* Returns the number of items in an array (or object). */
 CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array);
-/* Retrieve item number "index" from array "array". Returns NULL if unsuccessful. */
+/* Retrieve item number "index" from array "array". Returns NULL if unsuccessful.
+ * If this has to walk past CJSON_INDEX_THRESHOLD items, the array is indexed (cJSON_IsIndexed) first. */
 CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index);
+
+/* Children of an array (or object) stay a linked list, an indexed array additionally keeps a vector of pointers
+ * to them in valuestring. cJSON_GetArraySize and cJSON_GetArrayItem are O(1) then, and the cJSON functions that
+ * add, insert, replace or detach items keep the vector up to date. Don't link children of an indexed array by hand.
+ * Index array with room for capacity items, so appending that many doesn't reallocate. Returns false on allocation failure. */
+CJSON_PUBLIC(cJSON_bool) cJSON_ReserveArray(cJSON *array, int capacity);
+/* Free the unused room of the index of array. */
+CJSON_PUBLIC(void) cJSON_ShrinkArray(cJSON *array);
 /* Get item "string" from object. Case insensitive. */
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItem(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const object, const char * const string);
+/* Same as above, but the key is given by pointer and length and doesn't have to be zero terminated. */
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemWithLength(const cJSON * const object, const char * const string, size_t length);
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitiveWithLength(const cJSON * const object, const char * const string, size_t length);
+/* Hash of a key as stored in cJSON::stringhash, keys that are equal ignoring case have the same hash.
+ * Computing it once and passing it to the WithHash lookups makes repeated lookups of the same key cheaper. */
+CJSON_PUBLIC(unsigned int) cJSON_HashKey(const char *string, size_t length);
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemWithHash(const cJSON * const object, const char * const string, size_t length, unsigned int hash);
+CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitiveWithHash(const cJSON * const object, const char * const string, size_t length, unsigned int hash);
+/* A key for cJSON_GetObjectItems, hash must be cJSON_HashKey(string, length). */
+typedef struct cJSON_Key
+{
+    const char *string;
+    size_t length;
+    unsigned int hash;
+} cJSON_Key;
+/* Looks up count keys with a single walk over the children of object. items[i] is set to the first child named
+ * keys[i].string, or NULL if there is none. Returns the number of keys that were found. */
+CJSON_PUBLIC(size_t) cJSON_GetObjectItems(const cJSON * const object, const cJSON_Key *keys, size_t count, cJSON **items, cJSON_bool case_sensitive);
 CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *string);
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void);
 
-/* Check item type and return its value */
+/* Check item type and return its value. Lazy values are decoded in place, which is not thread safe. */
 CJSON_PUBLIC(char *) cJSON_GetStringValue(const cJSON * const item);
+/* strlen of the value of a string item without scanning it if the length is stored, 0 if item is no string. */
+CJSON_PUBLIC(size_t) cJSON_GetStringLength(const cJSON * const item);
 CJSON_PUBLIC(double) cJSON_GetNumberValue(const cJSON * const item);
+/* The exact integer if the number has one, otherwise valuedouble truncated. Both saturate, non-numbers return 0. */
+CJSON_PUBLIC(cJSON_int64) cJSON_GetInt64Value(const cJSON * const item);
+CJSON_PUBLIC(cJSON_uint64) cJSON_GetUInt64Value(const cJSON * const item);
+/* Decode all lazy values of item and its children and copy their interned keys, afterwards the tree no longer
+ * refers to the parsed buffer or to a key table. Returns false if a value could not be decoded, it stays lazy then. */
+CJSON_PUBLIC(cJSON_bool) cJSON_Decode(cJSON *item);
 
 /* These functions check the type of an item */
 CJSON_PUBLIC(cJSON_bool) cJSON_IsInvalid(const cJSON * const item);
@@ -197,7 +388,12 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateTrue(void);
 CJSON_PUBLIC(cJSON *) cJSON_CreateFalse(void);
 CJSON_PUBLIC(cJSON *) cJSON_CreateBool(cJSON_bool boolean);
 CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num);
+/* numbers that keep their exact integer value */
+CJSON_PUBLIC(cJSON *) cJSON_CreateInt64(cJSON_int64 num);
+CJSON_PUBLIC(cJSON *) cJSON_CreateUInt64(cJSON_uint64 num);
 CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string);
+/* Copies "length" bytes of string, string doesn't have to be zero terminated. */
+CJSON_PUBLIC(cJSON *) cJSON_CreateStringWithLength(const char *string, size_t length);
 /* raw json */
 CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw);
 CJSON_PUBLIC(cJSON *) cJSON_CreateArray(void);
@@ -217,6 +413,19 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateIntArray(const int *numbers, int count);
 CJSON_PUBLIC(cJSON *) cJSON_CreateFloatArray(const float *numbers, int count);
 CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count);
 CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count);
+/* Create a packed array (cJSON_IsPacked) holding a copy of count doubles. */
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedDoubleArray(const double *numbers, int count);
+
+/* A packed array keeps its numbers in one buffer of doubles (valuestring) and their count in valueint, it has no
+ * child nodes. cJSON_GetArraySize, printing, comparing and duplicating work on the buffer. cJSON_GetArrayItem and
+ * every change of the array unpack it into child nodes first, walk child/cJSON_ArrayForEach only after cJSON_UnpackArray.
+ * Pack an array whose items are all numbers that are exact as double (integers up to 2^53). Returns false and
+ * leaves the array unchanged otherwise. */
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArray(cJSON *array);
+/* Create the child nodes of a packed array again. Returns false on allocation failure, the array stays packed then. */
+CJSON_PUBLIC(cJSON_bool) cJSON_UnpackArray(cJSON *array);
+/* The numbers of a packed array, NULL if array isn't packed or empty. */
+CJSON_PUBLIC(const double *) cJSON_GetPackedArrayData(const cJSON *array);
 
 /* Append item to the specified array/object. */
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToArray(cJSON *array, cJSON *item);
@@ -225,7 +434,11 @@ CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObject(cJSON *object, const char *string
  * WARNING: When this function was used, make sure to always check that (item->type & cJSON_StringIsConst) is zero before
  * writing to `item->string` */
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectCS(cJSON *object, const char *string, cJSON *item);
-/* Append reference to item to the specified array/object. Use this when you want to add an existing cJSON to a new cJSON, but don't want to corrupt your existing cJSON. */
+/* Same as cJSON_AddItemToObject, the key is given by pointer and length and doesn't have to be zero terminated. */
+CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectWithLength(cJSON *object, const char *string, size_t length, cJSON *item);
+/* Append reference to item to the specified array/object. Use this when you want to add an existing cJSON to a new cJSON, but don't want to corrupt your existing cJSON.
+ * A packed array (see cJSON_PackArray) is added as a copy of its numbers instead, and a lazy value as a copy that is
+ * decoded on its own; later changes of item don't show in them. */
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item);
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemReferenceToObject(cJSON *object, const char *string, cJSON *item);
 
@@ -250,6 +463,13 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse);
 /* Duplicate will create a new, identical cJSON item to the one you pass, in new memory that will
  * need to be released. With recurse!=0, it will duplicate any children connected to the item.
  * The item->next and ->prev pointers are always zero on return from Duplicate. */
+/* Recursive duplicate that places all nodes and strings of the copy in one allocation. The copy is used
+ * and changed like any other tree; the block is freed when the last node or string placed in it is deleted,
+ * so items detached from the copy stay valid. */
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateFlat(const cJSON *item);
+/* The same, but the copy is allocated from allocator (NULL for the global hooks). */
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateWithAllocator(const cJSON *item, cJSON_bool recurse, const cJSON_Allocator *allocator);
+CJSON_PUBLIC(cJSON *) cJSON_DuplicateFlatWithAllocator(const cJSON *item, const cJSON_Allocator *allocator);
 /* Recursively compare two cJSON items for equality. If either a or b is NULL or invalid, they will be considered unequal.
  * case_sensitive determines if object keys are treated case sensitive (1) or case insensitive (0) */
 CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * const b, const cJSON_bool case_sensitive);
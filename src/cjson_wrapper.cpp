@@ -1,82 +1,173 @@
 #include "cjson_wrapper.h"
 
 #include <utility>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+
+// 把 source 的值移到 target 节点中再释放 source，target 的 key 和在链表中的位置都不变，
+// 指向 target 的迭代器和 JsonValueRef 仍然有效。cJSON_IsFlat 和 cJSON_IsAllocated 说明的是节点本身的内存，和 key 一样留在原节点
+static void moveValue(struct cJSON *target, struct cJSON *source)
+{
+    const int keyFlags = cJSON_StringIsConst | cJSON_StringIsHashed | cJSON_StringIsInterned | cJSON_IsFlat | cJSON_IsAllocated;
+    const int targetType = target->type;
+    std::swap(target->child, source->child);
+    std::swap(target->valuestring, source->valuestring);
+    std::swap(target->valueint, source->valueint);
+    std::swap(target->valuedouble, source->valuedouble);
+    std::swap(target->valueint64, source->valueint64);
+    target->type = (source->type & ~keyFlags) | (targetType & keyFlags);
+    source->type = (targetType & ~keyFlags) | (source->type & keyFlags);
+    // 内联的短字符串随 valueint64 一起换过来了，valuestring 要指回各自节点
+    if (target->type & cJSON_StringIsInline) {
+        target->valuestring = cJSON_InlineString(target);
+    }
+    if (source->type & cJSON_StringIsInline) {
+        source->valuestring = cJSON_InlineString(source);
+    }
+    cJSON_Delete(source);
+}
+
+// 定义了 CJSON_WRAPPER_CASE_SENSITIVE 时区分大小写，所有按 key 查找、插入和删除的地方都通过这里查找
+static struct cJSON *findKey(const struct cJSON *object, const JsonKey &key)
+{
+#ifdef CJSON_WRAPPER_CASE_SENSITIVE
+    return cJSON_GetObjectItemCaseSensitiveWithHash(object, key.data(), key.size(), key.hash());
+#else
+    return cJSON_GetObjectItemWithHash(object, key.data(), key.size(), key.hash());
+#endif
+}
 
 //------------------[JsonValue] BEGIN---------------------
 
 JsonValue::JsonValue()
-    : item_(cJSON_CreateNull())
+    : item_(nullptr)
+    , type_(cJSON_NULL)
+    , scalar_()
 {
-    assert(item_ != nullptr);
+
 }
 
 JsonValue::JsonValue(double val)
-    : item_(cJSON_CreateNumber(val))
+    : item_(nullptr)
+    , type_(cJSON_Number)
+    , scalar_()
 {
-    assert(item_ != nullptr);
+    scalar_.number.value = val;
+    scalar_.number.integer = 0;
 }
 
 JsonValue::JsonValue(int32_t val)
-    : JsonValue(static_cast<double>(val))
+    : JsonValue(static_cast<int64_t>(val))
 {
 
 }
 
 JsonValue::JsonValue(int64_t val)
-    : JsonValue(static_cast<double>(val))
+    : item_(nullptr)
+    , type_(cJSON_Number | cJSON_NumberIsInt64)
+    , scalar_()
 {
+    scalar_.number.value = static_cast<double>(val);
+    scalar_.number.integer = val;
+}
 
+JsonValue::JsonValue(uint64_t val)
+    : item_(nullptr)
+    , type_(cJSON_Number | (val > static_cast<uint64_t>(INT64_MAX) ? cJSON_NumberIsUInt64 : cJSON_NumberIsInt64))
+    , scalar_()
+{
+    scalar_.number.value = static_cast<double>(val);
+    scalar_.number.integer = static_cast<int64_t>(val);
 }
 
 JsonValue::JsonValue(const char *val)
-    : JsonValue(std::string(val))
+    : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
 {
-
+    setString(val, strlen(val));
 }
 
 JsonValue::JsonValue(bool val)
-    : item_(cJSON_CreateBool(val))
+    : item_(nullptr)
+    , type_(val ? cJSON_True : cJSON_False)
+    , scalar_()
 {
-    assert(item_ != nullptr);
+
 }
 
 JsonValue::JsonValue(const std::string &val)
-    : item_(cJSON_CreateString(val.c_str()))
+    : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
 {
-    assert(item_ != nullptr);
+    // 和 cJSON_CreateString 一样，只保存第一个'\0'之前的内容
+    setString(val.c_str(), strlen(val.c_str()));
 }
 
 JsonValue::JsonValue(const JsonObject &val)
     : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
 {
-    item_ = cJSON_Duplicate(val.item_, 1);
+    item_ = cJSON_DuplicateFlat(val.item_);
     assert(item_ != nullptr);
 }
 
 JsonValue::JsonValue(const JsonArray &val)
     : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
 {
-    item_ = cJSON_Duplicate(val.item_, 1);
+    item_ = cJSON_DuplicateFlat(val.item_);
     assert(item_ != nullptr);
 }
 
+JsonValue::JsonValue(JsonObject &&val)
+    : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
+{
+    assert(cJSON_IsObject(val.item_));
+    std::swap(item_, val.item_);
+}
+
+JsonValue::JsonValue(JsonArray &&val)
+    : item_(nullptr)
+    , type_(cJSON_Invalid)
+    , scalar_()
+{
+    assert(cJSON_IsArray(val.item_));
+    std::swap(item_, val.item_);
+}
+
 JsonValue::JsonValue(const JsonValue &other)
     : item_(nullptr)
+    , type_(other.type_)
+    , scalar_(other.scalar_)
 {
     if (other.item_) {
-        item_ = cJSON_Duplicate(other.item_, 1);
+        item_ = cJSON_DuplicateFlat(other.item_);
         assert(item_ != nullptr);
     }
 }
 
 JsonValue::JsonValue(JsonValue &&other)
     : item_(nullptr)
+    , type_(other.type_)
+    , scalar_(other.scalar_)
 {
     std::swap(item_, other.item_);
 }
 
 JsonValue::JsonValue(struct cJSON *item)
     : item_(item)
+    , type_(cJSON_Invalid)
+    , scalar_()
 {
 
 }
@@ -88,12 +179,126 @@ JsonValue::~JsonValue()
     }
 }
 
+void JsonValue::setString(const char *val, size_t length)
+{
+    assert(item_ == nullptr);
+    if (length <= MaxShortStringLength) {
+        memcpy(scalar_.string, val, length);
+        scalar_.string[length] = '\0';
+        type_ = cJSON_String;
+    } else {
+        item_ = cJSON_CreateStringWithLength(val, length);
+        assert(item_ != nullptr);
+    }
+}
+
+JsonValue JsonValue::copyOf(const struct cJSON *item)
+{
+    if (!item) {
+        return JsonValue(static_cast<struct cJSON*>(nullptr)); // 返回一个非法值
+    }
+
+    if (!(item->type & cJSON_IsLazy)) {
+        switch (item->type & 0xFF) {
+        case cJSON_NULL:
+            return JsonValue();
+        case cJSON_True:
+        case cJSON_False:
+            return JsonValue(cJSON_IsTrue(item) != 0);
+        case cJSON_Number:
+            // valueint64 和 valuedouble 不一致时以 valuedouble 为准，和 cJSON 的处理一致
+            if ((item->type & cJSON_NumberIsInt64) && static_cast<double>(item->valueint64) == item->valuedouble) {
+                return JsonValue(static_cast<int64_t>(item->valueint64));
+            } else if ((item->type & cJSON_NumberIsUInt64)
+                       && static_cast<double>(static_cast<uint64_t>(item->valueint64)) == item->valuedouble) {
+                return JsonValue(static_cast<uint64_t>(item->valueint64));
+            }
+            return JsonValue(item->valuedouble);
+        case cJSON_String:
+            if (item->valuestring && cJSON_GetStringLength(item) <= MaxShortStringLength) {
+                JsonValue value;
+                value.setString(item->valuestring, cJSON_GetStringLength(item));
+                return value;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 复制出来的值不能再引用 JsonDocument 的原文，解码失败时返回非法值
+    struct cJSON *newItem = cJSON_DuplicateFlat(item);
+    assert(newItem != nullptr);
+    if (!cJSON_Decode(newItem)) {
+        cJSON_Delete(newItem);
+        return JsonValue(static_cast<struct cJSON*>(nullptr));
+    }
+    return JsonValue(newItem);
+}
+
+const struct cJSON *JsonValue::constItem(struct cJSON &view) const
+{
+    if (item_) {
+        return item_;
+    }
+
+    memset(&view, 0, sizeof(view));
+    view.type = type_;
+    if ((type_ & 0xFF) == cJSON_Number) {
+        double number = scalar_.number.value;
+        view.valuedouble = number;
+        view.valueint64 = scalar_.number.integer;
+        // 和 cJSON 一样，超出范围时取边界值
+        view.valueint = number >= INT_MAX ? INT_MAX : (number <= static_cast<double>(INT_MIN) ? INT_MIN : static_cast<int>(number));
+    } else if ((type_ & 0xFF) == cJSON_String) {
+        view.valuestring = const_cast<char*>(scalar_.string);
+    } else if ((type_ & 0xFF) == cJSON_True) {
+        view.valueint = 1;
+    }
+    return &view;
+}
+
+struct cJSON *JsonValue::createItem() const
+{
+    if (item_) {
+        return cJSON_DuplicateFlat(item_);
+    }
+
+    switch (type_ & 0xFF) {
+    case cJSON_NULL:
+        return cJSON_CreateNull();
+    case cJSON_True:
+        return cJSON_CreateTrue();
+    case cJSON_False:
+        return cJSON_CreateFalse();
+    case cJSON_Number:
+        if (type_ & cJSON_NumberIsInt64) {
+            return cJSON_CreateInt64(scalar_.number.integer);
+        } else if (type_ & cJSON_NumberIsUInt64) {
+            return cJSON_CreateUInt64(static_cast<uint64_t>(scalar_.number.integer));
+        }
+        return cJSON_CreateNumber(scalar_.number.value);
+    case cJSON_String:
+        return cJSON_CreateString(scalar_.string);
+    default:
+        return nullptr;
+    }
+}
+
+struct cJSON *JsonValue::takeItem()
+{
+    struct cJSON *item = item_ ? item_ : createItem();
+    item_ = nullptr;
+    type_ = cJSON_Invalid;
+    return item;
+}
+
 bool JsonValue::toBool(bool defaultValue) const
 {
     if (!isBool()) {
         return defaultValue;
     }
-    return item_->type == cJSON_True;
+    return valueType() == cJSON_True;
 }
 
 double JsonValue::toNumber(double defaultValue) const
@@ -101,7 +306,7 @@ double JsonValue::toNumber(double defaultValue) const
     if (!isNumber()) {
         return defaultValue;
     }
-    return item_->valuedouble;
+    return item_ ? item_->valuedouble : scalar_.number.value;
 }
 
 int32_t JsonValue::toInt(int32_t defaultValue) const
@@ -109,7 +314,26 @@ int32_t JsonValue::toInt(int32_t defaultValue) const
     if (!isNumber()) {
         return defaultValue;
     }
-    return item_->valueint;
+    struct cJSON view;
+    return constItem(view)->valueint;
+}
+
+int64_t JsonValue::toInt64(int64_t defaultValue) const
+{
+    if (!isNumber()) {
+        return defaultValue;
+    }
+    struct cJSON view;
+    return cJSON_GetInt64Value(constItem(view));
+}
+
+uint64_t JsonValue::toUInt64(uint64_t defaultValue) const
+{
+    if (!isNumber()) {
+        return defaultValue;
+    }
+    struct cJSON view;
+    return cJSON_GetUInt64Value(constItem(view));
 }
 
 std::string JsonValue::toString() const
@@ -118,9 +342,13 @@ std::string JsonValue::toString() const
         return std::string();
     }
 
+    if (!item_) {
+        return scalar_.string;
+    }
     const char *str = cJSON_GetStringValue(item_);
     assert(str != nullptr);
-    return str;
+    // 长度保存在节点中，不需要再 strlen
+    return std::string(str, cJSON_GetStringLength(item_));
 }
 
 std::string JsonValue::toString(const std::string &defaultValue) const
@@ -129,9 +357,7 @@ std::string JsonValue::toString(const std::string &defaultValue) const
         return defaultValue;
     }
 
-    const char *str = cJSON_GetStringValue(item_);
-    assert(str != nullptr);
-    return str;
+    return toString();
 }
 
 JsonArray JsonValue::toArray() const
@@ -140,7 +366,7 @@ JsonArray JsonValue::toArray() const
         return JsonArray(); //空的数组
     }
 
-    return JsonArray(cJSON_Duplicate(item_, 1));
+    return JsonArray(cJSON_DuplicateFlat(item_));
 }
 
 JsonArray JsonValue::toArray(const JsonArray &defaultValue) const
@@ -149,7 +375,7 @@ JsonArray JsonValue::toArray(const JsonArray &defaultValue) const
         return defaultValue;
     }
 
-    return JsonArray(cJSON_Duplicate(item_, 1));
+    return JsonArray(cJSON_DuplicateFlat(item_));
 }
 
 JsonObject JsonValue::toObject() const
@@ -158,7 +384,7 @@ JsonObject JsonValue::toObject() const
         return JsonObject(); //空的对象
     }
 
-    return JsonObject(cJSON_Duplicate(item_, 1));
+    return JsonObject(cJSON_DuplicateFlat(item_));
 }
 
 JsonObject JsonValue::toObject(const JsonObject &defaultValue) const
@@ -167,7 +393,7 @@ JsonObject JsonValue::toObject(const JsonObject &defaultValue) const
         return defaultValue;
     }
 
-    return JsonObject(cJSON_Duplicate(item_, 1));
+    return JsonObject(cJSON_DuplicateFlat(item_));
 }
 
 bool JsonValue::operator == (const JsonValue &other) const
@@ -175,8 +401,11 @@ bool JsonValue::operator == (const JsonValue &other) const
     if (this == &other) {
         return true;
     }
-    assert(item_ != other.item_); //按照JsonValue的处理逻辑，这里不应该出现相等指针的情况
-    return cJSON_Compare(item_, other.item_, 1);
+    //按照JsonValue的处理逻辑，这里不应该出现相等指针的情况
+    assert(item_ == nullptr || item_ != other.item_);
+    struct cJSON view;
+    struct cJSON otherView;
+    return cJSON_Compare(constItem(view), other.constItem(otherView), 1);
 }
 
 JsonValue &JsonValue::operator = (const JsonValue &other)
@@ -184,9 +413,11 @@ JsonValue &JsonValue::operator = (const JsonValue &other)
     if (this == &other) {
         return *this;
     }
-    assert(other.item_ != nullptr);
+    assert(!other.isUndefined());
     cJSON_Delete(item_);
-    item_ = cJSON_Duplicate(other.item_, 1);
+    item_ = other.item_ ? cJSON_DuplicateFlat(other.item_) : nullptr;
+    type_ = other.type_;
+    scalar_ = other.scalar_;
     return *this;
 }
 
@@ -197,6 +428,8 @@ JsonValue &JsonValue::operator = (JsonValue &&other)
     }
 
     std::swap(item_, other.item_);
+    std::swap(type_, other.type_);
+    std::swap(scalar_, other.scalar_);
     return *this;
 }
 
@@ -211,15 +444,7 @@ JsonValueRef &JsonValueRef::operator = (const JsonValue &other)
         return *this;
     }
 
-    struct cJSON *newItem = cJSON_Duplicate(other.item_, 1);
-    if (cJSON_IsObject(parentItem_)) {
-        std::swap(item_->string, newItem->string);
-    }
-    // 内部会释放item_ 的资源
-    bool ret = cJSON_ReplaceItemViaPointer(parentItem_, item_, newItem);
-    assert(ret);
-    (void)ret;
-    item_ = newItem;
+    moveValue(item_, other.createItem());
     return *this;
 }
 
@@ -230,15 +455,7 @@ JsonValueRef &JsonValueRef::operator = (JsonValue &&other)
         return *this;
     }
 
-    if (cJSON_IsObject(parentItem_)) {
-        std::swap(item_->string, other.item_->string);
-    }
-    // 内部会释放item_ 的资源
-    bool ret = cJSON_ReplaceItemViaPointer(parentItem_, item_, other.item_);
-    assert(ret);
-    (void)ret;
-    item_ = other.item_;
-    other.item_ = nullptr;
+    moveValue(item_, other.takeItem());
     return *this;
 }
 
@@ -258,7 +475,7 @@ JsonArray JsonValueRef::toArray() const
         return JsonArray();
     }
 
-    cJSON *newItem = cJSON_Duplicate(item_, 1);
+    cJSON *newItem = cJSON_DuplicateFlat(item_);
     assert(newItem != nullptr);
     return JsonArray(newItem);
 }
@@ -269,12 +486,12 @@ JsonObject JsonValueRef::toObject() const
         return JsonObject();
     }
 
-    cJSON *newItem = cJSON_Duplicate(item_, 1);
+    cJSON *newItem = cJSON_DuplicateFlat(item_);
     assert(newItem != nullptr);
     return JsonObject(newItem);
 }
 
-JsonValueRef &JsonValueRef::operator [] (const std::string &key)
+JsonValueRef &JsonValueRef::operator [] (const JsonKey &key)
 {
     assert(parentItem_ != nullptr && item_ != nullptr);
     assert(parentItem_ != item_);
@@ -282,17 +499,17 @@ JsonValueRef &JsonValueRef::operator [] (const std::string &key)
         operator = (JsonObject());
         assert(cJSON_IsObject(item_));
     }
-    cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
+    cJSON *curItem = findKey(item_, key);
     if (!curItem) {
         curItem = cJSON_CreateNull();
-        cJSON_AddItemToObject(item_, key.c_str(), curItem);
+        cJSON_AddItemToObjectWithLength(item_, key.data(), key.size(), curItem);
     }
     parentItem_ = item_;
     item_ = curItem;
     return *this;
 }
 
-const JsonValueRef &JsonValueRef::operator [] (const std::string &key) const
+const JsonValueRef &JsonValueRef::operator [] (const JsonKey &key) const
 {
     assert(parentItem_ != nullptr && item_ != nullptr);
     assert(parentItem_ != item_);
@@ -301,7 +518,7 @@ const JsonValueRef &JsonValueRef::operator [] (const std::string &key) const
         return *this;
     }
 
-    cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
+    cJSON *curItem = findKey(item_, key);
     if (!curItem) {
         assert(false);
         return *this;
@@ -428,21 +645,25 @@ bool JsonValueRef::contains(const JsonValue &val) const
     return ret;
 }
 
-bool JsonValueRef::contains(const std::string &key) const
+bool JsonValueRef::contains(const JsonKey &key) const
 {
     assert(cJSON_IsObject(item_));
-    JsonObject object(item_);
-    bool ret = object.contains(key);
-    object.item_ = nullptr;
-    return ret;
+    return findKey(item_, key) != nullptr;
 }
 
 JsonValue JsonValueRef::toValue() const
 {
     assert(item_ != nullptr);
-    cJSON *newItem = cJSON_Duplicate(item_, 1);
-    assert(newItem != nullptr);
-    return JsonValue(newItem);
+    return JsonValue::copyOf(item_);
+}
+
+std::string JsonValueRef::toString() const
+{
+    const char *str = cJSON_GetStringValue(item_);
+    if (str == nullptr) {
+        return std::string();
+    }
+    return std::string(str, cJSON_GetStringLength(item_));
 }
 
 //------------------[JsonValueRef] END---------------------
@@ -459,7 +680,7 @@ JsonArray::JsonArray(const JsonArray &val)
     : item_(nullptr)
 {
     assert(cJSON_IsArray(val.item_));
-    item_ = cJSON_Duplicate(val.item_, 1);
+    item_ = cJSON_DuplicateFlat(val.item_);
     assert(item_ != nullptr);
 }
 
@@ -491,17 +712,25 @@ JsonArray::~JsonArray()
     }
 }
 
+JsonArray JsonArray::fromDoubles(const double *values, int count)
+{
+    struct cJSON *item = cJSON_CreatePackedDoubleArray(values, count);
+    assert(item != nullptr);
+    return JsonArray(item);
+}
+
 void JsonArray::append(const JsonValue &val)
 {
-    struct cJSON *tmpItem = cJSON_Duplicate(val.item_, 1);
+    struct cJSON *tmpItem = val.createItem();
     assert(tmpItem != nullptr);
     cJSON_AddItemToArray(item_, tmpItem);
 }
 
 void JsonArray::append(JsonValue &&val)
 {
-    cJSON_AddItemToArray(item_, val.item_);
-    val.item_ = nullptr;
+    struct cJSON *tmpItem = val.takeItem();
+    assert(tmpItem != nullptr);
+    cJSON_AddItemToArray(item_, tmpItem);
 }
 
 JsonValue JsonArray::at(int index) const
@@ -509,12 +738,15 @@ JsonValue JsonArray::at(int index) const
     if (index >= size()) {
         return JsonValue(static_cast<struct cJSON*>(nullptr)); //返回一个非法的 JsonValue
     }
+    const double *numbers = cJSON_GetPackedArrayData(item_);
+    if (numbers != nullptr) {
+        assert(index >= 0);
+        return JsonValue(numbers[index]);
+    }
     struct cJSON *item = cJSON_GetArrayItem(item_, index);
     assert(item != nullptr);
     // 这里需要把item复制一份，不能直接使用item指针，否则会出现重复释放内存的错误
-    struct cJSON *tmpItem = cJSON_Duplicate(item, 1);
-    assert(tmpItem != nullptr);
-    return JsonValue(tmpItem);
+    return JsonValue::copyOf(item);
 }
 
 bool JsonArray::contains(const JsonValue &val) const
@@ -535,11 +767,7 @@ JsonValue JsonArray::last() const
         return JsonValue(static_cast<struct cJSON*>(nullptr)); // 返回一个非法值
     }
     assert(arryLength > 0);
-    struct cJSON *curItem = cJSON_GetArrayItem(item_, arryLength - 1);
-    assert(curItem != nullptr);
-    struct cJSON *newItem = cJSON_Duplicate(curItem, 1);
-    assert(newItem != nullptr);
-    return JsonValue(newItem);
+    return at(arryLength - 1);
 }
 
 JsonValue JsonArray::first() const
@@ -549,11 +777,7 @@ JsonValue JsonArray::first() const
         return JsonValue(static_cast<struct cJSON*>(nullptr)); // 返回一个非法值
     }
     assert(arryLength > 0);
-    struct cJSON *curItem = cJSON_GetArrayItem(item_, 0);
-    assert(curItem != nullptr);
-    struct cJSON *newItem = cJSON_Duplicate(curItem, 1);
-    assert(newItem != nullptr);
-    return JsonValue(newItem);
+    return at(0);
 }
 
 void JsonArray::removeAt(int index)
@@ -593,6 +817,14 @@ void JsonArray::replace(int index, const JsonValue &val)
     operator [] (index) = val;
 }
 
+JsonDoubleSpan JsonArray::toDoubleSpan() const
+{
+    if (!cJSON_PackArray(item_)) {
+        return JsonDoubleSpan();
+    }
+    return JsonDoubleSpan(cJSON_GetPackedArrayData(item_), static_cast<size_t>(cJSON_GetArraySize(item_)));
+}
+
 JsonValueRef JsonArray::operator [] (int index)
 {
     return static_cast<const JsonArray*>(this)->operator [] (index);
@@ -622,7 +854,7 @@ JsonArray &JsonArray::operator = (const JsonArray &other)
     }
 
     cJSON_Delete(item_);
-    item_ = cJSON_Duplicate(other.item_, 1);
+    item_ = cJSON_DuplicateFlat(other.item_);
     return *this;
 }
 
@@ -651,7 +883,7 @@ JsonObject::JsonObject(const JsonObject &other)
     : item_(nullptr)
 {
     assert(cJSON_IsObject(other.item_));
-    item_ = cJSON_Duplicate(other.item_, 1);
+    item_ = cJSON_DuplicateFlat(other.item_);
     assert(item_ != nullptr);
 }
 
@@ -683,40 +915,61 @@ JsonObject::~JsonObject()
     }
 }
 
-void JsonObject::insert(const std::string &key, const JsonValue &val)
+struct cJSON *JsonObject::findItem(const JsonKey &key) const
 {
-    assert(!val.isUndefined());
-    assert(!key.empty());
-    if (!contains(key)) {
-        struct cJSON *newItem = cJSON_Duplicate(val.item_, 1);
-        cJSON_AddItemToObject(item_, key.c_str(), newItem);
-    } else {
-        struct cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
-        assert(curItem != nullptr);
-        assert(std::string(curItem->string) == key);
-        struct cJSON *newItem = cJSON_Duplicate(val.item_, 1);
-        std::swap(curItem->string, newItem->string);
-        // curItem 指向的资源会被销毁
-        cJSON_ReplaceItemViaPointer(item_, curItem, newItem);
-    }
+    return findKey(item_, key);
 }
 
-void JsonObject::insert(const std::string &key, JsonValue &&val)
+void JsonObject::findItems(const cJSON_Key *keys, size_t count, struct cJSON **items) const
 {
-    assert(!val.isUndefined());
-    assert(!key.empty());
-    if (!contains(key)) {
-        cJSON_AddItemToObject(item_, key.c_str(), val.item_);
-        val.item_ = nullptr; //把 JsonValue 置为非法,可以正常调用析构函数即可
-    } else {
-        struct cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
-        assert(curItem != nullptr);
-        assert(std::string(curItem->string) == key);
-        std::swap(curItem->string, val.item_->string);
-        // curItem 指向的资源会被销毁
-        cJSON_ReplaceItemViaPointer(item_, curItem, val.item_);
-        val.item_ = nullptr;
+#ifdef CJSON_WRAPPER_CASE_SENSITIVE
+    cJSON_GetObjectItems(item_, keys, count, items, 1);
+#else
+    cJSON_GetObjectItems(item_, keys, count, items, 0);
+#endif
+}
+
+std::pair<JsonObject::iterator, bool> JsonObject::insertItem(const JsonKey &key, struct cJSON *item)
+{
+    // 插入非法的 JsonValue 时 item 为NULL
+    assert(item != nullptr);
+    struct cJSON *curItem = findItem(key);
+    if (!curItem) {
+        return std::make_pair(iterator(item_, appendItem(key, item)), true);
     }
+    moveValue(curItem, item);
+    return std::make_pair(iterator(item_, curItem), false);
+}
+
+void JsonObject::remove(const JsonKey &key)
+{
+    cJSON_Delete(cJSON_DetachItemViaPointer(item_, findItem(key)));
+}
+
+JsonObject::iterator JsonObject::erase(iterator it)
+{
+    assert(it.object_ == item_ && it.item_ != nullptr);
+    struct cJSON *next = it.item_->next;
+    cJSON_Delete(cJSON_DetachItemViaPointer(item_, it.item_));
+    return iterator(item_, next);
+}
+
+void JsonObject::appendItem(const char *key, struct cJSON *item)
+{
+    assert(key != nullptr && *key != '\0');
+    assert(item != nullptr);
+    assert(!contains(key));
+    cJSON_AddItemToObject(item_, key, item);
+}
+
+struct cJSON *JsonObject::appendItem(const JsonKey &key, struct cJSON *item)
+{
+    assert(key.size() > 0);
+    assert(item != nullptr);
+    bool ret = cJSON_AddItemToObjectWithLength(item_, key.data(), key.size(), item);
+    assert(ret);
+    (void)ret;
+    return item;
 }
 
 std::vector<std::string> JsonObject::keys() const
@@ -730,21 +983,9 @@ std::vector<std::string> JsonObject::keys() const
     return keysData;
 }
 
-JsonValue JsonObject::value(const std::string &key) const
-{
-    struct cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
-    if (!curItem) {
-        return JsonValue(static_cast<struct cJSON*>(nullptr)); // 返回一个非法值
-    }
-
-    struct cJSON *newItem = cJSON_Duplicate(curItem, 1);
-    assert(newItem != nullptr);
-    return JsonValue(newItem);
-}
-
-const JsonValueRef JsonObject::operator [] (const std::string &key) const
+const JsonValueRef JsonObject::operator [] (const JsonKey &key) const
 {
-    struct cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
+    struct cJSON *curItem = findItem(key);
     assert(curItem != nullptr);
     return JsonValueRef(item_, curItem);
 }
@@ -764,7 +1005,7 @@ JsonObject &JsonObject::operator = (const JsonObject &other)
     }
 
     cJSON_Delete(item_);
-    item_ = cJSON_Duplicate(other.item_, 1);
+    item_ = cJSON_DuplicateFlat(other.item_);
     return *this;
 }
 
@@ -777,14 +1018,14 @@ JsonObject &JsonObject::operator = (JsonObject &&other)
     return *this;
 }
 
-JsonValueRef JsonObject::operator [] (const std::string &key)
+JsonValueRef JsonObject::operator [] (const JsonKey &key)
 {
-    assert(!key.empty());
-    struct cJSON *curItem = cJSON_GetObjectItem(item_, key.c_str());
+    assert(key.size() > 0);
+    struct cJSON *curItem = findItem(key);
     if (!curItem) {
         struct cJSON *newItem = cJSON_CreateNull();
         assert(newItem != nullptr);
-        cJSON_AddItemToObject(item_, key.c_str(), newItem);
+        cJSON_AddItemToObjectWithLength(item_, key.data(), key.size(), newItem);
         return JsonValueRef(item_, newItem);
     }
     return JsonValueRef(item_, curItem);
@@ -792,49 +1033,497 @@ JsonValueRef JsonObject::operator [] (const std::string &key)
 
 //------------------[JsonObject] END---------------------
 
+//------------------[JsonKeyTable] BEGIN---------------------
+JsonKeyTable::JsonKeyTable()
+    : table_(cJSON_CreateKeyTable(lock, unlock, this))
+{
+    assert(table_ != nullptr);
+}
+
+JsonKeyTable::~JsonKeyTable()
+{
+    cJSON_DeleteKeyTable(table_);
+}
+
+void JsonKeyTable::lock(void *context)
+{
+    static_cast<JsonKeyTable*>(context)->mutex_.lock();
+}
+
+void JsonKeyTable::unlock(void *context)
+{
+    static_cast<JsonKeyTable*>(context)->mutex_.unlock();
+}
+//------------------[JsonKeyTable] END---------------------
+
+//------------------[JsonMemoryResource] BEGIN---------------------
+JsonMemoryResource::JsonMemoryResource()
+{
+    allocator_.allocate = allocateFrom;
+    allocator_.deallocate = deallocateTo;
+    allocator_.context = this;
+}
+
+void *JsonMemoryResource::allocateFrom(void *context, size_t size)
+{
+    return static_cast<JsonMemoryResource*>(context)->allocate(size);
+}
+
+void JsonMemoryResource::deallocateTo(void *context, void *pointer)
+{
+    static_cast<JsonMemoryResource*>(context)->deallocate(pointer);
+}
+//------------------[JsonMemoryResource] END---------------------
+
+//------------------[JsonPoolResource] BEGIN---------------------
+namespace {
+// 各个分级的大小，包括块头，都是 16 的倍数。cJSON 节点加上它前面的 allocator 指针和块头正好是 96
+const size_t kPoolClassSizes[] = {32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+const size_t kPoolClassCount = sizeof(kPoolClassSizes) / sizeof(kPoolClassSizes[0]);
+// 直接使用 malloc 的块
+const size_t kPoolLargeClass = kPoolClassCount;
+// 其他线程的块攒够这么多再一起归还
+const size_t kPoolReturnBatch = 64;
+
+std::atomic<uint64_t> g_poolResourceId(0);
+
+size_t poolClassOf(size_t size)
+{
+    for (size_t i = 0; i < kPoolClassCount; ++i) {
+        if (size <= kPoolClassSizes[i]) {
+            return i;
+        }
+    }
+    return kPoolLargeClass;
+}
+
+// 空闲的块通过块中的第一个指针连成链表
+void *&nextBlock(void *pointer)
+{
+    return *static_cast<void**>(pointer);
+}
+}
+
+// 每块内存前面的头，记录它是哪个缓存切分出来的，释放时还给这个缓存
+struct alignas(std::max_align_t) JsonPoolResource::Block
+{
+    Cache *cache;
+    size_t sizeClass;
+};
+
+struct JsonPoolResource::Cache
+{
+    Cache()
+        : slab(nullptr)
+        , slabLeft(0)
+        , hasRemote(false)
+        , pending(nullptr)
+        , pendingCount(0)
+    {
+        std::fill(freeBlocks, freeBlocks + kPoolClassCount, nullptr);
+        std::fill(remoteBlocks, remoteBlocks + kPoolClassCount, nullptr);
+    }
+
+    // 只由使用这个缓存的线程访问
+    void *freeBlocks[kPoolClassCount];
+    char *slab;
+    size_t slabLeft;
+    // 其他线程还回来的块，加锁访问，hasRemote 用来在不加锁的时候判断有没有
+    std::mutex remoteMutex;
+    std::atomic<bool> hasRemote;
+    void *remoteBlocks[kPoolClassCount];
+    // 这个线程释放的其他缓存的块
+    void *pending;
+    size_t pendingCount;
+};
+
+struct JsonPoolResource::Shared
+{
+    explicit Shared(size_t size) : slabSize(size) {}
+    ~Shared()
+    {
+        for (char *slab : slabs) {
+            std::free(slab);
+        }
+    }
+
+    std::mutex mutex;
+    size_t slabSize;
+    std::vector<char*> slabs;
+    // reserve 申请了还没有分给线程的 slab
+    std::vector<char*> freeSlabs;
+    std::vector<std::unique_ptr<Cache>> caches;
+    // 线程退出后留下的缓存，下一个线程接着使用其中的空闲块
+    std::vector<Cache*> orphans;
+};
+
+// 每个线程在各个 JsonPoolResource 中使用的缓存
+struct JsonPoolResource::ThreadCaches
+{
+    struct Entry {
+        uint64_t id;
+        Cache *cache;
+        std::weak_ptr<Shared> shared;
+    };
+
+    ~ThreadCaches()
+    {
+        for (Entry &entry : entries) {
+            std::shared_ptr<Shared> shared = entry.shared.lock();
+            if (shared) {
+                returnPending(entry.cache);
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->orphans.push_back(entry.cache);
+            }
+        }
+    }
+
+    std::vector<Entry> entries;
+};
+
+JsonPoolResource::JsonPoolResource(size_t slabSize)
+    : shared_(std::make_shared<Shared>(std::max(slabSize, kPoolClassSizes[kPoolClassCount - 1])))
+    , id_(++g_poolResourceId)
+{
+    static_assert(sizeof(Block) % alignof(std::max_align_t) == 0, "blocks must stay aligned");
+}
+
+void *JsonPoolResource::allocate(size_t size)
+{
+    const size_t sizeClass = poolClassOf(size + sizeof(Block));
+    Block *block = nullptr;
+    if (sizeClass == kPoolLargeClass) {
+        block = static_cast<Block*>(std::malloc(size + sizeof(Block)));
+        if (block == nullptr) {
+            return nullptr;
+        }
+        block->cache = nullptr;
+    } else {
+        Cache *cache = localCache();
+        void *pointer = cache->freeBlocks[sizeClass];
+        if (pointer == nullptr && cache->hasRemote.load(std::memory_order_acquire)) {
+            collectRemote(cache);
+            pointer = cache->freeBlocks[sizeClass];
+        }
+        if (pointer != nullptr) {
+            cache->freeBlocks[sizeClass] = nextBlock(pointer);
+            return pointer;
+        }
+        block = carve(cache, kPoolClassSizes[sizeClass]);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        block->cache = cache;
+    }
+    block->sizeClass = sizeClass;
+    return block + 1;
+}
+
+void JsonPoolResource::deallocate(void *pointer)
+{
+    Block *block = static_cast<Block*>(pointer) - 1;
+    if (block->sizeClass == kPoolLargeClass) {
+        std::free(block);
+        return;
+    }
+
+    Cache *cache = localCache();
+    if (block->cache == cache) {
+        nextBlock(pointer) = cache->freeBlocks[block->sizeClass];
+        cache->freeBlocks[block->sizeClass] = pointer;
+        return;
+    }
+    nextBlock(pointer) = cache->pending;
+    cache->pending = pointer;
+    if (++cache->pendingCount >= kPoolReturnBatch) {
+        returnPending(cache);
+    }
+}
+
+void JsonPoolResource::reserve(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    while (shared_->freeSlabs.size() * shared_->slabSize < bytes) {
+        char *slab = static_cast<char*>(std::malloc(shared_->slabSize));
+        if (slab == nullptr) {
+            return;
+        }
+        shared_->slabs.push_back(slab);
+        shared_->freeSlabs.push_back(slab);
+    }
+}
+
+size_t JsonPoolResource::slabCount() const
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    return shared_->slabs.size();
+}
+
+JsonPoolResource::Cache *JsonPoolResource::localCache()
+{
+    static thread_local ThreadCaches caches;
+    for (const ThreadCaches::Entry &entry : caches.entries) {
+        if (entry.id == id_) {
+            return entry.cache;
+        }
+    }
+
+    // 这个线程第一次使用，顺便去掉已经析构的 resource 留下的记录
+    caches.entries.erase(std::remove_if(caches.entries.begin(), caches.entries.end(),
+                                        [](const ThreadCaches::Entry &entry) {return entry.shared.expired();}),
+                         caches.entries.end());
+    Cache *cache = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        if (shared_->orphans.empty()) {
+            shared_->caches.emplace_back(new Cache());
+            cache = shared_->caches.back().get();
+        } else {
+            cache = shared_->orphans.back();
+            shared_->orphans.pop_back();
+        }
+    }
+    ThreadCaches::Entry entry = {id_, cache, shared_};
+    caches.entries.push_back(entry);
+    return cache;
+}
+
+JsonPoolResource::Block *JsonPoolResource::carve(Cache *cache, size_t size)
+{
+    // slab 剩下的不够一块时丢弃剩下的部分
+    if (cache->slabLeft < size) {
+        char *slab = takeSlab();
+        if (slab == nullptr) {
+            return nullptr;
+        }
+        cache->slab = slab;
+        cache->slabLeft = shared_->slabSize;
+    }
+    Block *block = reinterpret_cast<Block*>(cache->slab);
+    cache->slab += size;
+    cache->slabLeft -= size;
+    return block;
+}
+
+char *JsonPoolResource::takeSlab()
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    if (!shared_->freeSlabs.empty()) {
+        char *slab = shared_->freeSlabs.back();
+        shared_->freeSlabs.pop_back();
+        return slab;
+    }
+    char *slab = static_cast<char*>(std::malloc(shared_->slabSize));
+    if (slab != nullptr) {
+        shared_->slabs.push_back(slab);
+    }
+    return slab;
+}
+
+void JsonPoolResource::collectRemote(Cache *cache)
+{
+    std::lock_guard<std::mutex> lock(cache->remoteMutex);
+    bool left = false;
+    for (size_t i = 0; i < kPoolClassCount; ++i) {
+        // 本地链表不为空的分级留到下次，不用遍历链表去接
+        if (cache->freeBlocks[i] == nullptr) {
+            cache->freeBlocks[i] = cache->remoteBlocks[i];
+            cache->remoteBlocks[i] = nullptr;
+        } else if (cache->remoteBlocks[i] != nullptr) {
+            left = true;
+        }
+    }
+    cache->hasRemote.store(left, std::memory_order_release);
+}
+
+void JsonPoolResource::returnPending(Cache *cache)
+{
+    // 按所属的缓存分组，每组只加一次锁
+    while (cache->pending != nullptr) {
+        Cache *owner = (static_cast<Block*>(cache->pending) - 1)->cache;
+        std::lock_guard<std::mutex> lock(owner->remoteMutex);
+        void **link = &cache->pending;
+        while (*link != nullptr) {
+            void *pointer = *link;
+            Block *block = static_cast<Block*>(pointer) - 1;
+            if (block->cache == owner) {
+                *link = nextBlock(pointer);
+                nextBlock(pointer) = owner->remoteBlocks[block->sizeClass];
+                owner->remoteBlocks[block->sizeClass] = pointer;
+            } else {
+                link = &nextBlock(pointer);
+            }
+        }
+        owner->hasRemote.store(true, std::memory_order_release);
+    }
+    cache->pendingCount = 0;
+}
+//------------------[JsonPoolResource] END---------------------
+
+//------------------[JsonReclaimer] BEGIN---------------------
+JsonReclaimer::JsonReclaimer(Mode mode)
+    : mode_(mode)
+    , items_(nullptr)
+    , busy_(false)
+    , stopping_(false)
+{
+    if (mode_ == Background) {
+        thread_ = std::thread(&JsonReclaimer::run, this);
+    }
+}
+
+JsonReclaimer::~JsonReclaimer()
+{
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wakeup_.notify_one();
+        // 后台线程释放完剩下的树之后退出
+        thread_.join();
+    }
+    flush();
+}
+
+bool JsonReclaimer::reclaim(size_t maxNodes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    items_ = cJSON_DeleteSlice(items_, maxNodes);
+    if (items_ == nullptr) {
+        for (struct cJSON_Pool *pool : pools_) {
+            cJSON_DeletePool(pool);
+        }
+        pools_.clear();
+        resources_.clear();
+    }
+    return items_ != nullptr;
+}
+
+void JsonReclaimer::flush()
+{
+    reclaim(static_cast<size_t>(-1));
+    if (mode_ == Background) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] {return !busy_;});
+    }
+}
+
+void JsonReclaimer::retire(struct cJSON *item, const std::shared_ptr<JsonMemoryResource> &resource)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        item->next = items_;
+        items_ = item;
+        keep(resource);
+    }
+    if (mode_ == Background) {
+        wakeup_.notify_one();
+    }
+}
+
+void JsonReclaimer::retire(struct cJSON_Pool *pool, const std::shared_ptr<JsonMemoryResource> &resource)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pools_.push_back(pool);
+        keep(resource);
+    }
+    if (mode_ == Background) {
+        wakeup_.notify_one();
+    }
+}
+
+void JsonReclaimer::keep(const std::shared_ptr<JsonMemoryResource> &resource)
+{
+    // 同一个文档交来的树通常在同一块内存中，只保存一次
+    if (resource && (resources_.empty() || resources_.back() != resource)) {
+        resources_.push_back(resource);
+    }
+}
+
+void JsonReclaimer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wakeup_.wait(lock, [this] {return items_ != nullptr || !pools_.empty() || stopping_;});
+        if (items_ == nullptr && pools_.empty()) {
+            return;
+        }
+
+        // 释放时不持有锁，其他线程可以继续交来新的树
+        struct cJSON *items = items_;
+        std::vector<struct cJSON_Pool*> pools;
+        std::vector<std::shared_ptr<JsonMemoryResource>> resources;
+        items_ = nullptr;
+        pools.swap(pools_);
+        resources.swap(resources_);
+        busy_ = true;
+        lock.unlock();
+
+        cJSON_Delete(items);
+        for (struct cJSON_Pool *pool : pools) {
+            cJSON_DeletePool(pool);
+        }
+        resources.clear();
+
+        lock.lock();
+        busy_ = false;
+        idle_.notify_all();
+    }
+}
+//------------------[JsonReclaimer] END---------------------
+
 //------------------[JsonDocument] BEGIN---------------------
 JsonDocument::JsonDocument()
     : item_(nullptr)
+    , pool_(nullptr)
 {
 
 }
 
 JsonDocument::JsonDocument(const JsonObject &object)
     : item_(nullptr)
+    , pool_(nullptr)
 {
     assert(cJSON_IsObject(object.item_));
-    item_ = cJSON_Duplicate(object.item_, 1);
+    item_ = cJSON_DuplicateFlat(object.item_);
     assert(item_ != nullptr);
 }
 
 JsonDocument::JsonDocument(const JsonArray &array)
     : item_(nullptr)
+    , pool_(nullptr)
 {
     assert(cJSON_IsArray(array.item_));
-    item_ = cJSON_Duplicate(array.item_, 1);
+    item_ = cJSON_DuplicateFlat(array.item_);
     assert(item_ != nullptr);
 }
 
 JsonDocument::~JsonDocument()
 {
-    if (item_) {
-        cJSON_Delete(item_);
-    }
+    deleteItem();
+    deletePool();
 }
 
 JsonDocument::JsonDocument(const JsonDocument &other)
     : item_(nullptr)
+    , pool_(nullptr)
+    , source_(other.source_)
+    , keys_(other.keys_)
+    , reclaimer_(other.reclaimer_)
+    , resource_(other.resource_)
 {
     if (other.item_) {
-        item_ = cJSON_Duplicate(other.item_, 1);
-        assert(item_ != nullptr);
+        item_ = copyItem(other.item_);
     }
 }
 
 JsonDocument::JsonDocument(JsonDocument &&other)
     : item_(nullptr)
+    , pool_(nullptr)
 {
-    std::swap(item_, other.item_);
+    swap(other);
 }
 
 JsonDocument &JsonDocument::operator =(const JsonDocument &other)
@@ -843,16 +1532,15 @@ JsonDocument &JsonDocument::operator =(const JsonDocument &other)
         return *this;
     }
 
-    if (item_) {
-        cJSON_Delete(item_);
-    }
+    deleteItem();
+    setMemoryResource(other.resource_);
 
     if (other.item_) {
-        item_ = cJSON_Duplicate(other.item_, 1);
-        assert(item_ != nullptr);
-    } else {
-        item_ = nullptr;
+        item_ = copyItem(other.item_);
     }
+    source_ = other.source_;
+    keys_ = other.keys_;
+    reclaimer_ = other.reclaimer_;
     return *this;
 }
 
@@ -870,49 +1558,202 @@ bool JsonDocument::operator == (const JsonDocument &other) const
     return cJSON_Compare(item_, other.item_, 1);
 }
 
-const JsonValue JsonDocument::operator [] (const std::string &key) const
+const JsonValue JsonDocument::operator [] (const JsonKey &key) const
 {
-    return object().value(key);
+    // 只复制需要的值，不复制整个文档
+    struct cJSON *curItem = cJSON_IsObject(item_) ? findKey(item_, key) : nullptr;
+    return JsonValue::copyOf(curItem);
 }
 
 const JsonValue JsonDocument::operator [] (int index) const
 {
     assert(index >= 0);
-    JsonArray arryVal(array());
-    if (index >= array().size()) {
-        return JsonArray(static_cast<struct cJSON*>(nullptr));
-    }
-    return array().at(index);
+    struct cJSON *curItem = cJSON_IsArray(item_) ? cJSON_GetArrayItem(item_, index) : nullptr;
+    return JsonValue::copyOf(curItem);
 }
 
 JsonArray JsonDocument::array() const
 {
-    if (cJSON_IsArray(item_)) {
-        return JsonArray(cJSON_Duplicate(item_, 1));
-    }
-    return JsonArray();
+    struct cJSON *item = cJSON_IsArray(item_) ? detachItem(item_) : nullptr;
+    return item ? JsonArray(item) : JsonArray();
 }
 
 JsonObject JsonDocument::object() const
 {
-    if (cJSON_IsObject(item_)) {
-        return JsonObject(cJSON_Duplicate(item_, 1));
+    struct cJSON *item = cJSON_IsObject(item_) ? detachItem(item_) : nullptr;
+    return item ? JsonObject(item) : JsonObject();
+}
+
+struct cJSON *JsonDocument::detachItem(const struct cJSON *item)
+{
+    struct cJSON *newItem = cJSON_DuplicateFlat(item);
+    assert(newItem != nullptr);
+    if (!cJSON_Decode(newItem)) {
+        cJSON_Delete(newItem);
+        return nullptr;
     }
-    return JsonObject();
+    return newItem;
 }
 
 JsonDocument JsonDocument::fromJson(const std::string &data, bool *ok)
 {
-    struct cJSON *json = cJSON_Parse(data.c_str());
-    JsonDocument document;
-    assert(document.item_ == nullptr);
-    document.item_ = json;
+    return fromJson(data, JsonParseOptions(), ok);
+}
+
+JsonDocument JsonDocument::fromJson(const std::string &data, const JsonParseOptions &options, bool *ok)
+{
+    JsonParseError error;
+    JsonDocument document(fromJson(data, options, &error));
     if (ok) {
-        *ok = json;
+        *ok = error.error == JsonParseError::NoError;
     }
     return document;
 }
 
+JsonDocument JsonDocument::fromJson(const std::string &data, JsonParseError *error)
+{
+    return fromJson(data, JsonParseOptions(), error);
+}
+
+JsonDocument JsonDocument::fromJson(const std::string &data, const JsonParseOptions &options, JsonParseError *error)
+{
+    JsonDocument document;
+    assert(document.item_ == nullptr);
+    document.resource_ = options.memoryResource;
+    document.parse(data, options, error);
+    return document;
+}
+
+bool JsonDocument::parseInto(const std::string &data, JsonParseError *error)
+{
+    return parseInto(data, JsonParseOptions(), error);
+}
+
+bool JsonDocument::parseInto(const std::string &data, const JsonParseOptions &options, JsonParseError *error)
+{
+    reset();
+    if (options.memoryResource) {
+        setMemoryResource(options.memoryResource);
+    }
+    if (pool_ == nullptr) {
+        pool_ = cJSON_CreatePoolWithAllocator(allocator());
+    }
+    return parse(data, options, error);
+}
+
+void JsonDocument::deleteItem()
+{
+    if (item_ && reclaimer_) {
+        reclaimer_->retire(item_, resource_);
+    } else if (item_) {
+        cJSON_Delete(item_);
+    }
+    item_ = nullptr;
+}
+
+void JsonDocument::recycleItem()
+{
+    if (pool_) {
+        // 放回 pool_ 不释放内存，只是把节点和字符串挂到空闲链表上
+        cJSON_DeleteToPool(pool_, item_);
+        item_ = nullptr;
+    } else {
+        deleteItem();
+    }
+}
+
+void JsonDocument::deletePool()
+{
+    if (pool_ && reclaimer_) {
+        reclaimer_->retire(pool_, resource_);
+    } else {
+        cJSON_DeletePool(pool_);
+    }
+    pool_ = nullptr;
+}
+
+struct cJSON *JsonDocument::copyItem(const struct cJSON *item) const
+{
+    struct cJSON *newItem = cJSON_DuplicateFlatWithAllocator(item, allocator());
+    assert(newItem != nullptr);
+    return newItem;
+}
+
+void JsonDocument::setMemoryResource(const std::shared_ptr<JsonMemoryResource> &resource)
+{
+    if (resource == resource_) {
+        return;
+    }
+
+    // 旧的树和 pool_ 用的是原来的内存，树复制到新的内存中，pool_ 下一次 parseInto 时重新创建
+    struct cJSON *item = item_ ? cJSON_DuplicateFlatWithAllocator(item_, resource ? &resource->allocator_ : nullptr) : nullptr;
+    assert(item_ == nullptr || item != nullptr);
+    deleteItem();
+    deletePool();
+    resource_ = resource;
+    item_ = item;
+}
+
+void JsonDocument::reset()
+{
+    recycleItem();
+    // source_ 留给下一次延迟解码的 parseInto 复用
+}
+
+void JsonDocument::compact()
+{
+    if (item_ == nullptr) {
+        return;
+    }
+
+    // 延迟解码的值仍然引用 source_，intern 的 key 仍然在 keys_ 中
+    struct cJSON *item = copyItem(item_);
+    recycleItem();
+    item_ = item;
+}
+
+bool JsonDocument::parse(const std::string &data, const JsonParseOptions &options, JsonParseError *error)
+{
+    assert(item_ == nullptr);
+    cJSON_ParseOptions parseOptions;
+    cJSON_InitParseOptions(&parseOptions);
+    parseOptions.nesting_limit = options.maxDepth;
+    parseOptions.pool = pool_;
+    parseOptions.lazy = options.lazy;
+    parseOptions.pack = options.packNumbers;
+    parseOptions.allocator = allocator();
+    if (options.keyTable) {
+        keys_ = options.keyTable;
+    } else if (options.internKeys && !keys_) {
+        keys_ = std::make_shared<JsonKeyTable>();
+    }
+    if (options.internKeys || options.keyTable) {
+        parseOptions.keys = keys_->table_;
+    }
+
+    const std::string *text = &data;
+    if (options.lazy) {
+        // 延迟解码的值指向原文，文档需要自己保留一份
+        if (source_ && source_.use_count() == 1) {
+            source_->assign(data);
+        } else {
+            source_ = std::make_shared<std::string>(data);
+        }
+        text = source_.get();
+    }
+
+    cJSON_ParseResult result;
+    // 长度包含结尾的'\0'，和 cJSON_Parse 的处理保持一致
+    item_ = cJSON_ParseWithOptions(text->c_str(), text->size() + 1, &parseOptions, &result);
+    if (error) {
+        error->error = static_cast<JsonParseError::ParseError>(result.error);
+        error->offset = result.offset;
+        error->line = result.line;
+        error->column = result.column;
+    }
+    return item_ != nullptr;
+}
+
 std::string JsonDocument::toJson(JsonFormat format) const
 {
     char *json = nullptr;
@@ -933,21 +1774,17 @@ std::string JsonDocument::toJson(JsonFormat format) const
 void JsonDocument::setArray(const JsonArray &array)
 {
     assert(array.item_ != nullptr);
-    if (item_) {
-        cJSON_Delete(item_);
-    }
+    deleteItem();
     assert(cJSON_IsArray(array.item_));
-    item_ = cJSON_Duplicate(array.item_, 1);
+    item_ = copyItem(array.item_);
 }
 
 void JsonDocument::setObject(const JsonObject &object)
 {
     assert(object.item_ != nullptr);
-    if (item_) {
-        cJSON_Delete(item_);
-    }
+    deleteItem();
     assert(cJSON_IsObject(object.item_));
-    item_ = cJSON_Duplicate(object.item_, 1);
+    item_ = copyItem(object.item_);
 }
 
 std::ostream &operator << (std::ostream &os, const JsonValue &val)
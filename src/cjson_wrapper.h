@@ -8,6 +8,19 @@
 #include <functional>
 #include <cassert>
 #include <ostream>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// C++17 及以上提供 std::string_view 的重载
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define CJSON_WRAPPER_HAS_STRING_VIEW
+#endif
 
 class JsonValue;
 class JsonArray;
@@ -15,6 +28,57 @@ class JsonObject;
 class JsonDocument;
 class JsonValueRef;
 
+// 预先计算好长度和哈希值的 key，同一个 key 反复查找时不再需要 strlen，哈希值不同的节点直接跳过
+// 用字符串字面量构造时在编译期计算，例如 static constexpr JsonKey kName("name");
+// 只保存指针，不复制字符串，使用期间字符串必须有效
+class JsonKey
+{
+public:
+    template <size_t N>
+    constexpr JsonKey(const char (&key)[N])
+        : data_(key)
+        , length_(lengthOf(key, N - 1))
+        , hash_(hashOf(key, N - 1, 2166136261U))
+    {
+
+    }
+    JsonKey(const char *key, size_t length)
+        : data_(key)
+        , length_(length)
+        , hash_(cJSON_HashKey(key, length))
+    {
+
+    }
+    explicit JsonKey(const std::string &key) : JsonKey(key.data(), key.size()) {}
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    explicit JsonKey(std::string_view key) : JsonKey(key.data(), key.size()) {}
+#endif
+
+    constexpr const char *data() const {return data_;}
+    constexpr size_t size() const {return length_;}
+    // 和 cJSON_HashKey 的结果一致
+    constexpr unsigned int hash() const {return hash_;}
+
+private:
+    // 和 cJSON.c 中的 hash_key 相同：遇到'\0'结束，ASCII 字母转为小写，其余大于0x7F的字节看作同一个值
+    static constexpr size_t lengthOf(const char *key, size_t n)
+    {
+        return (n == 0 || *key == '\0') ? 0 : 1 + lengthOf(key + 1, n - 1);
+    }
+    static constexpr unsigned int fold(unsigned char c)
+    {
+        return c > 0x7F ? 0x80U : static_cast<unsigned int>((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+    }
+    static constexpr unsigned int hashOf(const char *key, size_t n, unsigned int hash)
+    {
+        return (n == 0 || *key == '\0') ? hash : hashOf(key + 1, n - 1, (hash ^ fold(static_cast<unsigned char>(*key))) * 16777619U);
+    }
+
+    const char *data_;
+    size_t length_;
+    unsigned int hash_;
+};
+
 class JsonValue
 {
 public:
@@ -23,28 +87,38 @@ public:
     JsonValue(bool val);
     JsonValue(int32_t val);
     JsonValue(int64_t val);
+    JsonValue(uint64_t val);
     JsonValue(const char *val);
     JsonValue(const std::string &val);
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    JsonValue(std::string_view val) : item_(nullptr), type_(cJSON_Invalid), scalar_() {setString(val.data(), val.size());}
+#endif
     JsonValue(const JsonObject &val);
     JsonValue(const JsonArray &val);
+    // 直接接管 val 的节点，不复制，之后 val 不能再使用
+    JsonValue(JsonObject &&val);
+    JsonValue(JsonArray &&val);
     JsonValue(const JsonValue &other);
     JsonValue(JsonValue &&other);
     ~JsonValue();
 
-    bool isNull() const {return cJSON_IsNull(item_);}
-    bool isBool() const {return cJSON_IsBool(item_);}
-    bool isNumber() const {return cJSON_IsNumber(item_);}
+    bool isNull() const {return valueType() == cJSON_NULL;}
+    bool isBool() const {return valueType() == cJSON_True || valueType() == cJSON_False;}
+    bool isNumber() const {return valueType() == cJSON_Number;}
     bool isDouble() const {return isNumber();}
-    bool isString() const {return cJSON_IsString(item_);}
-    bool isArray() const {return cJSON_IsArray(item_);}
-    bool isObject() const {return cJSON_IsObject(item_);}
-    //cJSON_IsInvalid 在 item_ 为NULL的时候返回false ,按照函数的定义，这里item_为NULL的时候返回true
-    bool isUndefined() const {return item_ == nullptr || cJSON_IsInvalid(item_);}
+    bool isString() const {return valueType() == cJSON_String;}
+    bool isArray() const {return valueType() == cJSON_Array;}
+    bool isObject() const {return valueType() == cJSON_Object;}
+    // item_ 为NULL并且没有保存标量的时候也是非法值
+    bool isUndefined() const {return valueType() == cJSON_Invalid;}
 
     bool toBool(bool defaultValue = false) const;
     double toNumber(double defaultValue = 0) const;
     double toDouble(double defaultValue = 0) const {return toNumber(defaultValue);}
     int32_t toInt(int32_t defaultValue = 0) const;
+    // 整数按 64 位精确保存，超过 2^53 的 ID 也不会丢失精度，超出范围时取边界值
+    int64_t toInt64(int64_t defaultValue = 0) const;
+    uint64_t toUInt64(uint64_t defaultValue = 0) const;
     std::string toString() const;
     std::string toString(const std::string &defaultValue) const;
     JsonArray toArray() const;
@@ -61,11 +135,36 @@ private:
     // 内部使用的构造函数
     JsonValue(struct cJSON *item);
 
+    // 可以直接保存在 JsonValue 中的字符串的最大长度
+    enum {MaxShortStringLength = 15};
+
+    // 复制 cJSON 节点中的值，标量直接保存在 JsonValue 中
+    static JsonValue copyOf(const struct cJSON *item);
+    int valueType() const {return (item_ ? item_->type : type_) & 0xFF;}
+    // 返回可以直接读取的节点，标量的值临时填到 view 中
+    const struct cJSON *constItem(struct cJSON &view) const;
+    // 插入容器时使用：复制一个新的节点，或者把节点的所有权交出去，之后 JsonValue 为非法值
+    struct cJSON *createItem() const;
+    struct cJSON *takeItem();
+    void setString(const char *val, size_t length);
+
     friend class JsonArray;
     friend class JsonObject;
     friend class JsonValueRef;
+    friend class JsonDocument;
 
+    // 数组、对象和较长的字符串保存在 item_ 中，其余的值保存在 type_ 和 scalar_ 中，不申请内存
     struct cJSON *item_;
+    // item_ 为NULL时有效，和 cJSON::type 的取值一致
+    int type_;
+    union {
+        struct {
+            double value;
+            // type_ 中有 cJSON_NumberIsInt64 或 cJSON_NumberIsUInt64 时有效
+            int64_t integer;
+        } number;
+        char string[MaxShortStringLength + 1];
+    } scalar_;
 };
 
 // 内部被JsonObject 和 JsonArray 使用的帮助类
@@ -104,15 +203,20 @@ public:
 
     bool toBool() const {return toValue().toBool();}
     int toInt() const {return toValue().toInt();}
+    int64_t toInt64() const {return toValue().toInt64();}
+    uint64_t toUInt64() const {return toValue().toUInt64();}
     double toDouble() const {return toValue().toDouble();}
-    std::string toString() const {return toValue().toString();}
+    // 直接从节点复制字符串，不经过 JsonValue
+    std::string toString() const;
     JsonArray toArray() const;
     JsonObject toObject() const;
 
     bool toBool(bool defaultValue) const {return toValue().toBool(defaultValue);}
     int toInt(int defaultValue) const {return toValue().toInt(defaultValue);}
+    int64_t toInt64(int64_t defaultValue) const {return toValue().toInt64(defaultValue);}
+    uint64_t toUInt64(uint64_t defaultValue) const {return toValue().toUInt64(defaultValue);}
     double toDouble(double defaultValue) const {return toValue().toDouble(defaultValue);}
-    std::string toString(const std::string &defaultValue) const {return toValue().toString(defaultValue);}
+    std::string toString(const std::string &defaultValue) const {return isString() ? toString() : defaultValue;}
 
     bool operator == (const JsonValue &other) const {return toValue() == other;}
     bool operator != (const JsonValue &other) const {return toValue() != other;}
@@ -120,9 +224,17 @@ public:
     //Qt没有类似的接口，这里的几个接口是扩展接口
     // 扩展接口 --------------[BEGIN] ---------------
     //如果当前不是JsonObject或者key不存在，函数内部会自动创建和销毁相关对象
-    JsonValueRef &operator [] (const std::string &key);
+    JsonValueRef &operator [] (const JsonKey &key);
+    JsonValueRef &operator [] (const std::string &key) {return operator [] (JsonKey(key));}
+    JsonValueRef &operator [] (const char *key) {return operator [] (JsonKey(key, strlen(key)));}
     //如果当前不是JsonObject或者key不存在，则函数的处理是未定义的
-    const JsonValueRef &operator [] (const std::string &key) const;
+    const JsonValueRef &operator [] (const JsonKey &key) const;
+    const JsonValueRef &operator [] (const std::string &key) const {return operator [] (JsonKey(key));}
+    const JsonValueRef &operator [] (const char *key) const {return operator [] (JsonKey(key, strlen(key)));}
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    JsonValueRef &operator [] (std::string_view key) {return operator [] (JsonKey(key));}
+    const JsonValueRef &operator [] (std::string_view key) const {return operator [] (JsonKey(key));}
+#endif
 
     // 如果index非法或者对象不是JsonArray ,函数的处理是未定义的
     JsonValueRef &operator [] (int index);
@@ -143,7 +255,12 @@ public:
     bool isEmpty() const {return size() == 0;}
 
     bool contains(const JsonValue &val) const;
-    bool contains(const std::string &key) const;
+    bool contains(const JsonKey &key) const;
+    bool contains(const std::string &key) const {return contains(JsonKey(key));}
+    bool contains(const char *key) const {return contains(JsonKey(key, strlen(key)));}
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    bool contains(std::string_view key) const {return contains(JsonKey(key));}
+#endif
     // 扩展接口 --------------[END] ---------------
 
 private:
@@ -153,6 +270,26 @@ private:
     mutable struct cJSON *item_;
 };
 
+// JsonArray::toDoubleSpan 的返回值，直接指向数组中保存的 double，不复制
+// 数组被修改，或者通过 operator[] 取得元素之后失效
+class JsonDoubleSpan
+{
+public:
+    JsonDoubleSpan() : data_(nullptr), size_(0) {}
+    JsonDoubleSpan(const double *data, size_t size) : data_(data), size_(size) {}
+
+    const double *data() const {return data_;}
+    size_t size() const {return size_;}
+    bool empty() const {return size_ == 0;}
+    const double *begin() const {return data_;}
+    const double *end() const {return data_ + size_;}
+    double operator [] (size_t index) const {assert(index < size_); return data_[index];}
+
+private:
+    const double *data_;
+    size_t size_;
+};
+
 class JsonArray
 {
 public:
@@ -162,12 +299,32 @@ public:
     JsonArray(std::initializer_list<JsonValue> args);
     ~JsonArray();
 
+    // 一次构造出整个数组，每个节点只创建一次：标量直接创建节点，右值的 JsonArray/JsonObject 直接接管，不复制
+    // 例如 JsonArray::of(1, "two", JsonObject::of("three", 3))
+    // 使用 initializer_list 构造时元素是 const 的，嵌套的数组和对象都会被复制
+    template <typename... Values>
+    static JsonArray of(Values &&...values)
+    {
+        JsonArray array;
+        array.appendValues(std::forward<Values>(values)...);
+        return array;
+    }
+
+    // 只包含数字的数组，数字连续保存在一块内存中，没有单独的节点
+    static JsonArray fromDoubles(const double *values, int count);
+    static JsonArray fromDoubles(const std::vector<double> &values) {return fromDoubles(values.data(), static_cast<int>(values.size()));}
+
     void append(const JsonValue &val);
     void append(JsonValue &&val);
     JsonValue at(int index) const;
     int size() const {return cJSON_GetArraySize(item_);}
     int count() const {return size();}
     bool isEmpty() const {return size() == 0;}
+    // 为 size 个元素建立指向各个节点的索引，之后 size/at/operator[] 都是 O(1)，追加元素时不再重新分配
+    // 通过下标访问较靠后的元素时也会自动建立索引
+    void reserve(int size) {cJSON_ReserveArray(item_, size);}
+    // 释放索引中没有使用的空间
+    void shrink_to_fit() {cJSON_ShrinkArray(item_);}
     bool contains(const JsonValue &val) const;
     JsonValue last() const;
     JsonValue first() const;
@@ -177,6 +334,12 @@ public:
     JsonValue takeAt(int index);
     void replace(int index, const JsonValue &val);
 
+    // 数字连续保存时为true，at/first/last/size/toJson 和比较都直接读取这块内存，
+    // 修改数组或者使用 operator[] 时自动转换回普通的节点
+    bool isPacked() const {return (item_->type & cJSON_IsPacked) != 0;}
+    // 返回数组中所有的数字，数组还没有连续保存时先转换，包含数字以外的值时返回空的 JsonDoubleSpan
+    JsonDoubleSpan toDoubleSpan() const;
+
     JsonValueRef operator [] (int index);
     const JsonValueRef operator [] (int index) const;
     bool operator == (const JsonArray &other) const;
@@ -188,6 +351,14 @@ private:
     // 内部使用，主要为了避免不必要的内存创建和释放
     JsonArray(struct cJSON *item);
 
+    void appendValues() {}
+    template <typename Value, typename... Values>
+    void appendValues(Value &&value, Values &&...values)
+    {
+        append(JsonValue(std::forward<Value>(value)));
+        appendValues(std::forward<Values>(values)...);
+    }
+
     friend class JsonValue;
     friend class JsonDocument;
     friend class JsonValueRef;
@@ -198,35 +369,258 @@ private:
 class JsonObject
 {
 public:
+    class const_iterator;
+
+    // 和 QJsonObject::iterator 一样，value() 返回的 JsonValueRef 可以直接修改对象中的值
+    // 插入新的 key 或者修改值不影响已有的迭代器，删除的元素对应的迭代器失效
+    class iterator
+    {
+    public:
+        iterator() : object_(nullptr), item_(nullptr) {}
+
+        std::string key() const {return item_->string;}
+        JsonValueRef value() const {return JsonValueRef(object_, item_);}
+        JsonValueRef operator * () const {return value();}
+
+        iterator &operator ++ () {item_ = item_->next; return *this;}
+        iterator operator ++ (int) {iterator it = *this; item_ = item_->next; return it;}
+        bool operator == (const iterator &other) const {return item_ == other.item_;}
+        bool operator != (const iterator &other) const {return item_ != other.item_;}
+
+    private:
+        iterator(struct cJSON *object, struct cJSON *item) : object_(object), item_(item) {}
+
+        friend class JsonObject;
+        friend class const_iterator;
+
+        struct cJSON *object_;
+        struct cJSON *item_;
+    };
+
+    class const_iterator
+    {
+    public:
+        const_iterator() : object_(nullptr), item_(nullptr) {}
+        const_iterator(const iterator &other) : object_(other.object_), item_(other.item_) {}
+
+        std::string key() const {return item_->string;}
+        JsonValue value() const {return JsonValueRef(object_, item_);}
+        JsonValue operator * () const {return value();}
+
+        const_iterator &operator ++ () {item_ = item_->next; return *this;}
+        const_iterator operator ++ (int) {const_iterator it = *this; item_ = item_->next; return it;}
+        bool operator == (const const_iterator &other) const {return item_ == other.item_;}
+        bool operator != (const const_iterator &other) const {return item_ != other.item_;}
+
+    private:
+        const_iterator(struct cJSON *object, struct cJSON *item) : object_(object), item_(item) {}
+
+        friend class JsonObject;
+
+        struct cJSON *object_;
+        struct cJSON *item_;
+    };
+
     JsonObject();
     JsonObject(const JsonObject &other);
     JsonObject(JsonObject &&other);
     JsonObject(std::initializer_list<std::pair<std::string, JsonValue> > args);
     ~JsonObject();
 
-    void insert(const std::string &key, const JsonValue &val);
-    void insert(const std::string &key, JsonValue &&val);
+    // 和 JsonArray::of 一样一次构造出整个对象，参数为成对的 key 和 value，
+    // 例如 JsonObject::of("id", 1, "tags", JsonArray::of("a", "b"))，key 不能重复
+    template <typename... Args>
+    static JsonObject of(Args &&...args)
+    {
+        static_assert(sizeof...(Args) % 2 == 0, "JsonObject::of expects key/value pairs");
+        JsonObject object;
+        object.insertValues(std::forward<Args>(args)...);
+        return object;
+    }
+
+    // 使用 key 的接口都有 JsonKey、std::string、const char* 和 std::string_view(C++17) 的版本，
+    // 内部按指针和长度比较 key，查找时不会构造临时的 std::string
+    // 默认和 cJSON_GetObjectItem 一样不区分大小写，编译时定义 CJSON_WRAPPER_CASE_SENSITIVE
+    // (cmake -DCJSON_WRAPPER_CASE_SENSITIVE=ON) 后区分大小写，和 QJsonObject 一致
+    void insert(const JsonKey &key, const JsonValue &val) {insertItem(key, val.createItem());}
+    void insert(const JsonKey &key, JsonValue &&val) {insertItem(key, val.takeItem());}
+    void insert(const std::string &key, const JsonValue &val) {insertItem(JsonKey(key), val.createItem());}
+    void insert(const std::string &key, JsonValue &&val) {insertItem(JsonKey(key), val.takeItem());}
+    void insert(const char *key, const JsonValue &val) {insertItem(JsonKey(key, strlen(key)), val.createItem());}
+    void insert(const char *key, JsonValue &&val) {insertItem(JsonKey(key, strlen(key)), val.takeItem());}
 
     // 键值对的个数
     int size() const {return cJSON_GetArraySize(item_);}
     int count() const {return size();}
     bool isEmpty() const {return size() == 0;}
+    // 和 JsonArray 一样，建立索引后 size 是 O(1)，插入 size 个键值对时不再重新分配
+    void reserve(int size) {cJSON_ReserveArray(item_, size);}
+    void shrink_to_fit() {cJSON_ShrinkArray(item_);}
     std::vector<std::string> keys() const;
-    JsonValue value(const std::string &key) const;
-    bool contains(const std::string &key) const {return cJSON_HasObjectItem(item_, key.c_str());}
-    void remove(const std::string &key) {cJSON_DeleteItemFromObject(item_, key.c_str());}
+    JsonValue value(const JsonKey &key) const {return JsonValue::copyOf(findItem(key));}
+    JsonValue value(const std::string &key) const {return value(JsonKey(key));}
+    JsonValue value(const char *key) const {return value(JsonKey(key, strlen(key)));}
+    bool contains(const JsonKey &key) const {return findItem(key) != nullptr;}
+    bool contains(const std::string &key) const {return contains(JsonKey(key));}
+    bool contains(const char *key) const {return contains(JsonKey(key, strlen(key)));}
+    void remove(const JsonKey &key);
+    void remove(const std::string &key) {remove(JsonKey(key));}
+    void remove(const char *key) {remove(JsonKey(key, strlen(key)));}
 
     bool operator != (const JsonObject &other) const {return !(*this == other);}
     bool operator == (const JsonObject &other) const;
     JsonObject &operator = (const JsonObject &other);
     JsonObject &operator = (JsonObject &&other);
-    const JsonValueRef operator [] (const std::string &key) const;
-    JsonValueRef operator [] (const std::string &key);
+    iterator begin() {return iterator(item_, item_->child);}
+    const_iterator begin() const {return constBegin();}
+    const_iterator constBegin() const {return const_iterator(item_, item_->child);}
+    iterator end() {return iterator(item_, nullptr);}
+    const_iterator end() const {return constEnd();}
+    const_iterator constEnd() const {return const_iterator(item_, nullptr);}
+
+    // 只查找一次，找不到时返回 end()，可以代替先 contains 再 value 的写法
+    iterator find(const JsonKey &key) {return iterator(item_, findItem(key));}
+    iterator find(const std::string &key) {return find(JsonKey(key));}
+    iterator find(const char *key) {return find(JsonKey(key, strlen(key)));}
+    const_iterator find(const JsonKey &key) const {return constFind(key);}
+    const_iterator find(const std::string &key) const {return constFind(JsonKey(key));}
+    const_iterator find(const char *key) const {return constFind(JsonKey(key, strlen(key)));}
+    const_iterator constFind(const JsonKey &key) const {return const_iterator(item_, findItem(key));}
+    const_iterator constFind(const std::string &key) const {return constFind(JsonKey(key));}
+    const_iterator constFind(const char *key) const {return constFind(JsonKey(key, strlen(key)));}
+    // 删除 it 指向的元素，返回下一个元素的迭代器
+    iterator erase(iterator it);
+
+    // 和 std::map 的同名函数一样，只查找一次 key，返回值的 second 表示是否插入了新的 key
+    // insert_or_assign 在 key 已经存在时替换原来的值
+    std::pair<iterator, bool> insert_or_assign(const JsonKey &key, const JsonValue &val) {return insertItem(key, val.createItem());}
+    std::pair<iterator, bool> insert_or_assign(const JsonKey &key, JsonValue &&val) {return insertItem(key, val.takeItem());}
+    std::pair<iterator, bool> insert_or_assign(const std::string &key, const JsonValue &val) {return insertItem(JsonKey(key), val.createItem());}
+    std::pair<iterator, bool> insert_or_assign(const std::string &key, JsonValue &&val) {return insertItem(JsonKey(key), val.takeItem());}
+    std::pair<iterator, bool> insert_or_assign(const char *key, const JsonValue &val) {return insertItem(JsonKey(key, strlen(key)), val.createItem());}
+    std::pair<iterator, bool> insert_or_assign(const char *key, JsonValue &&val) {return insertItem(JsonKey(key, strlen(key)), val.takeItem());}
+    // try_emplace 在 key 已经存在时不做任何事，否则用 args 构造新的值，例如 try_emplace("tags", JsonArray::of("a"))
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const JsonKey &key, Args &&...args)
+    {
+        struct cJSON *curItem = findItem(key);
+        if (curItem) {
+            return std::make_pair(iterator(item_, curItem), false);
+        }
+        return std::make_pair(iterator(item_, appendItem(key, JsonValue(std::forward<Args>(args)...).takeItem())), true);
+    }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const std::string &key, Args &&...args)
+    {
+        return try_emplace(JsonKey(key), std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const char *key, Args &&...args)
+    {
+        return try_emplace(JsonKey(key, strlen(key)), std::forward<Args>(args)...);
+    }
+
+    // 遍历一次同时查找多个 key，结果和参数的顺序一致，key 可以是 JsonKey、std::string 或者 const char*
+    // values 返回的值在 key 不存在时为非法值，findAll 返回的迭代器在 key 不存在时为 end()
+    // 例如 std::array<JsonValue, 3> record = object.values(kId, kName, "tags");
+    template <typename... Keys>
+    std::array<JsonValue, sizeof...(Keys)> values(const Keys &...keys) const
+    {
+        std::array<struct cJSON*, sizeof...(Keys)> items = findItems(keys...);
+        std::array<JsonValue, sizeof...(Keys)> result;
+        for (size_t i = 0; i < items.size(); ++i) {
+            result[i] = JsonValue::copyOf(items[i]);
+        }
+        return result;
+    }
+    template <typename... Keys>
+    std::array<iterator, sizeof...(Keys)> findAll(const Keys &...keys)
+    {
+        std::array<struct cJSON*, sizeof...(Keys)> items = findItems(keys...);
+        std::array<iterator, sizeof...(Keys)> result;
+        for (size_t i = 0; i < items.size(); ++i) {
+            result[i] = iterator(item_, items[i]);
+        }
+        return result;
+    }
+    template <typename... Keys>
+    std::array<const_iterator, sizeof...(Keys)> findAll(const Keys &...keys) const
+    {
+        std::array<struct cJSON*, sizeof...(Keys)> items = findItems(keys...);
+        std::array<const_iterator, sizeof...(Keys)> result;
+        for (size_t i = 0; i < items.size(); ++i) {
+            result[i] = const_iterator(item_, items[i]);
+        }
+        return result;
+    }
+
+    const JsonValueRef operator [] (const JsonKey &key) const;
+    const JsonValueRef operator [] (const std::string &key) const {return operator [] (JsonKey(key));}
+    const JsonValueRef operator [] (const char *key) const {return operator [] (JsonKey(key, strlen(key)));}
+    JsonValueRef operator [] (const JsonKey &key);
+    JsonValueRef operator [] (const std::string &key) {return operator [] (JsonKey(key));}
+    JsonValueRef operator [] (const char *key) {return operator [] (JsonKey(key, strlen(key)));}
+
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    void insert(std::string_view key, const JsonValue &val) {insertItem(JsonKey(key), val.createItem());}
+    void insert(std::string_view key, JsonValue &&val) {insertItem(JsonKey(key), val.takeItem());}
+    JsonValue value(std::string_view key) const {return value(JsonKey(key));}
+    bool contains(std::string_view key) const {return contains(JsonKey(key));}
+    void remove(std::string_view key) {remove(JsonKey(key));}
+    const JsonValueRef operator [] (std::string_view key) const {return operator [] (JsonKey(key));}
+    JsonValueRef operator [] (std::string_view key) {return operator [] (JsonKey(key));}
+    iterator find(std::string_view key) {return find(JsonKey(key));}
+    const_iterator find(std::string_view key) const {return constFind(JsonKey(key));}
+    const_iterator constFind(std::string_view key) const {return constFind(JsonKey(key));}
+    std::pair<iterator, bool> insert_or_assign(std::string_view key, const JsonValue &val) {return insertItem(JsonKey(key), val.createItem());}
+    std::pair<iterator, bool> insert_or_assign(std::string_view key, JsonValue &&val) {return insertItem(JsonKey(key), val.takeItem());}
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(std::string_view key, Args &&...args)
+    {
+        return try_emplace(JsonKey(key), std::forward<Args>(args)...);
+    }
+#endif
 
 private:
     // 内部使用
     JsonObject(struct cJSON *item);
 
+    struct cJSON *findItem(const JsonKey &key) const;
+    void findItems(const cJSON_Key *keys, size_t count, struct cJSON **items) const;
+    template <typename... Keys>
+    std::array<struct cJSON*, sizeof...(Keys)> findItems(const Keys &...keys) const
+    {
+        static_assert(sizeof...(Keys) > 0, "at least one key is required");
+        const cJSON_Key cKeys[] = {keyOf(keys)...};
+        std::array<struct cJSON*, sizeof...(Keys)> items;
+        findItems(cKeys, sizeof...(Keys), items.data());
+        return items;
+    }
+    static cJSON_Key keyOf(const JsonKey &key) {cJSON_Key cKey = {key.data(), key.size(), key.hash()}; return cKey;}
+    static cJSON_Key keyOf(const std::string &key) {return keyOf(JsonKey(key));}
+    static cJSON_Key keyOf(const char *key) {return keyOf(JsonKey(key, strlen(key)));}
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    static cJSON_Key keyOf(std::string_view key) {return keyOf(JsonKey(key));}
+#endif
+    // key 已经存在时替换原来的值，item 的所有权交给 JsonObject
+    std::pair<iterator, bool> insertItem(const JsonKey &key, struct cJSON *item);
+
+    // 不检查 key 是否已经存在，直接添加到末尾
+    void appendItem(const char *key, struct cJSON *item);
+    struct cJSON *appendItem(const JsonKey &key, struct cJSON *item);
+    void insertValues() {}
+    template <typename Value, typename... Args>
+    void insertValues(const char *key, Value &&value, Args &&...args)
+    {
+        appendItem(key, JsonValue(std::forward<Value>(value)).takeItem());
+        insertValues(std::forward<Args>(args)...);
+    }
+    template <typename Value, typename... Args>
+    void insertValues(const std::string &key, Value &&value, Args &&...args)
+    {
+        insertValues(key.c_str(), std::forward<Value>(value), std::forward<Args>(args)...);
+    }
+
     friend class JsonValue;
     friend class JsonDocument;
     friend class JsonValueRef;
@@ -234,6 +628,201 @@ private:
     struct cJSON *item_;
 };
 
+// 解析时保存对象 key 的表，每个不同的 key 只保存一份，节点直接指向表中的 key，不再单独申请内存
+// 可以在多个文档和多个线程之间共用，表中的 key 不会删除，只适合 key 的种类有限的数据
+class JsonKeyTable
+{
+public:
+    JsonKeyTable();
+    ~JsonKeyTable();
+    JsonKeyTable(const JsonKeyTable &) = delete;
+    JsonKeyTable &operator = (const JsonKeyTable &) = delete;
+
+    // 不同的 key 的个数
+    size_t size() const {return cJSON_GetKeyTableSize(table_);}
+
+private:
+    static void lock(void *context);
+    static void unlock(void *context);
+
+    friend class JsonDocument;
+
+    std::mutex mutex_;
+    struct cJSON_KeyTable *table_;
+};
+
+// JsonDocument 的节点和字符串从这里申请，不同的文档可以使用不同的内存，比如每个请求一块，见 JsonDocument::setMemoryResource
+// 文档通过 shared_ptr 持有，用到它的树都释放之后才会析构。交给 JsonReclaimer 的树在回收器的线程中调用 deallocate
+class JsonMemoryResource
+{
+public:
+    JsonMemoryResource();
+    virtual ~JsonMemoryResource() {}
+    JsonMemoryResource(const JsonMemoryResource &) = delete;
+    JsonMemoryResource &operator = (const JsonMemoryResource &) = delete;
+
+    // 返回的内存按任意类型对齐，失败时返回 nullptr，不能抛出异常
+    virtual void *allocate(size_t size) = 0;
+    // pointer 不会是 nullptr
+    virtual void deallocate(void *pointer) = 0;
+
+private:
+    static void *allocateFrom(void *context, size_t size);
+    static void deallocateTo(void *context, void *pointer);
+
+    friend class JsonDocument;
+
+    cJSON_Allocator allocator_;
+};
+
+// 按大小分级的内存池，每个线程在自己的空闲链表中申请和释放，多个线程同时解析时不再争用系统的 malloc
+// 在其他线程中释放的内存攒够一批再一起还给申请它的线程；内存只在析构时还给系统，可以用 reserve 预先申请
+class JsonPoolResource : public JsonMemoryResource
+{
+public:
+    // 每次向系统申请 slabSize 字节再切分，超过最大分级的内存直接使用 malloc
+    explicit JsonPoolResource(size_t slabSize = 256 * 1024);
+
+    void *allocate(size_t size) override;
+    void deallocate(void *pointer) override;
+
+    // 预先向系统申请至少 bytes 字节，各个线程先使用这些内存
+    void reserve(size_t bytes);
+    // 已经向系统申请的 slab 个数
+    size_t slabCount() const;
+
+private:
+    struct Block;
+    struct Cache;
+    struct Shared;
+    struct ThreadCaches;
+
+    // 当前线程使用的缓存，第一次使用时创建或接手已退出线程留下的缓存
+    Cache *localCache();
+    Block *carve(Cache *cache, size_t size);
+    char *takeSlab();
+    static void collectRemote(Cache *cache);
+    static void returnPending(Cache *cache);
+
+    // 线程退出时通过 weak_ptr 判断 resource 是否还在
+    std::shared_ptr<Shared> shared_;
+    // 不会重复使用，线程中记录的缓存按它查找
+    uint64_t id_;
+};
+
+// 替 JsonDocument 释放不再使用的树，很大的文档析构时当前线程只把树交给回收器，不再同步释放整棵树
+// 可以在多个文档和多个线程之间共用，见 JsonDocument::setReclaimer
+class JsonReclaimer
+{
+public:
+    enum Mode {
+        // 由后台线程释放
+        Background,
+        // 由使用者调用 reclaim 分批释放，比如在两个请求之间
+        Incremental
+    };
+
+    explicit JsonReclaimer(Mode mode = Background);
+    // 释放所有还没释放的树
+    ~JsonReclaimer();
+    JsonReclaimer(const JsonReclaimer &) = delete;
+    JsonReclaimer &operator = (const JsonReclaimer &) = delete;
+
+    Mode mode() const {return mode_;}
+    // 最多释放 maxNodes 个节点，返回是否还有没释放的树，parseInto 复用的内存在所有树释放之后一次释放
+    bool reclaim(size_t maxNodes);
+    // 释放目前交给回收器的所有树，Background 模式下等待后台线程释放完
+    void flush();
+
+private:
+    // resource 为树或 pool 所在的内存，释放完之前一直持有
+    void retire(struct cJSON *item, const std::shared_ptr<JsonMemoryResource> &resource);
+    void retire(struct cJSON_Pool *pool, const std::shared_ptr<JsonMemoryResource> &resource);
+    void keep(const std::shared_ptr<JsonMemoryResource> &resource);
+    void run();
+
+    friend class JsonDocument;
+
+    Mode mode_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable idle_;
+    // 待释放的树通过 next 连成一个链表，可以直接交给 cJSON_DeleteSlice
+    struct cJSON *items_;
+    std::vector<struct cJSON_Pool*> pools_;
+    std::vector<std::shared_ptr<JsonMemoryResource>> resources_;
+    // 后台线程正在释放从 items_ 取走的树
+    bool busy_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+// JsonDocument::fromJson 使用的解析选项
+struct JsonParseOptions
+{
+    JsonParseOptions()
+        : maxDepth(CJSON_NESTING_LIMIT)
+        , lazy(false)
+        , internKeys(false)
+        , packNumbers(false)
+    {
+
+    }
+
+    // 数组和对象允许的最大嵌套层数；解析器和文档的拷贝、比较、输出、释放都不递归，
+    // 调大时只需要考虑调用方自己递归遍历时的栈空间
+    size_t maxDepth;
+    // 字符串和数字在第一次读取时才解码，没有读取过的值 toJson 时直接复制原文，
+    // 适合只转发或只读取少量字段的场景，文档会保留一份原文
+    bool lazy;
+    // 相同的 key 只保存一份，适合由结构相同的对象组成的数组，文档会保留 key 表，parseInto 时继续使用
+    // keyTable 不为空时使用 keyTable，多个文档可以共用同一个表
+    bool internKeys;
+    std::shared_ptr<JsonKeyTable> keyTable;
+    // 只包含数字的数组连续保存，不为每个数字创建节点，见 JsonArray::toDoubleSpan
+    bool packNumbers;
+    // 不为空时文档从这里申请内存，见 JsonDocument::setMemoryResource
+    std::shared_ptr<JsonMemoryResource> memoryResource;
+};
+
+// JsonDocument::fromJson 的解析错误信息，参考 QJsonParseError
+// 每次解析单独返回，不依赖 cJSON 内部的全局错误，可以在多个线程中同时解析
+struct JsonParseError
+{
+    enum ParseError {
+        NoError = cJSON_ParseErrorNone,
+        IllegalValue = cJSON_ParseErrorIllegalValue,
+        IllegalNumber = cJSON_ParseErrorIllegalNumber,
+        UnterminatedString = cJSON_ParseErrorUnterminatedString,
+        IllegalEscapeSequence = cJSON_ParseErrorIllegalEscapeSequence,
+        MissingName = cJSON_ParseErrorMissingName,
+        MissingNameSeparator = cJSON_ParseErrorMissingNameSeparator,
+        MissingValueSeparator = cJSON_ParseErrorMissingValueSeparator,
+        UnterminatedArray = cJSON_ParseErrorUnterminatedArray,
+        UnterminatedObject = cJSON_ParseErrorUnterminatedObject,
+        DeepNesting = cJSON_ParseErrorDeepNesting,
+        GarbageAtEnd = cJSON_ParseErrorGarbageAtEnd,
+        AllocationFailure = cJSON_ParseErrorAllocationFailure
+    };
+
+    JsonParseError()
+        : error(NoError)
+        , offset(0)
+        , line(0)
+        , column(0)
+    {
+
+    }
+
+    std::string errorString() const {return cJSON_GetParseErrorString(static_cast<cJSON_ParseError>(error));}
+
+    ParseError error;
+    // 出错的位置，line 和 column 从1开始计数，只在解析失败的时候设置
+    size_t offset;
+    size_t line;
+    size_t column;
+};
+
 class JsonDocument
 {
 public:
@@ -254,10 +843,23 @@ public:
     bool operator != (const JsonDocument &other) const {return !(*this == other);}
     bool operator == (const JsonDocument &other) const;
 
-    const JsonValue operator [] (const std::string &key) const;
+    const JsonValue operator [] (const JsonKey &key) const;
+    const JsonValue operator [] (const std::string &key) const {return operator [] (JsonKey(key));}
+    const JsonValue operator [] (const char *key) const {return operator [] (JsonKey(key, strlen(key)));}
+#ifdef CJSON_WRAPPER_HAS_STRING_VIEW
+    const JsonValue operator [] (std::string_view key) const {return operator [] (JsonKey(key));}
+#endif
     const JsonValue operator [] (int index) const;
 
-    void swap(JsonDocument &other) {std::swap(item_, other.item_);}
+    void swap(JsonDocument &other)
+    {
+        std::swap(item_, other.item_);
+        std::swap(pool_, other.pool_);
+        source_.swap(other.source_);
+        keys_.swap(other.keys_);
+        reclaimer_.swap(other.reclaimer_);
+        resource_.swap(other.resource_);
+    }
 
     bool isNull() const {return item_ == nullptr;}
 
@@ -270,9 +872,55 @@ public:
     void setObject(const JsonObject &object);
 
     static JsonDocument fromJson(const std::string &data, bool *ok = nullptr);
+    static JsonDocument fromJson(const std::string &data, const JsonParseOptions &options, bool *ok = nullptr);
+    static JsonDocument fromJson(const std::string &data, JsonParseError *error);
+    static JsonDocument fromJson(const std::string &data, const JsonParseOptions &options, JsonParseError *error);
+
+    // 复用当前文档的节点和字符串内存解析 data，反复解析结构相近的数据时几乎不再申请内存
+    // 解析失败时文档为空，返回false
+    bool parseInto(const std::string &data, JsonParseError *error = nullptr);
+    bool parseInto(const std::string &data, const JsonParseOptions &options, JsonParseError *error = nullptr);
+    // 清空文档，节点和字符串内存留给下一次 parseInto 使用；放回 pool 在当前线程中完成，
+    // 没有 pool（还没有调用过 parseInto）时和析构一样释放，设置了 reclaimer 时交给 reclaimer
+    void reset();
+    // 把整棵树复制到一块连续的内存中，节点按深度优先的顺序排列，字符串跟在节点后面
+    // 反复修改过的文档节点分散在堆上，空闲时调用可以恢复遍历时的局部性；旧的树按 reset 的方式处理
+    void compact();
+
+    // 设置之后文档析构、赋值、setArray/setObject 以及没有 pool 时的 reset/compact 把旧的树交给 reclaimer 释放，
+    // 拷贝的文档共用同一个 reclaimer
+    // 文档中的节点只属于这个文档，可以在其他线程中释放
+    void setReclaimer(const std::shared_ptr<JsonReclaimer> &reclaimer) {reclaimer_ = reclaimer;}
+    const std::shared_ptr<JsonReclaimer> &reclaimer() const {return reclaimer_;}
+
+    // 设置之后文档中的节点和字符串都从 resource 申请，包括解析、拷贝和 setArray/setObject，当前的树复制过去
+    // 拷贝的文档共用同一个 resource，为空时使用 cJSON_InitHooks 设置的全局函数；从文档中取出的值不使用 resource
+    void setMemoryResource(const std::shared_ptr<JsonMemoryResource> &resource);
+    const std::shared_ptr<JsonMemoryResource> &memoryResource() const {return resource_;}
 
 private:
+    bool parse(const std::string &data, const JsonParseOptions &options, JsonParseError *error);
+    // 复制文档中的值并解码其中延迟解码的部分，复制出去的值不再引用 source_，解码失败时返回 nullptr
+    static struct cJSON *detachItem(const struct cJSON *item);
+    // 释放 item_，设置了 reclaimer_ 时交给 reclaimer_
+    void deleteItem();
+    // 有 pool_ 时把 item_ 放回 pool_，否则 deleteItem
+    void recycleItem();
+    void deletePool();
+    // 在 resource_ 中复制一份 item
+    struct cJSON *copyItem(const struct cJSON *item) const;
+    const cJSON_Allocator *allocator() const {return resource_ ? &resource_->allocator_ : nullptr;}
+
     struct cJSON *item_;
+    // parseInto 复用的内存，第一次 parseInto 时创建，不随拷贝复制
+    struct cJSON_Pool *pool_;
+    // 延迟解码时 item_ 引用的原文，拷贝的文档共用同一份
+    std::shared_ptr<std::string> source_;
+    // internKeys 时 item_ 中的 key 所在的表，拷贝的文档共用同一份
+    std::shared_ptr<JsonKeyTable> keys_;
+    std::shared_ptr<JsonReclaimer> reclaimer_;
+    // item_ 和 pool_ 所在的内存，要比它们后释放
+    std::shared_ptr<JsonMemoryResource> resource_;
 };
 
 std::ostream &operator << (std::ostream &os, const JsonValue &val);
@@ -2,6 +2,8 @@
 #include <climits>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 
 using std::cout;
 using std::endl;
@@ -422,4 +424,1412 @@ TEST(cjson_wrapper, benchmark_test_cjson_wrapper)
     }
 }
 
+TEST(cjson_wrapper, parse_deep_nesting)
+{
+    const int depth = 20000;
+    std::string jsonData(depth, '[');
+    jsonData.append(depth, ']');
+
+    {
+        bool ok = true;
+        JsonDocument::fromJson(jsonData, &ok);
+        ASSERT_FALSE(ok); // 超过默认的 CJSON_NESTING_LIMIT
+    }
+
+    {
+        JsonParseOptions options;
+        options.maxDepth = depth;
+        bool ok = false;
+        JsonDocument document(JsonDocument::fromJson(jsonData, options, &ok));
+        ASSERT_TRUE(ok);
+        ASSERT_TRUE(document.isArray());
+
+        options.maxDepth = depth - 1;
+        JsonDocument::fromJson(jsonData, options, &ok);
+        ASSERT_FALSE(ok);
+    }
+
+    {
+        JsonParseOptions options;
+        options.maxDepth = 2;
+        bool ok = false;
+        JsonDocument document(JsonDocument::fromJson("{\"a\":[1,{\"b\":2}]}", &ok));
+        ASSERT_TRUE(ok);
+        ASSERT_TRUE(document.toJson(JsonDocument::Compact) == "{\"a\":[1,{\"b\":2}]}");
+        JsonDocument::fromJson("{\"a\":[1,{\"b\":2}]}", options, &ok);
+        ASSERT_FALSE(ok);
+        JsonDocument::fromJson("{\"a\":[1,2]}", options, &ok);
+        ASSERT_TRUE(ok);
+    }
+
+    {
+        bool ok = true;
+        const char *invalidJson[] = {"[1,2", "{\"a\":}", "{\"a\" 1}", "[1,]", "{,}", "[}", "{]", "", "[1 2]", "{\"a\":1,}"};
+        for (const char *data : invalidJson) {
+            JsonDocument::fromJson(data, &ok);
+            ASSERT_FALSE(ok) << data;
+        }
+        JsonDocument::fromJson(" [ 1 , { \"a\" : [ ] , \"b\" : { } } ] ", &ok);
+        ASSERT_TRUE(ok);
+    }
+}
+
+TEST(cjson_wrapper, parse_error)
+{
+    {
+        JsonParseError error;
+        JsonDocument document(JsonDocument::fromJson("{\"id\": 1024}", &error));
+        ASSERT_TRUE(error.error == JsonParseError::NoError);
+        ASSERT_TRUE(document.isObject());
+    }
+
+    {
+        JsonParseError error;
+        JsonDocument document(JsonDocument::fromJson("{\n  \"id\": 1024,\n  \"info\" \"hello\"\n}", &error));
+        ASSERT_TRUE(document.isNull());
+        ASSERT_TRUE(error.error == JsonParseError::MissingNameSeparator);
+        ASSERT_EQ(error.line, 3u);
+        ASSERT_EQ(error.column, 10u);
+        ASSERT_EQ(error.offset, 25u);
+        ASSERT_FALSE(error.errorString().empty());
+    }
+
+    {
+        struct {
+            const char *data;
+            JsonParseError::ParseError error;
+        } invalidJson[] = {
+            {"", JsonParseError::IllegalValue},
+            {"[1,]", JsonParseError::IllegalValue},
+            {"[-]", JsonParseError::IllegalNumber},
+            {"[\"hello", JsonParseError::UnterminatedString},
+            {"[\"\\x\"]", JsonParseError::IllegalEscapeSequence},
+            {"{1:2}", JsonParseError::MissingName},
+            {"{\"a\" 1}", JsonParseError::MissingNameSeparator},
+            {"[1 2]", JsonParseError::MissingValueSeparator},
+            {"[1,2", JsonParseError::UnterminatedArray},
+            {"{\"a\":1", JsonParseError::UnterminatedObject},
+        };
+        for (const auto &val : invalidJson) {
+            JsonParseError error;
+            JsonDocument::fromJson(val.data, &error);
+            ASSERT_EQ(error.error, val.error) << val.data;
+        }
+
+        JsonParseOptions options;
+        options.maxDepth = 1;
+        JsonParseError error;
+        JsonDocument::fromJson("[[]]", options, &error);
+        ASSERT_EQ(error.error, JsonParseError::DeepNesting);
+    }
+
+    {
+        // 不同线程的解析错误互不影响
+        std::vector<std::thread> threads;
+        std::vector<int> failures(4, 0);
+        for (int index = 0; index < 4; ++index) {
+            threads.emplace_back([index, &failures]() {
+                const std::string data = std::string(index + 1, ' ') + "[1, 2, }";
+                for (int count = 0; count < 1000; ++count) {
+                    JsonParseError error;
+                    JsonDocument::fromJson(data, &error);
+                    if (error.error != JsonParseError::IllegalValue || error.offset != static_cast<size_t>(index + 8)) {
+                        ++failures[index];
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (int val : failures) {
+            ASSERT_EQ(val, 0);
+        }
+    }
+}
+
+static size_t g_mallocCount = 0;
+
+static void *countingMalloc(size_t size)
+{
+    ++g_mallocCount;
+    return malloc(size);
+}
+
+TEST(cjson_wrapper, parse_into)
+{
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+
+    {
+        const std::string data1 = "{\"id\": 1, \"name\": \"first\", \"tags\": [\"a\", \"bc\"], \"escaped\": \"x\\ny\"}";
+        const std::string data2 = "{\"id\": 2, \"name\": \"second\", \"tags\": [\"def\", \"g\"], \"escaped\": \"\\u00e9\"}";
+
+        JsonDocument doc;
+        ASSERT_TRUE(doc.parseInto(data1));
+        ASSERT_TRUE(doc == JsonDocument::fromJson(data1));
+        ASSERT_TRUE(doc.parseInto(data2));
+        ASSERT_TRUE(doc == JsonDocument::fromJson(data2));
+
+        // 稳定之后反复解析不再申请内存
+        g_mallocCount = 0;
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_TRUE(doc.parseInto(i % 2 ? data1 : data2));
+        }
+        ASSERT_EQ(g_mallocCount, 0u);
+        ASSERT_EQ(doc["id"].toInt(), 1);
+        ASSERT_EQ(doc["name"].toString(), "first");
+        ASSERT_EQ(doc["escaped"].toString(), "x\ny");
+
+        JsonParseError error;
+        ASSERT_FALSE(doc.parseInto("{\"id\": [1, 2", &error));
+        ASSERT_TRUE(doc.isNull());
+        ASSERT_EQ(error.error, JsonParseError::UnterminatedArray);
+        ASSERT_TRUE(doc.parseInto(data2));
+        ASSERT_EQ(doc["tags"].toArray().at(0).toString(), "def");
+
+        // 拷贝和移动后的文档可以正常释放
+        JsonDocument copy(doc);
+        JsonDocument moved(std::move(doc));
+        ASSERT_TRUE(copy == moved);
+        doc.reset();
+        ASSERT_TRUE(doc.isNull());
+        moved.reset();
+        ASSERT_TRUE(moved.isNull());
+        ASSERT_TRUE(moved.parseInto(data1));
+        ASSERT_EQ(moved["id"].toInt(), 1);
+    }
+
+    cJSON_InitHooks(nullptr);
+}
+
+TEST(cjson_wrapper, parse_lazy)
+{
+    JsonParseOptions options;
+    options.lazy = true;
+
+    const std::string data = "{\"price\":1.50,\"big\":1E+2,\"name\":\"caf\\u00e9\\n\",\"list\":[-0.0,\"a\\/b\"]}";
+    {
+        JsonDocument doc(JsonDocument::fromJson(data, options));
+        ASSERT_FALSE(doc.isNull());
+        // 没有读取过的值原样输出
+        ASSERT_EQ(doc.toJson(JsonDocument::Compact), data);
+        ASSERT_TRUE(doc == JsonDocument::fromJson(data));
+
+        ASSERT_EQ(doc["price"].toDouble(), 1.5);
+        ASSERT_EQ(doc["big"].toInt(), 100);
+        ASSERT_EQ(doc["name"].toString(), "caf\xc3\xa9\n");
+        JsonArray list = doc.object().value("list").toArray();
+        ASSERT_EQ(list.at(1).toString(), "a/b");
+        ASSERT_EQ(doc.toJson(JsonDocument::Compact), data);
+
+        // 拷贝出去的值和文档不再有关系
+        JsonDocument copy(doc);
+        JsonObject object = doc.object();
+        doc = JsonDocument();
+        ASSERT_EQ(copy.toJson(JsonDocument::Compact), data);
+        ASSERT_EQ(object.value("name").toString(), "caf\xc3\xa9\n");
+        ASSERT_TRUE(JsonDocument(object) == copy);
+        ASSERT_FALSE(copy == JsonDocument::fromJson("{\"price\":1.5,\"big\":100,\"name\":\"cafe\\n\",\"list\":[0,\"a/b\"]}"));
+    }
+
+    {
+        // 和直接解码报告相同的错误
+        const char *failures[] = {"[\"\\x\"]", "[\"\\ud800\"]", "[\"abc", "[-]", "[-a]", "[1.5.3]", "[1e]",
+                                  "{\"k\":\"\\u\"0e9\"}", "[\"\\ud800\\u\",\"dc00\"]", "[\"\\u12\"]"};
+        for (const char *failure : failures) {
+            JsonParseError lazyError;
+            JsonParseError error;
+            ASSERT_TRUE(JsonDocument::fromJson(failure, options, &lazyError).isNull());
+            ASSERT_TRUE(JsonDocument::fromJson(failure, &error).isNull());
+            ASSERT_EQ(lazyError.error, error.error);
+        }
+        const char *numbers[] = {"[-0.5e-3]", "[1.e5]", "[-.5]", "[12345678901234567890]"};
+        for (const char *number : numbers) {
+            ASSERT_TRUE(JsonDocument::fromJson(number, options) == JsonDocument::fromJson(number));
+        }
+    }
+
+    {
+        JsonDocument doc;
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_TRUE(doc.parseInto(data, options));
+            ASSERT_EQ(doc["list"].toArray().at(0).toDouble(), 0.0);
+        }
+        ASSERT_EQ(doc.toJson(JsonDocument::Compact), data);
+    }
+
+    {
+        // 引用延迟解码的值时，解码出的字符串属于引用自己，随引用一起释放
+        cJSON_ParseOptions parseOptions;
+        cJSON_InitParseOptions(&parseOptions);
+        parseOptions.lazy = true;
+        cJSON *tree = cJSON_ParseWithOptions(data.c_str(), data.size(), &parseOptions, nullptr);
+        ASSERT_TRUE(tree != nullptr);
+        cJSON *holder = cJSON_CreateArray();
+        ASSERT_TRUE(cJSON_AddItemReferenceToArray(holder, cJSON_GetObjectItem(tree, "name")));
+        ASSERT_TRUE(cJSON_AddItemReferenceToArray(holder, cJSON_GetObjectItem(tree, "price")));
+        ASSERT_STREQ(cJSON_GetStringValue(cJSON_GetArrayItem(holder, 0)), "caf\xc3\xa9\n");
+        ASSERT_EQ(cJSON_GetNumberValue(cJSON_GetArrayItem(holder, 1)), 1.5);
+        ASSERT_STREQ(cJSON_GetStringValue(cJSON_GetObjectItem(tree, "name")), "caf\xc3\xa9\n");
+        cJSON_Delete(holder);
+        cJSON_Delete(tree);
+    }
+}
+
+TEST(cjson_wrapper, int64_value)
+{
+    {
+        const std::string data = "{\"max\":9223372036854775807,\"min\":-9223372036854775808,"
+                                 "\"umax\":18446744073709551615,\"id\":9007199254740993,\"zero\":-0,\"double\":-2.5}";
+        JsonDocument doc(JsonDocument::fromJson(data));
+        ASSERT_EQ(doc.toJson(JsonDocument::Compact), data);
+        ASSERT_EQ(doc["max"].toInt64(), INT64_MAX);
+        ASSERT_EQ(doc["min"].toInt64(), INT64_MIN);
+        ASSERT_EQ(doc["umax"].toUInt64(), UINT64_MAX);
+        ASSERT_EQ(doc["umax"].toInt64(), INT64_MAX);
+        ASSERT_EQ(doc["min"].toUInt64(), 0u);
+        ASSERT_EQ(doc["id"].toInt64(), 9007199254740993LL);
+        ASSERT_EQ(doc["id"].toInt(), INT_MAX);
+        ASSERT_EQ(doc["double"].toInt64(), -2);
+        ASSERT_EQ(doc["double"].toUInt64(), 0u);
+        ASSERT_EQ(JsonValue("1").toInt64(7), 7);
+
+        JsonParseOptions options;
+        options.lazy = true;
+        ASSERT_EQ(JsonDocument::fromJson(data, options)["id"].toInt64(), 9007199254740993LL);
+    }
+
+    {
+        // 超过 2^53 的整数也能区分
+        JsonValue id(static_cast<int64_t>(9007199254740993LL));
+        ASSERT_EQ(id.toInt64(), 9007199254740993LL);
+        ASSERT_TRUE(id != JsonValue(static_cast<int64_t>(9007199254740992LL)));
+        ASSERT_TRUE(JsonValue(static_cast<int64_t>(3)) == JsonValue(3.0));
+        ASSERT_EQ(JsonValue(static_cast<uint64_t>(UINT64_MAX)).toUInt64(), UINT64_MAX);
+
+        JsonObject object{{"id", id}, {"small", -42}, {"big", static_cast<uint64_t>(UINT64_MAX)}};
+        ASSERT_EQ(JsonDocument(object).toJson(JsonDocument::Compact),
+                  "{\"id\":9007199254740993,\"small\":-42,\"big\":18446744073709551615}");
+        object["id"] = 1.5;
+        ASSERT_EQ(object["id"].toInt64(), 1);
+        ASSERT_EQ(JsonDocument(object)["id"].toDouble(), 1.5);
+    }
+}
+
+TEST(cjson_wrapper, inline_scalar_value)
+{
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+
+    {
+        // 标量不申请 cJSON 节点
+        g_mallocCount = 0;
+        JsonValue null;
+        JsonValue boolean(true);
+        JsonValue number(3.5);
+        JsonValue integer(static_cast<int64_t>(9007199254740993LL));
+        JsonValue text("short string");
+        JsonValue copy(text);
+        copy = integer;
+        ASSERT_TRUE(copy == integer);
+        ASSERT_TRUE(null.isNull());
+        ASSERT_TRUE(boolean.toBool());
+        ASSERT_EQ(number.toDouble(), 3.5);
+        ASSERT_EQ(number.toInt(), 3);
+        ASSERT_EQ(copy.toInt64(), 9007199254740993LL);
+        ASSERT_EQ(text.toString(), "short string");
+        ASSERT_TRUE(text == JsonValue(std::string("short string")));
+        ASSERT_FALSE(text == number);
+        ASSERT_EQ(g_mallocCount, 0u);
+
+        // 插入容器时每个值只申请一次
+        JsonArray array{1, 2.5, "three", false};
+        ASSERT_EQ(g_mallocCount, 5u); // 数组和4个元素，"three" 保存在节点里
+        g_mallocCount = 0;
+        ASSERT_EQ(array.at(2).toString(), "three");
+        ASSERT_TRUE(array.at(0) == JsonValue(1));
+        ASSERT_TRUE(array.contains(2.5));
+        ASSERT_EQ(g_mallocCount, 0u);
+
+        JsonObject object;
+        object["x"] = 5;
+        object.insert("y", text);
+        ASSERT_EQ(object.value("x").toInt(), 5);
+        ASSERT_EQ(object["y"].toString(), "short string");
+        ASSERT_EQ(JsonDocument(object).toJson(JsonDocument::Compact), "{\"x\":5,\"y\":\"short string\"}");
+
+        // 较长的字符串保存在节点中
+        JsonValue longText(std::string(100, 'a'));
+        ASSERT_EQ(longText.toString(), std::string(100, 'a'));
+        array.append(std::move(longText));
+        ASSERT_TRUE(longText.isUndefined());
+        ASSERT_EQ(array.last().toString(), std::string(100, 'a'));
+    }
+
+    cJSON_InitHooks(nullptr);
+}
+
+TEST(cjson_wrapper, builder)
+{
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+
+    {
+        std::string tagsKey("tags");
+        g_mallocCount = 0;
+        JsonObject object = JsonObject::of("name", "cjson", tagsKey, JsonArray::of("a", "b"), "size", 3);
+        // 对象节点，3个值节点和3个key，数组中的2个节点，短字符串都保存在节点里
+        ASSERT_EQ(g_mallocCount, 9u);
+
+        JsonObject expected{{"name", "cjson"}, {"tags", JsonArray({"a", "b"})}, {"size", 3}};
+        ASSERT_TRUE(object == expected);
+
+        JsonArray nested = JsonArray::of(1, JsonArray::of(2, JsonArray::of(3)), JsonObject::of("k", JsonObject::of()), object);
+        ASSERT_EQ(JsonDocument(nested).toJson(JsonDocument::Compact),
+                  "[1,[2,[3]],{\"k\":{}},{\"name\":\"cjson\",\"tags\":[\"a\",\"b\"],\"size\":3}]");
+        ASSERT_EQ(object.size(), 3); // 左值会被复制，不会被转移
+        ASSERT_TRUE(JsonArray::of().isEmpty());
+    }
+
+    cJSON_InitHooks(nullptr);
+}
+
+TEST(cjson_wrapper, key_overloads)
+{
+    const char *longKey = "a_key_longer_than_the_small_string_buffer";
+    JsonObject object;
+    object.insert(longKey, 1);
+    object.insert(std::string("name"), "cjson");
+    object["size"] = 3;
+
+    ASSERT_TRUE(object.contains(longKey));
+    ASSERT_EQ(object.value(longKey).toInt(), 1);
+    ASSERT_EQ(object[longKey].toInt(), 1);
+
+    // 按长度比较，前缀或者更长的 key 都不匹配
+    ASSERT_FALSE(object.contains("nam"));
+    ASSERT_FALSE(object.contains("names"));
+    ASSERT_FALSE(object.contains(std::string("name\0x", 6)));
+    ASSERT_TRUE(object.value("na").isUndefined());
+
+    // 已经存在的 key 替换值，不改变顺序
+    object.insert(longKey, "replaced");
+    ASSERT_EQ(object.size(), 3);
+    ASSERT_EQ(object.keys().front(), longKey);
+    ASSERT_EQ(object.value(longKey).toString(), "replaced");
+
+    JsonObject root{{"child", object}};
+    JsonValueRef child = root["child"];
+    ASSERT_TRUE(child.contains("size"));
+    ASSERT_FALSE(child.contains("siz"));
+    child["added"] = true;
+    ASSERT_TRUE(root["child"]["added"].toBool());
+
+    object.remove("nam");
+    ASSERT_EQ(object.size(), 3);
+    object.remove("name");
+    ASSERT_FALSE(object.contains("name"));
+
+    JsonDocument doc(root);
+    ASSERT_EQ(doc["child"].toObject().value("size").toInt(), 3);
+    ASSERT_TRUE(doc["chil"].isUndefined());
+
+    // 较长的字符串直接复制到节点中
+    JsonValue text(longKey);
+    ASSERT_EQ(text.toString(), longKey);
+}
+
+TEST(cjson_wrapper, json_key)
+{
+    static constexpr JsonKey kName("name");
+    static constexpr JsonKey kTags("tags");
+    static_assert(kName.size() == 4, "length is computed at compile time");
+    static_assert(JsonKey("Name").hash() == kName.hash(), "hash ignores ASCII case");
+    ASSERT_EQ(kName.hash(), cJSON_HashKey("name", 4));
+    ASSERT_EQ(JsonKey("\xe4\xbd\xa0\xe5\xa5\xbd").hash(), cJSON_HashKey("\xe4\xbd\xa0\xe5\xa5\xbd", 6));
+    char buffer[16] = "id";
+    ASSERT_EQ(JsonKey(buffer).size(), 2u);
+    ASSERT_EQ(JsonKey(std::string("tags")).hash(), kTags.hash());
+
+    bool ok = false;
+    JsonDocument doc = JsonDocument::fromJson("{\"id\":1,\"name\":\"cjson\",\"tags\":[\"a\"]}", &ok);
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(doc[kName].toString(), "cjson");
+    ASSERT_TRUE(doc[JsonKey("nam")].isUndefined());
+
+    JsonObject object = doc.object();
+    ASSERT_TRUE(object.contains(kTags));
+    ASSERT_EQ(object[kTags][0].toString(), "a");
+    ASSERT_EQ(object.value(JsonKey(buffer)).toInt(), 1);
+
+    // 替换值之后新的节点保留 key 的哈希值
+    object[kName] = JsonArray::of(1, 2);
+    object.insert(kTags, "b");
+    ASSERT_EQ(object.size(), 3);
+    ASSERT_EQ(object.value(kName).toArray().size(), 2);
+    ASSERT_EQ(object.value("tags").toString(), "b");
+
+    JsonObject root{{"child", object}};
+    JsonValueRef child = root["child"];
+    ASSERT_TRUE(child.contains(kName));
+    child[kTags] = 5;
+    ASSERT_EQ(root["child"][kTags].toInt(), 5);
+
+    object.remove(kName);
+    ASSERT_FALSE(object.contains(kName));
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"id", "tags"}));
+}
+
+TEST(cjson_wrapper, key_case)
+{
+    JsonObject object{{"name", "cjson"}};
+    object.insert("Name", "upper");
+    object["NAME"] = 3;
+
+#ifdef CJSON_WRAPPER_CASE_SENSITIVE
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"name", "Name", "NAME"}));
+    ASSERT_EQ(object.value("name").toString(), "cjson");
+    ASSERT_EQ(object.value("Name").toString(), "upper");
+    ASSERT_FALSE(object.contains("nAme"));
+    object.remove("NAME");
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"name", "Name"}));
+#else
+    // 不区分大小写时都是同一个 key，保留第一次插入时的写法
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"name"}));
+    ASSERT_EQ(object.value("nAme").toInt(), 3);
+    object.remove("NAME");
+    ASSERT_TRUE(object.isEmpty());
+#endif
+
+    // cJSON_Compare 本来就区分大小写
+    ASSERT_FALSE(JsonObject({{"a", 1}}) == JsonObject({{"A", 1}}));
+}
+
+TEST(cjson_wrapper, object_find)
+{
+    JsonObject object{{"id", 1}, {"name", "cjson"}, {"tags", JsonArray({"a", "b"})}};
+
+    std::vector<std::string> keys;
+    for (JsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+        keys.push_back(it.key());
+    }
+    ASSERT_EQ(keys, object.keys());
+
+    JsonObject::iterator it = object.find("name");
+    ASSERT_TRUE(it != object.end());
+    ASSERT_EQ(it.value().toString(), "cjson");
+    ASSERT_TRUE(object.find("nam") == object.end());
+    ASSERT_TRUE(static_cast<const JsonObject &>(object).find("id") == object.constFind(JsonKey("id")));
+
+    // 通过迭代器修改值，节点不变，迭代器仍然有效
+    it.value() = JsonObject{{"first", "c"}};
+    ASSERT_EQ(it.key(), "name");
+    ASSERT_EQ((*it).toObject().value("first").toString(), "c");
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"id", "name", "tags"}));
+
+    std::pair<JsonObject::iterator, bool> ret = object.insert_or_assign("id", 2);
+    ASSERT_FALSE(ret.second);
+    ASSERT_EQ(ret.first.value().toInt(), 2);
+    ret = object.insert_or_assign(std::string("size"), 3);
+    ASSERT_TRUE(ret.second);
+    ASSERT_EQ(ret.first.key(), "size");
+    ASSERT_EQ(object.size(), 4);
+
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    // key 已经存在时不会构造新的值
+    ret = object.try_emplace("tags", std::string(100, 'x'));
+    ASSERT_FALSE(ret.second);
+    ASSERT_EQ(g_mallocCount, 0u);
+    ASSERT_TRUE(ret.first.value().isArray());
+    ret = object.try_emplace("empty");
+    ASSERT_TRUE(ret.second);
+    ASSERT_TRUE(object.value("empty").isNull());
+    ret = object.try_emplace(JsonKey("list"), JsonArray::of(1, 2));
+    ASSERT_TRUE(ret.second);
+    ASSERT_EQ(object.value("list").toArray().size(), 2);
+    cJSON_InitHooks(nullptr);
+
+    for (JsonObject::iterator iter = object.begin(); iter != object.end();) {
+        if (iter.value().isArray()) {
+            iter = object.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    ASSERT_EQ(object.keys(), std::vector<std::string>({"id", "name", "size", "empty"}));
+}
+
+TEST(cjson_wrapper, object_values)
+{
+    static constexpr JsonKey kId("id");
+    JsonObject object{{"id", 7}, {"name", "cjson"}, {"tags", JsonArray({"a"})}, {"size", 3}};
+
+    std::array<JsonValue, 4> record = object.values(kId, "size", std::string("tags"), "missing");
+    ASSERT_EQ(record[0].toInt(), 7);
+    ASSERT_EQ(record[1].toInt(), 3);
+    ASSERT_EQ(record[2].toArray().size(), 1);
+    ASSERT_TRUE(record[3].isUndefined());
+
+    // 同一个 key 可以出现多次
+    std::array<JsonValue, 2> twice = object.values("name", "name");
+    ASSERT_EQ(twice[0].toString(), "cjson");
+    ASSERT_EQ(twice[1].toString(), "cjson");
+
+    std::array<JsonObject::iterator, 2> its = object.findAll("tags", "nothing");
+    ASSERT_TRUE(its[1] == object.end());
+    its[0].value() = "replaced";
+    ASSERT_EQ(object.value("tags").toString(), "replaced");
+
+    const JsonObject &constObject = object;
+    std::array<JsonObject::const_iterator, 1> constIts = constObject.findAll(kId);
+    ASSERT_EQ(constIts[0].key(), "id");
+
+    // 解析出来的对象有重复的 key 时和 value 一样返回第一个
+    bool ok = false;
+    JsonObject parsed = JsonDocument::fromJson("{\"k\":1,\"k\":2}", &ok).object();
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(parsed.values("k")[0].toInt(), parsed.value("k").toInt());
+}
 
+TEST(cjson_wrapper, intern_keys)
+{
+    // cJSON 接口：相同的 key 指向表中的同一份
+    cJSON_KeyTable *table = cJSON_CreateKeyTable(nullptr, nullptr, nullptr);
+    cJSON_ParseOptions parseOptions;
+    cJSON_InitParseOptions(&parseOptions);
+    parseOptions.keys = table;
+    const char text[] = "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"n\\u0061me\":\"b\"}]";
+    cJSON *root = cJSON_ParseWithOptions(text, sizeof(text), &parseOptions, nullptr);
+    ASSERT_TRUE(root != nullptr);
+    cJSON *first = cJSON_GetArrayItem(root, 0);
+    cJSON *second = cJSON_GetArrayItem(root, 1);
+    ASSERT_EQ(cJSON_GetObjectItem(first, "name")->string, cJSON_GetObjectItem(second, "name")->string);
+    ASSERT_TRUE(cJSON_GetObjectItem(first, "id")->type & cJSON_StringIsInterned);
+    ASSERT_EQ(cJSON_GetKeyTableSize(table), 2u);
+    ASSERT_EQ(cJSON_InternKey(table, "id", 2), first->child->string);
+
+    // cJSON_Decode 之后不再引用 key 表
+    cJSON *copy = cJSON_Duplicate(root, 1);
+    ASSERT_TRUE(cJSON_Decode(copy));
+    cJSON_Delete(root);
+    cJSON_DeleteKeyTable(table);
+    ASSERT_FALSE(cJSON_GetArrayItem(copy, 0)->child->type & cJSON_StringIsInterned);
+    ASSERT_EQ(cJSON_GetObjectItem(cJSON_GetArrayItem(copy, 1), "name")->valuestring, std::string("b"));
+    cJSON_Delete(copy);
+
+    std::string json = "[";
+    for (int i = 0; i < 1000; ++i) {
+        json += (i ? ",{" : "{");
+        json += "\"id\":" + std::to_string(i) + ",\"value\":true,\"description\":null}";
+    }
+    json += "]";
+
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    JsonParseOptions options;
+    g_mallocCount = 0;
+    JsonDocument::fromJson(json, options);
+    size_t plainCount = g_mallocCount;
+
+    options.internKeys = true;
+    g_mallocCount = 0;
+    JsonArray array;
+    {
+        JsonDocument doc = JsonDocument::fromJson(json, options);
+        // 每个对象的3个 key 不再单独申请内存
+        ASSERT_LE(g_mallocCount + 3000, plainCount + 10);
+        ASSERT_EQ(doc[999].toObject().value("id").toInt(), 999);
+        array = doc.array();
+    }
+    cJSON_InitHooks(nullptr);
+    // 文档销毁之后复制出来的值仍然可以使用
+    ASSERT_EQ(array.size(), 1000);
+    ASSERT_TRUE(array.last().toObject().value("value").toBool());
+
+    // 多个线程中的文档共用一个 key 表
+    options.keyTable = std::make_shared<JsonKeyTable>();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&options, &json]() {
+            JsonDocument doc;
+            for (int n = 0; n < 5; ++n) {
+                ASSERT_TRUE(doc.parseInto(json, options));
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(options.keyTable->size(), 3u);
+}
+
+TEST(cjson_wrapper, predicted_keys)
+{
+    // 后面的对象按前一个对象的 key 顺序预测 key
+    const char text[] = "[{\"id\":1,\"name\":\"a\",\"a\\\"b\":1},"
+                        "{\"id\":2,\"n\\u0061me\":\"b\",\"a\\\"b\":2},"
+                        "{\"id\":3,\"nam\":\"c\",\"Name\":3},"
+                        "{\"id\":4,\"names\":\"d\",\"x\":{\"id\":5}}]";
+    cJSON *root = cJSON_Parse(text);
+    ASSERT_TRUE(root != nullptr);
+    char *printed = cJSON_PrintUnformatted(root);
+    ASSERT_EQ(std::string(printed), "[{\"id\":1,\"name\":\"a\",\"a\\\"b\":1},{\"id\":2,\"name\":\"b\",\"a\\\"b\":2},"
+                                    "{\"id\":3,\"nam\":\"c\",\"Name\":3},{\"id\":4,\"names\":\"d\",\"x\":{\"id\":5}}]");
+    cJSON_free(printed);
+    for (cJSON *item = root->child->next; item != nullptr; item = item->next) {
+        ASSERT_TRUE(item->child->string != root->child->child->string);
+        ASSERT_EQ(cJSON_GetObjectItemCaseSensitive(item, "id"), item->child);
+    }
+    ASSERT_EQ(cJSON_GetObjectItem(cJSON_GetArrayItem(root, 1), "a\"b")->valueint, 2);
+    ASSERT_EQ(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(root, 2), "Name")->valueint, 3);
+    ASSERT_EQ(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(root, 3), "names")->valuestring, std::string("d"));
+    cJSON_Delete(root);
+
+    // 与 key 表一起使用时仍然共用表中的 key
+    cJSON_KeyTable *table = cJSON_CreateKeyTable(nullptr, nullptr, nullptr);
+    cJSON_ParseOptions parseOptions;
+    cJSON_InitParseOptions(&parseOptions);
+    parseOptions.keys = table;
+    root = cJSON_ParseWithOptions(text, sizeof(text), &parseOptions, nullptr);
+    ASSERT_TRUE(root != nullptr);
+    ASSERT_EQ(cJSON_GetArrayItem(root, 3)->child->string, root->child->child->string);
+    ASSERT_EQ(cJSON_GetObjectItem(cJSON_GetArrayItem(root, 1), "name")->string, cJSON_GetObjectItem(root->child, "name")->string);
+    ASSERT_TRUE(cJSON_GetArrayItem(root, 2)->child->type & cJSON_StringIsInterned);
+    ASSERT_EQ(cJSON_GetKeyTableSize(table), 7u);
+    cJSON_Delete(root);
+    cJSON_DeleteKeyTable(table);
+}
+
+TEST(cjson_wrapper, packed_arrays)
+{
+    // 只包含数字的数组连续保存
+    JsonParseOptions options;
+    options.packNumbers = true;
+    const std::string text = "{\"values\":[1,2.5,-3,9007199254740992],\"mixed\":[1,\"two\"],\"nested\":[[1,2],[]],\"big\":[9007199254740993]}";
+    JsonDocument doc = JsonDocument::fromJson(text, options);
+    ASSERT_EQ(doc.toJson(JsonDocument::Compact), text);
+    JsonObject object = doc.object();
+    JsonArray values = object.value("values").toArray();
+    ASSERT_TRUE(values.isPacked());
+    ASSERT_FALSE(object.value("mixed").toArray().isPacked());
+    ASSERT_TRUE(object.value("nested").toArray().at(0).toArray().isPacked());
+    ASSERT_FALSE(object.value("big").toArray().isPacked());
+    // 重复解析时数组的节点放回文档的缓存中
+    ASSERT_TRUE(doc.parseInto(text, options));
+    ASSERT_TRUE(doc.parseInto(text, options));
+    ASSERT_EQ(doc.toJson(JsonDocument::Compact), text);
+    ASSERT_EQ(object.value("big").toArray().first().toUInt64(), 9007199254740993ULL);
+
+    JsonDoubleSpan span = values.toDoubleSpan();
+    ASSERT_EQ(span.size(), 4u);
+    ASSERT_EQ(span[1], 2.5);
+    ASSERT_EQ(span[3], 9007199254740992.0);
+    ASSERT_EQ(values.size(), 4);
+    ASSERT_EQ(values.at(2).toInt(), -3);
+    ASSERT_EQ(values.last().toInt64(), 9007199254740992LL);
+    ASSERT_TRUE(values.contains(2.5));
+    ASSERT_TRUE(values.isPacked());
+
+    // 与普通节点保存的数组比较
+    JsonArray nodes = JsonArray::of(1, 2.5, -3, static_cast<int64_t>(9007199254740992LL));
+    ASSERT_FALSE(nodes.isPacked());
+    ASSERT_TRUE(nodes == values);
+    ASSERT_TRUE(values == nodes);
+    ASSERT_TRUE(JsonArray(values) == values);
+
+    // 修改时转换回普通节点
+    values.append("four");
+    ASSERT_FALSE(values.isPacked());
+    ASSERT_TRUE(values.toDoubleSpan().empty());
+    ASSERT_EQ(JsonDocument(values).toJson(JsonDocument::Compact), "[1,2.5,-3,9007199254740992,\"four\"]");
+    values.removeLast();
+    ASSERT_EQ(values.toDoubleSpan().size(), 4u);
+    values[0] = 10;
+    ASSERT_FALSE(values.isPacked());
+    ASSERT_EQ(values.first().toInt(), 10);
+
+    // 一百万个 double 只申请一块内存
+    std::vector<double> numbers(1000000);
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = i * 0.5;
+    }
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    JsonArray packed = JsonArray::fromDoubles(numbers);
+    ASSERT_LE(g_mallocCount, 2u);
+    cJSON_InitHooks(nullptr);
+    ASSERT_EQ(packed.size(), 1000000);
+    ASSERT_EQ(packed.toDoubleSpan().data()[999999], 499999.5);
+    double sum = 0;
+    for (double number : packed.toDoubleSpan()) {
+        sum += number;
+    }
+    ASSERT_EQ(sum, 249999750000.0);
+    ASSERT_TRUE(JsonArray::fromDoubles(nullptr, 0).isEmpty());
+
+    // -0 打包之后仍然是 -0
+    const std::string zeros = "[-0,1,2,-0.0,0]";
+    JsonDocument signedZeros = JsonDocument::fromJson(zeros, options);
+    ASSERT_TRUE(signedZeros.array().isPacked());
+    ASSERT_EQ(signedZeros.toJson(JsonDocument::Compact), JsonDocument::fromJson(zeros).toJson(JsonDocument::Compact));
+    ASSERT_EQ(signedZeros.toJson(JsonDocument::Compact), "[-0,1,2,-0,0]");
+    cJSON *unpacked = cJSON_Parse(zeros.c_str());
+    ASSERT_TRUE(cJSON_PackArray(unpacked));
+    ASSERT_TRUE(cJSON_UnpackArray(unpacked));
+    char *zeroText = cJSON_PrintUnformatted(unpacked);
+    ASSERT_STREQ(zeroText, "[-0,1,2,-0,0]");
+    cJSON_free(zeroText);
+    cJSON_Delete(unpacked);
+
+    // 引用打包的数组时复制数字，读取和修改引用不会释放原数组的内存
+    const double three[] = {1, 2, 3};
+    cJSON *source = cJSON_CreatePackedDoubleArray(three, 3);
+    cJSON *holder = cJSON_CreateArray();
+    ASSERT_TRUE(cJSON_AddItemReferenceToArray(holder, source));
+    ASSERT_TRUE(cJSON_AddItemReferenceToArray(holder, source));
+    cJSON *reference = cJSON_GetArrayItem(holder, 0);
+    ASSERT_EQ(cJSON_GetNumberValue(cJSON_GetArrayItem(reference, 1)), 2.0);
+    ASSERT_TRUE(cJSON_AddItemToArray(reference, cJSON_CreateNumber(4)));
+    ASSERT_TRUE(cJSON_GetPackedArrayData(source) != nullptr);
+    char *printed = cJSON_PrintUnformatted(source);
+    ASSERT_STREQ(printed, "[1,2,3]");
+    cJSON_free(printed);
+    printed = cJSON_PrintUnformatted(holder);
+    ASSERT_STREQ(printed, "[[1,2,3,4],[1,2,3]]");
+    cJSON_free(printed);
+    cJSON_Pool *pool = cJSON_CreatePool();
+    cJSON_DeleteToPool(pool, holder);
+    cJSON_DeletePool(pool);
+    ASSERT_EQ(cJSON_GetArraySize(source), 3);
+    cJSON_Delete(source);
+}
+
+// 通过下标和链表读到的元素必须一致
+static void checkIndexed(const cJSON *array)
+{
+    int index = 0;
+    for (const cJSON *item = array->child; item != nullptr; item = item->next, ++index) {
+        ASSERT_EQ(cJSON_GetArrayItem(array, index), item);
+    }
+    ASSERT_EQ(cJSON_GetArraySize(array), index);
+    ASSERT_TRUE(cJSON_GetArrayItem(array, index) == nullptr);
+}
+
+TEST(cjson_wrapper, indexed_children)
+{
+    // 访问较靠后的元素时自动建立索引
+    std::string json = "[";
+    for (int i = 0; i < 100; ++i) {
+        json += (i ? "," : "") + std::to_string(i);
+    }
+    json += "]";
+    cJSON *root = cJSON_Parse(json.c_str());
+    ASSERT_FALSE(root->type & cJSON_IsIndexed);
+    ASSERT_EQ(cJSON_GetArrayItem(root, 50)->valueint, 50);
+    ASSERT_TRUE(root->type & cJSON_IsIndexed);
+    checkIndexed(root);
+
+    // 插入、删除和替换之后索引和链表一致
+    cJSON_InsertItemInArray(root, 0, cJSON_CreateString("first"));
+    cJSON_InsertItemInArray(root, 60, cJSON_CreateString("sixty"));
+    cJSON_InsertItemInArray(root, 1000, cJSON_CreateString("last"));
+    cJSON_DeleteItemFromArray(root, 30);
+    cJSON_ReplaceItemInArray(root, 40, cJSON_CreateNull());
+    cJSON_AddItemToArray(root, cJSON_CreateTrue());
+    ASSERT_TRUE(root->type & cJSON_IsIndexed);
+    checkIndexed(root);
+    ASSERT_EQ(cJSON_GetArraySize(root), 103);
+    ASSERT_EQ(cJSON_GetArrayItem(root, 0)->valuestring, std::string("first"));
+    ASSERT_EQ(cJSON_GetArrayItem(root, 59)->valuestring, std::string("sixty"));
+    ASSERT_TRUE(cJSON_IsNull(cJSON_GetArrayItem(root, 40)));
+    ASSERT_TRUE(cJSON_IsTrue(cJSON_GetArrayItem(root, 102)));
+
+    // 复制和引用不共用索引
+    cJSON *copy = cJSON_Duplicate(root, 1);
+    ASSERT_FALSE(copy->type & cJSON_IsIndexed);
+    ASSERT_TRUE(cJSON_Compare(root, copy, 1));
+    cJSON *container = cJSON_CreateArray();
+    cJSON_AddItemReferenceToArray(container, root);
+    ASSERT_EQ(cJSON_GetArraySize(container->child), 103);
+    cJSON_Delete(container);
+    cJSON_Delete(copy);
+    cJSON_ShrinkArray(root);
+    checkIndexed(root);
+    while (cJSON_GetArraySize(root) > 0) {
+        cJSON_DeleteItemFromArray(root, cJSON_GetArraySize(root) / 2);
+    }
+    checkIndexed(root);
+    cJSON_Delete(root);
+
+    // JsonArray::reserve 之后追加不重新分配
+    JsonArray array;
+    array.reserve(100);
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    for (int i = 0; i < 100; ++i) {
+        array.append(i);
+    }
+    ASSERT_EQ(g_mallocCount, 100u);
+    cJSON_InitHooks(nullptr);
+    array.shrink_to_fit();
+    ASSERT_EQ(array.size(), 100);
+    ASSERT_EQ(array.at(99).toInt(), 99);
+    array[98] = "ninety-eight";
+    ASSERT_EQ(array.at(98).toString(), "ninety-eight");
+    ASSERT_EQ(array.takeAt(0).toInt(), 0);
+    ASSERT_EQ(array.first().toInt(), 1);
+    ASSERT_EQ(array.toDoubleSpan().size(), 0u);
+    array.removeAt(97);
+    ASSERT_EQ(array.toDoubleSpan().size(), 98u);
+    ASSERT_EQ(array.at(97).toInt(), 99);
+
+    JsonObject object;
+    object.reserve(20);
+    for (int i = 0; i < 20; ++i) {
+        object.insert("k" + std::to_string(i), i);
+    }
+    object.remove("k3");
+    ASSERT_EQ(object.size(), 19);
+    ASSERT_EQ(object.value("k19").toInt(), 19);
+}
+
+TEST(cjson_wrapper, string_length)
+{
+    // cJSON 设置字符串时同时保存长度
+    cJSON *root = cJSON_Parse("[\"abc\",\"a\\u0000b\",\"\\u00e9t\\u00e9\",\"\"]");
+    ASSERT_TRUE(root != nullptr);
+    ASSERT_TRUE(cJSON_GetArrayItem(root, 0)->type & cJSON_StringHasLength);
+    ASSERT_EQ(cJSON_GetStringLength(cJSON_GetArrayItem(root, 0)), 3u);
+    ASSERT_EQ(cJSON_GetStringLength(cJSON_GetArrayItem(root, 1)), strlen(cJSON_GetArrayItem(root, 1)->valuestring));
+    ASSERT_EQ(cJSON_GetStringLength(cJSON_GetArrayItem(root, 2)), 5u);
+    ASSERT_EQ(cJSON_GetStringLength(cJSON_GetArrayItem(root, 3)), 0u);
+    ASSERT_EQ(cJSON_GetStringLength(root), 0u);
+
+    cJSON *item = cJSON_GetArrayItem(root, 0);
+    cJSON_SetValuestring(item, "x");
+    ASSERT_EQ(cJSON_GetStringLength(item), 1u);
+    cJSON_SetValuestring(item, "a longer value");
+    ASSERT_EQ(cJSON_GetStringLength(item), 14u);
+    cJSON *other = cJSON_CreateStringWithLength("a longer value\0tail", 19);
+    ASSERT_EQ(cJSON_GetStringLength(other), 14u);
+    ASSERT_TRUE(cJSON_Compare(item, other, 1));
+    cJSON_SetValuestring(other, "a longer valuE");
+    ASSERT_FALSE(cJSON_Compare(item, other, 1));
+    cJSON_Delete(other);
+
+    // 没有保存长度的字符串仍然可以比较和复制
+    cJSON *reference = cJSON_CreateStringReference("a longer value");
+    ASSERT_FALSE(reference->type & cJSON_StringHasLength);
+    ASSERT_TRUE(cJSON_Compare(item, reference, 1));
+    cJSON *copy = cJSON_Duplicate(reference, 1);
+    ASSERT_EQ(cJSON_GetStringLength(copy), 14u);
+    cJSON_Delete(copy);
+    cJSON_Delete(reference);
+    cJSON_Delete(root);
+
+    // 对象的 key 解析之后不保留长度
+    root = cJSON_Parse("{\"key\":null,\"text\":\"some longer text value\"}");
+    ASSERT_FALSE(root->child->type & cJSON_StringHasLength);
+    ASSERT_EQ(root->child->valueint, 0);
+    ASSERT_EQ(cJSON_GetStringLength(root->child->next), 22u);
+    cJSON_Delete(root);
+
+    JsonParseOptions options;
+    options.lazy = true;
+    JsonDocument doc = JsonDocument::fromJson("{\"key\":null,\"text\":\"some longer text value\"}", options);
+    ASSERT_EQ(doc["text"].toString(), "some longer text value");
+    ASSERT_EQ(doc["key"].toString("default"), "default");
+    ASSERT_EQ(doc.object().value("text").toString(), "some longer text value");
+}
+
+TEST(cjson_wrapper, inline_strings)
+{
+    // 短字符串直接存在节点里，不另外分配
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    cJSON *root = cJSON_Parse("[\"a\",\"seven!!\",\"eight!!!\",\"\"]");
+    ASSERT_TRUE(root != nullptr);
+    ASSERT_EQ(g_mallocCount, 6u);
+    cJSON *shortItem = cJSON_GetArrayItem(root, 0);
+    cJSON *longItem = cJSON_GetArrayItem(root, 2);
+    ASSERT_TRUE(shortItem->type & cJSON_StringIsInline);
+    ASSERT_EQ(shortItem->valuestring, cJSON_InlineString(shortItem));
+    ASSERT_TRUE(cJSON_GetArrayItem(root, 1)->type & cJSON_StringIsInline);
+    ASSERT_STREQ(cJSON_GetArrayItem(root, 1)->valuestring, "seven!!");
+    ASSERT_FALSE(longItem->type & cJSON_StringIsInline);
+    ASSERT_STREQ(longItem->valuestring, "eight!!!");
+    ASSERT_TRUE(cJSON_GetArrayItem(root, 3)->type & cJSON_StringIsInline);
+
+    g_mallocCount = 0;
+    cJSON *created = cJSON_CreateString("short");
+    ASSERT_EQ(g_mallocCount, 1u);
+    ASSERT_TRUE(created->type & cJSON_StringIsInline);
+    cJSON_InitHooks(nullptr);
+
+    // 变长时移到堆上，变短时再放回节点里
+    cJSON_SetValuestring(created, "a value that does not fit");
+    ASSERT_FALSE(created->type & cJSON_StringIsInline);
+    ASSERT_STREQ(created->valuestring, "a value that does not fit");
+    cJSON_SetValuestring(created, "tiny");
+    ASSERT_STREQ(created->valuestring, "tiny");
+    cJSON_SetValuestring(longItem, "short");
+    ASSERT_STREQ(longItem->valuestring, "short");
+    cJSON_SetValuestring(shortItem, "still");
+    ASSERT_TRUE(shortItem->type & cJSON_StringIsInline);
+    ASSERT_STREQ(shortItem->valuestring, "still");
+    cJSON_Delete(created);
+
+    cJSON *copy = cJSON_Duplicate(root, 1);
+    ASSERT_TRUE(cJSON_Compare(root, copy, 1));
+    ASSERT_TRUE(copy->child->type & cJSON_StringIsInline);
+    ASSERT_EQ(copy->child->valuestring, cJSON_InlineString(copy->child));
+    cJSON_Delete(root);
+    char *printed = cJSON_PrintUnformatted(copy);
+    ASSERT_STREQ(printed, "[\"still\",\"seven!!\",\"short\",\"\"]");
+    cJSON_free(printed);
+    cJSON_Delete(copy);
+
+    // 通过 JsonValueRef 赋值时节点的值被换过来，字符串仍然完整
+    JsonObject object = JsonDocument::fromJson("{\"a\":\"first\",\"b\":1}").object();
+    object["b"] = JsonValue(object["a"]);
+    object["a"] = JsonValue("second");
+    ASSERT_EQ(object["a"].toString(), "second");
+    ASSERT_EQ(object["b"].toString(), "first");
+    object["a"] = JsonValue(2);
+    ASSERT_EQ(object["a"].toInt(), 2);
+    ASSERT_EQ(JsonDocument(object).toJson(JsonDocument::Compact), "{\"a\":2,\"b\":\"first\"}");
+}
+
+TEST(cjson_wrapper, flat_copy)
+{
+    std::string text = "[";
+    for (int i = 0; i < 100; ++i) {
+        text += (i == 0 ? "" : ",");
+        text += "{\"id\":" + std::to_string(i) + ",\"name\":\"a name longer than the inline size\",\"tags\":[\"x\",true,null]}";
+    }
+    text += "]";
+    cJSON *root = cJSON_Parse(text.c_str());
+    ASSERT_TRUE(root != nullptr);
+
+    // 所有节点和字符串只申请一次
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    cJSON *copy = cJSON_DuplicateFlat(root);
+    ASSERT_EQ(g_mallocCount, 1u);
+    cJSON_InitHooks(nullptr);
+    ASSERT_TRUE(cJSON_Compare(root, copy, 1));
+    cJSON *first = copy->child;
+    ASSERT_TRUE(first->type & cJSON_IsFlat);
+    ASSERT_TRUE(first->child->type & cJSON_StringIsConst);
+    ASSERT_TRUE(first->child->next->type & cJSON_StringIsFlat);
+    ASSERT_EQ(copy->child->prev, cJSON_GetArrayItem(copy, 99));
+    cJSON_Delete(root);
+
+    // 拷贝可以像普通的树一样修改，取出的节点在拷贝删除后仍然有效
+    cJSON *name = cJSON_GetObjectItem(first, "name");
+    ASSERT_TRUE(cJSON_SetValuestring(name, "a name that is longer than the one before") != nullptr);
+    ASSERT_FALSE(name->type & cJSON_StringIsFlat);
+    cJSON *detached = cJSON_DetachItemFromArray(copy, 1);
+    cJSON *keyCopy = cJSON_Duplicate(cJSON_GetObjectItem(detached, "tags"), 1);
+    cJSON_AddItemToObject(detached, "more", cJSON_CreateString("a string allocated on its own"));
+    cJSON_DeleteItemFromArray(copy, 5);
+    cJSON_Delete(copy);
+    ASSERT_EQ(cJSON_GetObjectItem(detached, "id")->valueint, 1);
+    ASSERT_STREQ(cJSON_GetObjectItem(detached, "name")->valuestring, "a name longer than the inline size");
+    ASSERT_STREQ(keyCopy->string, "tags");
+    cJSON_Delete(keyCopy);
+    cJSON_Delete(detached);
+
+    // 拷贝的值移到其他节点
+    JsonObject source = JsonDocument::fromJson("{\"text\":\"a string value that is long enough\",\"list\":[1,2,3]}").object();
+    JsonObject target;
+    target["slot"] = 0;
+    {
+        JsonObject copied(source);
+        target["slot"] = copied.value("text");
+        target["list"] = copied.value("list");
+    }
+    ASSERT_EQ(target["slot"].toString(), "a string value that is long enough");
+    ASSERT_EQ(JsonDocument(target).toJson(JsonDocument::Compact), "{\"slot\":\"a string value that is long enough\",\"list\":[1,2,3]}");
+
+    // 拷贝的节点不回到 pool 中
+    cJSON *parsed = cJSON_Parse("{\"a\":[\"a string value that is long enough\",2]}");
+    cJSON *flat = cJSON_DuplicateFlat(parsed);
+    cJSON_Delete(parsed);
+    cJSON_Pool *pool = cJSON_CreatePool();
+    cJSON_DeleteToPool(pool, flat);
+    cJSON_DeletePool(pool);
+}
+
+TEST(cjson_wrapper, deep_nesting)
+{
+    // 不经过解析器构造的树没有嵌套层数限制，遍历树的函数都不递归
+    const int depth = 200000;
+    cJSON *root = cJSON_CreateArray();
+    cJSON *current = root;
+    for (int i = 0; i < depth; ++i) {
+        cJSON *child = (i % 2) ? cJSON_CreateArray() : cJSON_CreateObject();
+        if ((current->type & 0xFF) == cJSON_Object) {
+            cJSON_AddItemToObject(current, "k", child);
+        } else {
+            cJSON_AddItemToArray(current, child);
+        }
+        current = child;
+    }
+    cJSON_AddItemToObject(current, "leaf", cJSON_CreateString("a string value that is long enough"));
+
+    char *printed = cJSON_PrintUnformatted(root);
+    ASSERT_TRUE(printed != nullptr);
+    ASSERT_EQ(strncmp(printed, "[{\"k\":[{\"k\":", 12), 0);
+    cJSON *parsed = cJSON_ParseWithOpts(printed, nullptr, 0);
+    ASSERT_TRUE(parsed == nullptr); // 超过了解析器的嵌套限制
+    cJSON_free(printed);
+
+    cJSON *copy = cJSON_Duplicate(root, 1);
+    cJSON *flat = cJSON_DuplicateFlat(root);
+    ASSERT_TRUE(cJSON_Compare(root, copy, 1));
+    ASSERT_TRUE(cJSON_Compare(flat, root, 0));
+    cJSON_SetValuestring(current->child, "changed");
+    ASSERT_FALSE(cJSON_Compare(root, copy, 1));
+    ASSERT_TRUE(cJSON_Decode(flat));
+    cJSON_Delete(flat);
+    cJSON_Delete(copy);
+
+    cJSON_Delete(root);
+
+    // 手工链接的子节点可能没有设置 child->prev，释放时沿 next 找到最后一个
+    for (int pooled = 0; pooled < 2; ++pooled) {
+        cJSON *array = cJSON_CreateArray();
+        cJSON *first = cJSON_CreateNumber(1);
+        cJSON *second = cJSON_CreateNumber(2);
+        array->child = first;
+        first->next = second;
+        second->prev = first;
+        printed = cJSON_PrintUnformatted(array);
+        ASSERT_STREQ(printed, "[1,2]");
+        cJSON_free(printed);
+        if (pooled) {
+            cJSON_Pool *pool = cJSON_CreatePool();
+            cJSON_DeleteToPool(pool, array);
+            cJSON_DeletePool(pool);
+        } else {
+            cJSON_Delete(array);
+        }
+    }
+}
+
+TEST(cjson_wrapper, reclaimer)
+{
+    // cJSON_DeleteSlice 每次最多释放指定个数的节点
+    cJSON *root = cJSON_Parse("[{\"a\":1,\"b\":[2,3]},\"a string value that is long enough\",[]]");
+    int slices = 0;
+    while (root != nullptr) {
+        root = cJSON_DeleteSlice(root, 3);
+        ++slices;
+    }
+    ASSERT_EQ(slices, 3); // 8个节点
+
+    std::string text = "[";
+    for (int i = 0; i < 1000; ++i) {
+        text += (i == 0 ? "{\"id\":" : ",{\"id\":") + std::to_string(i) + ",\"name\":\"a name longer than the inline size\"}";
+    }
+    text += "]";
+
+    // 分批释放
+    auto incremental = std::make_shared<JsonReclaimer>(JsonReclaimer::Incremental);
+    {
+        JsonDocument doc = JsonDocument::fromJson(text);
+        doc.setReclaimer(incremental);
+        JsonDocument copy(doc);
+        ASSERT_TRUE(copy.reclaimer() == incremental);
+        doc.setArray(JsonArray{1, 2, 3});
+        ASSERT_EQ(doc.toJson(JsonDocument::Compact), "[1,2,3]");
+    }
+    slices = 0;
+    while (incremental->reclaim(1000)) {
+        ++slices;
+    }
+    ASSERT_EQ(slices, 6); // 两棵 3001 个节点的树和 [1,2,3]
+    ASSERT_FALSE(incremental->reclaim(1000));
+
+    // 没有 pool 时 reset 和 compact 也把旧的树交给 reclaimer，有 pool 时放回 pool
+    {
+        JsonDocument doc = JsonDocument::fromJson(text);
+        doc.setReclaimer(incremental);
+        doc.compact();
+        ASSERT_TRUE(incremental->reclaim(1000));
+        while (incremental->reclaim(1000)) {
+        }
+        doc.reset();
+        ASSERT_TRUE(doc.isNull());
+        ASSERT_TRUE(incremental->reclaim(1));
+        while (incremental->reclaim(1000)) {
+        }
+        ASSERT_TRUE(doc.parseInto(text));
+        doc.compact();
+        doc.reset();
+        ASSERT_FALSE(incremental->reclaim(1000));
+        ASSERT_TRUE(doc.parseInto(text));
+        ASSERT_EQ(doc[999].toObject().value("id").toInt(), 999);
+    }
+    while (incremental->reclaim(1000)) {
+    }
+
+    // 后台线程释放，多个线程可以共用
+    auto background = std::make_shared<JsonReclaimer>();
+    ASSERT_EQ(background->mode(), JsonReclaimer::Background);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&text, &background] {
+            for (int j = 0; j < 10; ++j) {
+                JsonDocument doc;
+                doc.setReclaimer(background);
+                ASSERT_TRUE(doc.parseInto(text));
+                ASSERT_EQ(doc[999].toObject().value("id").toInt(), 999);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    background->flush();
+    ASSERT_FALSE(background->reclaim(1));
+}
+
+// 记录从 resource 申请了多少块内存、还有多少块没有释放
+class CountingResource : public JsonMemoryResource
+{
+public:
+    CountingResource() : allocations(0), live(0) {}
+
+    void *allocate(size_t size) override
+    {
+        ++allocations;
+        ++live;
+        return malloc(size);
+    }
+    void deallocate(void *pointer) override
+    {
+        EXPECT_TRUE(pointer != nullptr);
+        --live;
+        free(pointer);
+    }
+
+    size_t allocations;
+    size_t live;
+};
+
+TEST(cjson_wrapper, memory_resource)
+{
+    std::string text = "[";
+    for (int i = 0; i < 100; ++i) {
+        text += (i == 0 ? "{\"id\":" : ",{\"id\":") + std::to_string(i) + ",\"name\":\"a name longer than the inline size\"}";
+    }
+    text += "]";
+
+    auto resource = std::make_shared<CountingResource>();
+    JsonParseOptions options;
+    options.memoryResource = resource;
+
+    cJSON_Hooks hooks = {countingMalloc, free};
+    cJSON_InitHooks(&hooks);
+    g_mallocCount = 0;
+    {
+        // 解析出的节点和字符串都从 resource 申请
+        JsonDocument doc = JsonDocument::fromJson(text, options);
+        ASSERT_TRUE(doc.memoryResource() == resource);
+        ASSERT_EQ(g_mallocCount, 0u);
+        const size_t parsed = resource->allocations;
+        ASSERT_GT(parsed, 100u);
+
+        // 按下标读取时建立的索引也在 resource 中，取出的值使用全局内存
+        ASSERT_EQ(doc[99].toObject().value("id").toInt(), 99);
+        ASSERT_EQ(resource->allocations, parsed + 1);
+
+        // 拷贝和 setObject 一次申请整棵树
+        JsonDocument copy(doc);
+        ASSERT_TRUE(copy.memoryResource() == resource);
+        ASSERT_EQ(resource->allocations, parsed + 2);
+        copy.setObject(JsonObject{{"a", 1}});
+        ASSERT_EQ(resource->allocations, parsed + 3);
+
+        // parseInto 使用的 pool 也在 resource 中，第二次解析不再申请
+        ASSERT_TRUE(copy.parseInto(text));
+        const size_t reused = resource->allocations;
+        ASSERT_TRUE(copy.parseInto(text));
+        ASSERT_EQ(resource->allocations, reused);
+
+        // 换回全局内存时树复制过去
+        g_mallocCount = 0;
+        copy.setMemoryResource(nullptr);
+        ASSERT_EQ(g_mallocCount, 1u);
+        ASSERT_TRUE(copy == doc);
+    }
+    ASSERT_EQ(resource->live, 0u);
+
+    // 不同内存中的节点可以放在同一棵树中，各自释放回自己的内存
+    cJSON_Allocator allocator = {
+        [](void *context, size_t size) {return static_cast<CountingResource*>(context)->allocate(size);},
+        [](void *context, void *pointer) {static_cast<CountingResource*>(context)->deallocate(pointer);},
+        resource.get()
+    };
+    cJSON *global = cJSON_Parse("{\"a\":\"a string value that is long enough\"}");
+    cJSON *tree = cJSON_DuplicateWithAllocator(global, 1, &allocator);
+    ASSERT_EQ(resource->live, 4u); // 两个节点、key 和字符串
+    ASSERT_TRUE(cJSON_AddItemToObject(tree, "b", cJSON_Duplicate(global, 1)));
+    ASSERT_EQ(resource->live, 4u);
+    ASSERT_TRUE(cJSON_SetValuestring(cJSON_GetObjectItem(tree, "a"), "another string value that is longer") != nullptr);
+    ASSERT_EQ(resource->live, 4u);
+    cJSON_Delete(global);
+    cJSON_Delete(tree);
+    ASSERT_EQ(resource->live, 0u);
+
+    // 空的打包数组没有缓冲区，放回 pool 时不会把 NULL 交给 allocator
+    cJSON_Pool *pool = cJSON_CreatePoolWithAllocator(&allocator);
+    cJSON_ParseOptions parseOptions;
+    cJSON_InitParseOptions(&parseOptions);
+    parseOptions.pool = pool;
+    parseOptions.allocator = &allocator;
+    const char empty[] = "{\"a\":[]}";
+    tree = cJSON_ParseWithOptions(empty, sizeof(empty) - 1, &parseOptions, nullptr);
+    ASSERT_TRUE(tree != nullptr);
+    ASSERT_TRUE(cJSON_PackArray(cJSON_GetObjectItem(tree, "a")));
+    ASSERT_TRUE(cJSON_GetPackedArrayData(cJSON_GetObjectItem(tree, "a")) == nullptr);
+    cJSON_DeleteToPool(pool, tree);
+    cJSON_DeletePool(pool);
+    ASSERT_EQ(resource->live, 0u);
+    cJSON_InitHooks(nullptr);
+
+    // 交给 reclaimer 的树释放完之前 resource 不会析构
+    auto reclaimer = std::make_shared<JsonReclaimer>(JsonReclaimer::Incremental);
+    std::weak_ptr<CountingResource> temporary;
+    {
+        auto requestResource = std::make_shared<CountingResource>();
+        temporary = requestResource;
+        JsonDocument doc;
+        doc.setReclaimer(reclaimer);
+        doc.setMemoryResource(requestResource);
+        ASSERT_TRUE(doc.parseInto(text));
+    }
+    ASSERT_FALSE(temporary.expired());
+    while (reclaimer->reclaim(100)) {
+    }
+    ASSERT_TRUE(temporary.expired());
+}
+
+TEST(cjson_wrapper, pool_resource)
+{
+    std::string text = "[";
+    for (int i = 0; i < 100; ++i) {
+        text += (i == 0 ? "{\"id\":" : ",{\"id\":") + std::to_string(i) + ",\"name\":\"a name longer than the inline size\"}";
+    }
+    text += "]";
+
+    // 预先申请之后，多个线程同时解析和拷贝不再向系统申请 slab
+    auto pool = std::make_shared<JsonPoolResource>(64 * 1024);
+    pool->reserve(4 * 1024 * 1024);
+    const size_t reserved = pool->slabCount();
+    ASSERT_EQ(reserved, 64u);
+    JsonParseOptions options;
+    options.memoryResource = pool;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&text, &options] {
+            for (int j = 0; j < 20; ++j) {
+                JsonDocument doc = JsonDocument::fromJson(text, options);
+                ASSERT_EQ(doc[99].toObject().value("id").toInt(), 99);
+                JsonDocument copy(doc);
+                ASSERT_TRUE(copy == doc);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(pool->slabCount(), reserved);
+
+    // 其他线程释放的块还给申请它的线程，之后再次申请时使用的还是这些块
+    JsonPoolResource blocks;
+    std::vector<void*> allocated;
+    for (int i = 0; i < 1000; ++i) {
+        allocated.push_back(blocks.allocate(80));
+    }
+    std::thread([&blocks, &allocated] {
+        for (void *pointer : allocated) {
+            blocks.deallocate(pointer);
+        }
+    }).join();
+    std::vector<void*> reused;
+    for (int i = 0; i < 1000; ++i) {
+        reused.push_back(blocks.allocate(80));
+    }
+    ASSERT_EQ(blocks.slabCount(), 1u);
+    std::sort(allocated.begin(), allocated.end());
+    std::sort(reused.begin(), reused.end());
+    ASSERT_TRUE(allocated == reused);
+    for (void *pointer : reused) {
+        blocks.deallocate(pointer);
+    }
+
+    // 超过最大分级的直接使用 malloc
+    void *large = blocks.allocate(100000);
+    ASSERT_TRUE(large != nullptr);
+    memset(large, 0, 100000);
+    blocks.deallocate(large);
+}
+
+TEST(cjson_wrapper, compact)
+{
+    std::string text = "{\"list\":[";
+    for (int i = 0; i < 100; ++i) {
+        text += (i == 0 ? "{\"id\":" : ",{\"id\":") + std::to_string(i) + ",\"name\":\"a name longer than the inline size\"}";
+    }
+    text += "],\"name\":\"config\"}";
+
+    // 逐个申请的节点和字符串整理到一块内存中，内容不变
+    auto resource = std::make_shared<CountingResource>();
+    JsonParseOptions options;
+    options.memoryResource = resource;
+    JsonDocument doc = JsonDocument::fromJson(text, options);
+    const std::string json = doc.toJson(JsonDocument::Compact);
+    ASSERT_GT(resource->live, 100u);
+    doc.compact();
+    ASSERT_EQ(resource->live, 1u);
+    ASSERT_EQ(doc.toJson(JsonDocument::Compact), json);
+    ASSERT_EQ(doc["name"].toString(), "config");
+    ASSERT_EQ(doc["list"].toArray().at(99).toObject().value("id").toInt(), 99);
+
+    // 设置了 reclaimer 时旧的树交给 reclaimer 释放
+    auto reclaimer = std::make_shared<JsonReclaimer>(JsonReclaimer::Incremental);
+    JsonDocument reclaimed = JsonDocument::fromJson(text, options);
+    reclaimed.setReclaimer(reclaimer);
+    const size_t live = resource->live;
+    reclaimed.compact();
+    ASSERT_EQ(resource->live, live + 1);
+    while (reclaimer->reclaim(100)) {
+    }
+    ASSERT_EQ(resource->live, 2u);
+    ASSERT_TRUE(reclaimed == doc);
+
+    // 延迟解码的文档整理之后仍然可以读取，parseInto 的旧节点还给 pool
+    JsonParseOptions lazyOptions;
+    lazyOptions.lazy = true;
+    JsonDocument lazy;
+    ASSERT_TRUE(lazy.parseInto(text, lazyOptions));
+    lazy.compact();
+    ASSERT_EQ(lazy["list"].toArray().at(42).toObject().value("name").toString(), "a name longer than the inline size");
+    ASSERT_EQ(lazy.toJson(JsonDocument::Compact), json);
+    ASSERT_TRUE(lazy.parseInto(text, lazyOptions));
+    ASSERT_TRUE(lazy == doc);
+
+    JsonDocument empty;
+    empty.compact();
+    ASSERT_TRUE(empty.isNull());
+}